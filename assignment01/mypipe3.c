@@ -1,6 +1,8 @@
 /*
  * File: mypipe3.c
  * Purpose: Connects 3 commands using pipes (cmd1 | cmd2 | cmd3)
+ *          A command without shell metacharacters is exec'd directly;
+ *          only the others go through sh -c.
  * Author: Sean Balbale
  * Date: 1/28/2026
  */
@@ -8,8 +10,29 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/wait.h>
 
+#define MAX_ARGS 64
+
+// Replace this (child) process with cmd. Plain words are exec'd as they
+// are; anything the shell would interpret, or a name that is not a
+// program (a shell builtin), goes to sh -c.
+void exec_command(const char *cmd) {
+    size_t first = strcspn(cmd, " \t");
+    if (strpbrk(cmd, "|&;<>()$`\\\"'*?[]#~{}!\n") == NULL && memchr(cmd, '=', first) == NULL) {
+        char *copy = strdup(cmd);
+        char *args[MAX_ARGS + 1];
+        int n = 0;
+        for (char *tok = strtok(copy, " \t"); tok != NULL && n < MAX_ARGS; tok = strtok(NULL, " \t"))
+            args[n++] = tok;
+        args[n] = NULL;
+        if (n > 0)
+            execvp(args[0], args);
+    }
+    execlp("sh", "sh", "-c", cmd, (char *)NULL);
+}
+
 int main(int argc, char *argv[]) {
     // Expect exactly 3 commands
     if (argc != 4) {
@@ -39,7 +62,7 @@ int main(int argc, char *argv[]) {
         close(fd1[1]);
         
         // Execute cmd1
-        execlp("sh", "sh", "-c", argv[1], (char *)NULL);
+        exec_command(argv[1]);
         perror("exec1");
         exit(1);
     default: /* parent */
@@ -70,7 +93,7 @@ int main(int argc, char *argv[]) {
         close(fd2[1]);
 
         // Execute cmd2
-        execlp("sh", "sh", "-c", argv[2], (char *)NULL);
+        exec_command(argv[2]);
         perror("exec2");
         exit(1);
     default: /* parent */
@@ -96,7 +119,7 @@ int main(int argc, char *argv[]) {
         close(fd2[1]);
 
         // Execute cmd3
-        execlp("sh", "sh", "-c", argv[3], (char *)NULL);
+        exec_command(argv[3]);
         perror("exec3");
         exit(1);
     default: /* parent */
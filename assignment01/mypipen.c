@@ -1,79 +1,269 @@
 /*
  * File: mypipen.c
  * Purpose: Connects n commands using pipes (cmd1 | ... | cmdn)
+ *          A command starting with @ is a built-in stage (@cat, @tee FILE...)
+ *          that forwards with splice/tee instead of copying; -z turns plain
+ *          "cat" and "tee FILE..." stages into those built-ins. -p SIZE
+ *          sets the size of every pipe, -p LINK=SIZE the pipe after stage
+ *          LINK (1-based); sizes take K and M suffixes.
+ *          -m relays every link through a measuring thread and reports
+ *          throughput, starved/stalled time and CPU time per stage, live
+ *          every -i SECONDS on a terminal and as a summary at the end.
+ *          -r STAGE=K[:rr|hash|order] runs K copies of stage STAGE fed
+ *          with whole lines, to spread a slow filter over several cores.
+ *          @wc, @head, @grep, @cut, @uniq and @sort run as threads of
+ *          mypipen (adjacent ones joined by in-memory rings, except under
+ *          -m); other plain commands are spawned without sh -c.
+ * Build: gcc -O2 -pthread mypipen.c -o mypipen
  * Author: Sean Balbale
  * Date: 1/28/2026
  */
 
+#define _GNU_SOURCE // splice, tee, F_SETPIPE_SZ
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/wait.h>
+#include "mypipen_splice.h"
+#include "mypipen_monitor.h"
+#include "mypipen_inproc.h"
+#include "mypipen_replicate.h"
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-z] [-m [-i SECONDS]] [-p SIZE | -p LINK=SIZE]... [-r STAGE=K[:rr|hash|order]]... cmd1 cmd2 ... cmdn\n", prog);
+    exit(1);
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s cmd1 cmd2 ... cmdn\n", argv[0]);
-        exit(1);
+    int first = 1;      // argv index of the first command
+    int zero_copy = 0;  // -z
+    int monitor = 0;    // -m
+    double interval = 1.0;
+    long default_size = 0;
+    long *link_size = calloc(argc, sizeof(long)); // Pipe after stage i (1-based), 0 = default
+    int *replicas = calloc(argc, sizeof(int));    // Copies of stage i (1-based), 0 = just one
+    int *rep_mode = calloc(argc, sizeof(int));
+    int max_link = 0, max_stage = 0; // Highest -p LINK and -r STAGE, checked once the commands are known
+
+    // Options come before the commands
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "--") == 0) {
+            first++;
+            break;
+        }
+        if (strcmp(argv[first], "-z") == 0) {
+            zero_copy = 1;
+            first++;
+        } else if (strcmp(argv[first], "-m") == 0) {
+            monitor = 1;
+            first++;
+        } else if (strcmp(argv[first], "-i") == 0 && first + 1 < argc) {
+            interval = atof(argv[first + 1]);
+            if (interval <= 0)
+                usage(argv[0]);
+            first += 2;
+        } else if (strcmp(argv[first], "-p") == 0 && first + 1 < argc) {
+            char *arg = argv[first + 1], *eq = strchr(arg, '=');
+            long size = parse_size(eq ? eq + 1 : arg);
+            char *end;
+            int link = eq ? (int)strtol(arg, &end, 10) : 0;
+            if (size < 0 || (eq && (end != eq || link < 1 || link >= argc)))
+                usage(argv[0]);
+            if (eq)
+                link_size[link] = size;
+            if (link > max_link)
+                max_link = link;
+            else
+                default_size = size;
+            first += 2;
+        } else if (strcmp(argv[first], "-r") == 0 && first + 1 < argc) {
+            char *arg = argv[first + 1], *eq = strchr(arg, '=');
+            char *end;
+            int stage = (int)strtol(arg, &end, 10);
+            if (eq == NULL || end != eq || stage < 1 || stage >= argc)
+                usage(argv[0]);
+            if (stage > max_stage)
+                max_stage = stage;
+            replicas[stage] = parse_replicas(eq + 1, &rep_mode[stage]);
+            if (replicas[stage] < 0)
+                usage(argv[0]);
+            first += 2;
+        } else {
+            usage(argv[0]);
+        }
     }
+    // A link lies between two stages; a replicated stage must exist
+    if (first >= argc || max_link >= argc - first || max_stage > argc - first)
+        usage(argv[0]);
 
     int i;
     int prev_pipe_read = STDIN_FILENO; // Initial input is stdin
     int fd[2];
+    int next_read = -1; // Read end for the next command: fd[0], or the relay's pipe
+    struct ring *prev_ring = NULL, *next_ring = NULL; // Between two in-process stages
+    int nstages = argc - first;
+    struct stage_stats *stages = calloc(nstages, sizeof(struct stage_stats));
+    struct link_stats *links = calloc(nstages, sizeof(struct link_stats));
+    struct inproc_stage *threads = calloc(nstages, sizeof(struct inproc_stage));
+    int *kept_fds = malloc(4 * nstages * sizeof(int)); // Ends only the parent's threads may hold
+    int nkept = 0;
+    long long start_ns = now_ns();
 
-    for (i = 1; i < argc; i++) {
+    for (i = first; i < argc; i++) {
         // Create pipe for next connection, unless it's the last command
         // We need a pipe between command i and i+1
         int is_last = (i == argc - 1);
+        int s = i - first;
+        const char *cmd = zero_copy ? zero_copy_rewrite(argv[i]) : argv[i];
+        int threaded = is_inproc(cmd) && replicas[s + 1] <= 1;
+        int next_threaded = !is_last && is_inproc(argv[i + 1]) && replicas[s + 2] <= 1;
 
-        if (!is_last) {
+        next_ring = NULL;
+        if (threaded && next_threaded && !monitor) {
+            next_ring = ring_new();
+        } else if (!is_last) {
             if (pipe(fd) == -1) {
                 perror("pipe");
                 exit(1);
             }
+            long size = link_size[s + 1] ? link_size[s + 1] : default_size;
+            set_pipe_size(fd[1], size);
+            next_read = fd[0];
+            if (monitor) {
+                // Command i writes fd, the relay moves it into down
+                int down[2];
+                if (pipe(down) == -1) {
+                    perror("pipe");
+                    exit(1);
+                }
+                set_pipe_size(down[1], size);
+                fcntl(fd[0], F_SETFL, O_NONBLOCK);
+                fcntl(down[1], F_SETFL, O_NONBLOCK);
+                links[s].in = fd[0];
+                links[s].out = down[1];
+                kept_fds[nkept++] = fd[0];
+                kept_fds[nkept++] = down[1];
+                next_read = down[0];
+            }
         }
 
-        switch (fork())
-        {
-        case -1:
-            perror("Fork");
-            exit(1);
-        case 0: /* child */
-            // Setup input: read from previous pipe (if not first command)
-            // If prev_pipe_read is STDIN, we just leave STDIN alone.
-            if (prev_pipe_read != STDIN_FILENO) {
-                dup2(prev_pipe_read, STDIN_FILENO);
-                close(prev_pipe_read);
+        stages[s].cmd = argv[i];
+        if (threaded) {
+            // Runs in a thread once every process is started; it keeps its ends
+            struct inproc_stage *t = &threads[s];
+            t->cmd = cmd;
+            t->in = (struct stream){prev_pipe_read, prev_ring};
+            t->out = (struct stream){is_last ? STDOUT_FILENO : fd[1], next_ring};
+            t->stats = monitor ? &stages[s] : NULL;
+            if (prev_ring == NULL && prev_pipe_read != STDIN_FILENO)
+                kept_fds[nkept++] = prev_pipe_read;
+            if (next_ring == NULL && !is_last)
+                kept_fds[nkept++] = fd[1];
+            prev_ring = next_ring;
+            prev_pipe_read = next_ring ? -1 : next_read;
+            continue;
+        }
+        if (!is_builtin(cmd) && replicas[s + 1] <= 1) {
+            // An external command: spawned directly, and without sh if it is plain
+            int closefds[4 * nstages + 1], nclose = 0;
+            for (int r = 0; r < nkept; r++)
+                closefds[nclose++] = kept_fds[r];
+            if (!is_last)
+                closefds[nclose++] = next_read;
+            stages[s].pid = spawn_command(cmd, prev_pipe_read, is_last ? STDOUT_FILENO : fd[1], closefds, nclose);
+            if (stages[s].pid < 0) {
+                stages[s].exited = 1;
+                stages[s].status = 127 << 8;
             }
+        } else {
+            switch ((stages[s].pid = fork()))
+            {
+            case -1:
+                perror("Fork");
+                exit(1);
+            case 0: /* child */
+                // Setup input: read from previous pipe (if not first command)
+                // If prev_pipe_read is STDIN, we just leave STDIN alone.
+                if (prev_pipe_read != STDIN_FILENO) {
+                    dup2(prev_pipe_read, STDIN_FILENO);
+                    close(prev_pipe_read);
+                }
+
+                // Setup output: write to current pipe (if not last command)
+                if (!is_last) {
+                    dup2(fd[1], STDOUT_FILENO);
+                    close(fd[1]);
+                    close(next_read); // Close read end of new pipe in child
+                }
+                // The threads' ends stay with the parent, or EOF never arrives
+                for (int r = 0; r < nkept; r++)
+                    close(kept_fds[r]);
 
-            // Setup output: write to current pipe (if not last command)
-            if (!is_last) {
-                dup2(fd[1], STDOUT_FILENO);
-                close(fd[1]);
-                close(fd[0]); // Close read end of new pipe in child
+                // Execute command: a built-in runs right here
+                if (replicas[s + 1] > 1)
+                    exit(run_replicated(cmd, replicas[s + 1], rep_mode[s + 1]));
+                exec_command(cmd);
+            default: /* parent */
+                break;
             }
+        }
+
+        // Close previous pipe read end (if not stdin)
+        if (prev_pipe_read != STDIN_FILENO) {
+            close(prev_pipe_read);
+        }
 
-            // Execute command
-            execlp("sh", "sh", "-c", argv[i], (char *)NULL);
-            perror("exec");
+        // If not last command, save current pipe read end for next iteration
+        // and close write end
+        if (!is_last) {
+            close(fd[1]);
+            prev_pipe_read = next_read;
+        }
+        prev_ring = NULL;
+    }
+
+    for (int s = 0; s < nstages; s++) {
+        if (threads[s].cmd != NULL && pthread_create(&threads[s].tid, NULL, inproc_main, &threads[s]) != 0) {
+            perror("pthread_create");
             exit(1);
-        default: /* parent */
-            // Close previous pipe read end (if not stdin)
-            if (prev_pipe_read != STDIN_FILENO) {
-                close(prev_pipe_read);
-            }
+        }
+    }
 
-            // If not last command, save current pipe read end for next iteration
-            // and close write end
-            if (!is_last) {
-                close(fd[1]);
-                prev_pipe_read = fd[0];
-            }
-            break;
+    if (!monitor) {
+        // Wait for all children, then the threads
+        while (wait(NULL) > 0);
+        for (int s = 0; s < nstages; s++) {
+            if (threads[s].cmd != NULL)
+                pthread_join(threads[s].tid, NULL);
         }
+        return 0;
     }
 
-    // Wait for all children
-    while (wait(NULL) > 0);
+    // Monitor: start the relays, then reap and redraw until every stage is done
+    for (int l = 0; l < nstages - 1; l++) {
+        if (pthread_create(&links[l].tid, NULL, relay_main, &links[l]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    int live = isatty(STDERR_FILENO), drawn = 0;
+    long long *last = calloc(3 * nstages, sizeof(long long));
+    long long next_draw = now_ns() + (long long)(interval * 1e9);
+    struct timespec tick = {0, 20000000};
+    while (reap_stages(stages, nstages) > 0) {
+        if (live && now_ns() >= next_draw) {
+            draw_live(stages, nstages, links, last, last + nstages, last + 2 * nstages, interval, drawn++);
+            next_draw += (long long)(interval * 1e9);
+        }
+        nanosleep(&tick, NULL);
+    }
+    for (int l = 0; l < nstages - 1; l++)
+        pthread_join(links[l].tid, NULL);
+    for (int s = 0; s < nstages; s++) {
+        if (threads[s].cmd != NULL)
+            pthread_join(threads[s].tid, NULL);
+    }
+    print_summary(stages, nstages, links, start_ns);
 
     return 0;
 }
@@ -0,0 +1,525 @@
+/*
+ * File: mypipen_inproc.h
+ * Purpose: Stages that need no shell. The text built-ins below run as
+ *          threads of mypipen itself; two of them in a row pass data
+ *          through an in-memory ring instead of a kernel pipe:
+ *            @wc [-l] [-w] [-c]        counts (all three by default)
+ *            @head [-n N | -N]         first N lines (10)
+ *            @grep [-v] [-c] STRING    lines containing STRING (no regex)
+ *            @cut [-d C] -f LIST       fields, e.g. 1,3 or 2-4 or 5-
+ *            @uniq [-c]                collapse adjacent equal lines
+ *            @sort [-brn] [-k F[,G]]... external merge sort, mypipen_sort.h
+ *          A stage that is a plain command line (no shell metacharacters)
+ *          is started with posix_spawnp on its own argv instead of sh -c.
+ * Author: Sean Balbale
+ * Date: 10/17/2026
+ */
+
+#ifndef MYPIPEN_INPROC_H
+#define MYPIPEN_INPROC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#define RING_SIZE (1 << 20)
+
+extern char **environ;
+
+// Byte stream between two in-process stages: one writer, one reader
+struct ring {
+    char *buf;
+    size_t head, tail; // Bytes read and written so far; tail - head are queued
+    int eof;           // Writer is done
+    int gone;          // Reader is done; writes fail like EPIPE
+    pthread_mutex_t lock;
+    pthread_cond_t readable, writable;
+};
+
+// Where a stage reads or writes: a ring, or else an fd
+struct stream {
+    int fd;
+    struct ring *ring;
+};
+
+// One in-process stage
+struct inproc_stage {
+    const char *cmd;
+    struct stream in, out;
+    struct stage_stats *stats; // -m: CPU time and exit, or NULL
+    pthread_t tid;
+    int status;
+};
+
+static struct ring *ring_new(void) {
+    struct ring *r = calloc(1, sizeof(struct ring));
+    r->buf = malloc(RING_SIZE);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->readable, NULL);
+    pthread_cond_init(&r->writable, NULL);
+    return r;
+}
+
+static int ring_write(struct ring *r, const char *data, size_t n) {
+    pthread_mutex_lock(&r->lock);
+    while (n > 0) {
+        while (r->tail - r->head == RING_SIZE && !r->gone)
+            pthread_cond_wait(&r->writable, &r->lock);
+        if (r->gone) {
+            pthread_mutex_unlock(&r->lock);
+            return -1;
+        }
+        size_t at = r->tail % RING_SIZE;
+        size_t room = RING_SIZE - (r->tail - r->head);
+        size_t len = n < room ? n : room;
+        size_t first = len < RING_SIZE - at ? len : RING_SIZE - at;
+        memcpy(r->buf + at, data, first);
+        memcpy(r->buf, data + first, len - first);
+        r->tail += len;
+        data += len;
+        n -= len;
+        pthread_cond_signal(&r->readable);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return 0;
+}
+
+// Up to max bytes; 0 once the writer is done and the ring is empty
+static size_t ring_read(struct ring *r, char *buf, size_t max) {
+    pthread_mutex_lock(&r->lock);
+    while (r->tail == r->head && !r->eof)
+        pthread_cond_wait(&r->readable, &r->lock);
+    size_t at = r->head % RING_SIZE;
+    size_t len = r->tail - r->head < max ? r->tail - r->head : max;
+    size_t first = len < RING_SIZE - at ? len : RING_SIZE - at;
+    memcpy(buf, r->buf + at, first);
+    memcpy(buf + first, r->buf, len - first);
+    r->head += len;
+    pthread_cond_signal(&r->writable);
+    pthread_mutex_unlock(&r->lock);
+    return len;
+}
+
+static void ring_close(struct ring *r, int *flag) {
+    pthread_mutex_lock(&r->lock);
+    *flag = 1;
+    pthread_cond_broadcast(&r->readable);
+    pthread_cond_broadcast(&r->writable);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static ssize_t stream_read(struct stream *s, char *buf, size_t max) {
+    if (s->ring != NULL)
+        return ring_read(s->ring, buf, max);
+    for (;;) {
+        ssize_t n = read(s->fd, buf, max);
+        if (n >= 0 || errno != EINTR)
+            return n;
+    }
+}
+
+static int stream_write(struct stream *s, const char *buf, size_t n) {
+    return s->ring != NULL ? ring_write(s->ring, buf, n) : write_all(s->fd, buf, n);
+}
+
+// Offset just past the last newline in buf[0..len), or 0
+static size_t line_end(const char *buf, size_t len) {
+    const char *nl = memrchr(buf, '\n', len);
+    return nl ? (size_t)(nl - buf) + 1 : 0;
+}
+
+// Line-at-a-time input
+struct reader {
+    struct stream *in;
+    char *buf;
+    size_t len, off, cap;
+    int eof;
+};
+
+// The next line without its newline, or NULL at the end; *n gets its length
+static char *next_line(struct reader *rd, size_t *n) {
+    for (;;) {
+        char *nl = rd->off < rd->len ? memchr(rd->buf + rd->off, '\n', rd->len - rd->off) : NULL;
+        if (nl != NULL || (rd->eof && rd->off < rd->len)) {
+            char *line = rd->buf + rd->off;
+            *n = nl ? (size_t)(nl - line) : rd->len - rd->off;
+            rd->off += *n + (nl != NULL);
+            return line;
+        }
+        if (rd->eof)
+            return NULL;
+        memmove(rd->buf, rd->buf + rd->off, rd->len - rd->off);
+        rd->len -= rd->off;
+        rd->off = 0;
+        if (rd->cap - rd->len < COPY_BUF_SIZE) {
+            rd->cap = rd->cap ? rd->cap * 2 : 2 * COPY_BUF_SIZE;
+            rd->buf = realloc(rd->buf, rd->cap);
+        }
+        ssize_t got = stream_read(rd->in, rd->buf + rd->len, rd->cap - rd->len);
+        if (got <= 0)
+            rd->eof = 1;
+        else
+            rd->len += got;
+    }
+}
+
+// Buffered output; after a failed write (reader gone) everything is dropped
+struct writer {
+    struct stream *out;
+    char buf[COPY_BUF_SIZE];
+    size_t len;
+    int failed;
+};
+
+static void flush_out(struct writer *w) {
+    if (!w->failed && w->len > 0 && stream_write(w->out, w->buf, w->len) < 0)
+        w->failed = 1;
+    w->len = 0;
+}
+
+static void put(struct writer *w, const char *data, size_t n) {
+    if (w->len + n > sizeof(w->buf))
+        flush_out(w);
+    if (n > sizeof(w->buf)) {
+        if (!w->failed && stream_write(w->out, data, n) < 0)
+            w->failed = 1;
+        return;
+    }
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+}
+
+static void put_line(struct writer *w, const char *line, size_t n) {
+    put(w, line, n);
+    put(w, "\n", 1);
+}
+
+static int inproc_wc(int argc, char **argv, struct stream *in, struct writer *w) {
+    int lines = 0, words = 0, bytes = 0, in_word = 0;
+    long long nl = 0, nw = 0, nc = 0;
+    char buf[COPY_BUF_SIZE], line[96];
+    for (int k = 1; k < argc; k++) {
+        lines |= strchr(argv[k], 'l') != NULL;
+        words |= strchr(argv[k], 'w') != NULL;
+        bytes |= strchr(argv[k], 'c') != NULL;
+    }
+    if (!lines && !words && !bytes)
+        lines = words = bytes = 1;
+
+    ssize_t n;
+    while ((n = stream_read(in, buf, sizeof(buf))) > 0) {
+        nc += n;
+        if (!words) {
+            for (char *p = buf, *end = buf + n; (p = memchr(p, '\n', end - p)) != NULL; p++)
+                nl++;
+            continue;
+        }
+        for (ssize_t k = 0; k < n; k++) {
+            int space = isspace((unsigned char)buf[k]);
+            nl += buf[k] == '\n';
+            nw += !space && !in_word;
+            in_word = !space;
+        }
+    }
+    // One count alone, or each right-aligned like wc on a pipe
+    int single = lines + words + bytes == 1, len = 0;
+    const char *fmt = single ? "%lld" : "%7lld";
+    if (lines)
+        len += snprintf(line + len, sizeof(line) - len, fmt, nl);
+    if (words)
+        len += snprintf(line + len, sizeof(line) - len, len ? " %7lld" : fmt, nw);
+    if (bytes)
+        len += snprintf(line + len, sizeof(line) - len, len ? " %7lld" : fmt, nc);
+    put_line(w, line, len);
+    return 0;
+}
+
+static int inproc_head(int argc, char **argv, struct stream *in, struct writer *w) {
+    long long want = 10;
+    char buf[COPY_BUF_SIZE];
+    if (argc > 2 && strcmp(argv[1], "-n") == 0)
+        want = atoll(argv[2]);
+    else if (argc > 1 && argv[1][0] == '-')
+        want = atoll(argv[1] + 1);
+
+    ssize_t n;
+    while (want > 0 && (n = stream_read(in, buf, sizeof(buf))) > 0) {
+        char *p = buf, *end = buf + n;
+        while (want > 0 && p < end) {
+            char *nl = memchr(p, '\n', end - p);
+            if (nl == NULL)
+                break;
+            p = nl + 1;
+            want--;
+        }
+        put(w, buf, want > 0 ? (size_t)n : (size_t)(p - buf));
+    }
+    return 0;
+}
+
+static int inproc_grep(int argc, char **argv, struct stream *in, struct writer *w) {
+    int invert = 0, count = 0, k;
+    for (k = 1; k < argc - 1 && argv[k][0] == '-'; k++) {
+        invert |= strchr(argv[k], 'v') != NULL;
+        count |= strchr(argv[k], 'c') != NULL;
+    }
+    if (k != argc - 1) {
+        fprintf(stderr, "usage: @grep [-v] [-c] STRING\n");
+        return 2;
+    }
+    const char *pat = argv[k];
+    size_t plen = strlen(pat);
+    struct reader rd = {in, NULL, 0, 0, 0, 0};
+    long long matched = 0;
+    char *line;
+    size_t n;
+    while ((line = next_line(&rd, &n)) != NULL && !w->failed) {
+        if ((memmem(line, n, pat, plen) != NULL) != invert) {
+            matched++;
+            if (!count)
+                put_line(w, line, n);
+        }
+    }
+    if (count) {
+        char num[32];
+        put_line(w, num, snprintf(num, sizeof(num), "%lld", matched));
+    }
+    free(rd.buf);
+    return matched ? 0 : 1;
+}
+
+// Field list "1,3-4,6-": up to CUT_MAX_RANGES [lo, hi] pairs, hi 0 = to the end
+#define CUT_MAX_RANGES 32
+
+static int inproc_cut(int argc, char **argv, struct stream *in, struct writer *w) {
+    char delim = '\t';
+    const char *list = NULL;
+    long lo[CUT_MAX_RANGES], hi[CUT_MAX_RANGES];
+    int nranges = 0;
+    for (int k = 1; k < argc; k++) {
+        if (strncmp(argv[k], "-d", 2) == 0)
+            delim = argv[k][2] ? argv[k][2] : (k + 1 < argc ? argv[++k][0] : '\t');
+        else if (strncmp(argv[k], "-f", 2) == 0)
+            list = argv[k][2] ? argv[k] + 2 : (k + 1 < argc ? argv[++k] : NULL);
+    }
+    for (const char *p = list; p != NULL && *p && nranges < CUT_MAX_RANGES;) {
+        char *end;
+        lo[nranges] = *p == '-' ? 1 : strtol(p, &end, 10);
+        if (*p != '-')
+            p = end;
+        hi[nranges] = lo[nranges];
+        if (*p == '-') {
+            p++;
+            hi[nranges] = (*p >= '0' && *p <= '9') ? strtol(p, &end, 10) : 0;
+            if (hi[nranges])
+                p = end;
+        }
+        if (lo[nranges] < 1 || (*p != ',' && *p != '\0'))
+            nranges = -1; // Malformed
+        if (nranges < 0)
+            break;
+        nranges++;
+        if (*p == ',')
+            p++;
+    }
+    if (nranges <= 0) {
+        fprintf(stderr, "usage: @cut [-d C] -f LIST\n");
+        return 1;
+    }
+
+    struct reader rd = {in, NULL, 0, 0, 0, 0};
+    char *line;
+    size_t n;
+    while ((line = next_line(&rd, &n)) != NULL && !w->failed) {
+        if (memchr(line, delim, n) == NULL) {
+            put_line(w, line, n); // No delimiter: the whole line, as cut does
+            continue;
+        }
+        int out = 0;
+        long field = 1;
+        for (char *p = line, *end = line + n; p <= end; field++) {
+            char *stop = memchr(p, delim, end - p);
+            if (stop == NULL)
+                stop = end;
+            for (int r = 0; r < nranges; r++) {
+                if (field >= lo[r] && (hi[r] == 0 || field <= hi[r])) {
+                    if (out++)
+                        put(w, &delim, 1);
+                    put(w, p, stop - p);
+                    break;
+                }
+            }
+            p = stop + 1;
+        }
+        put(w, "\n", 1);
+    }
+    free(rd.buf);
+    return 0;
+}
+
+static int inproc_uniq(int argc, char **argv, struct stream *in, struct writer *w) {
+    int count = argc > 1 && strcmp(argv[1], "-c") == 0;
+    struct reader rd = {in, NULL, 0, 0, 0, 0};
+    char *prev = NULL, *line, num[32];
+    size_t plen = 0, pcap = 0, n;
+    long long run = 0;
+    for (;;) {
+        line = next_line(&rd, &n);
+        if (run > 0 && (line == NULL || n != plen || memcmp(line, prev, n) != 0)) {
+            if (count)
+                put(w, num, snprintf(num, sizeof(num), "%7lld ", run));
+            put_line(w, prev, plen);
+            run = 0;
+        }
+        if (line == NULL || w->failed)
+            break;
+        if (run++ == 0) {
+            if (n > pcap) {
+                pcap = n * 2;
+                prev = realloc(prev, pcap);
+            }
+            memcpy(prev, line, n); // The reader reuses its buffer
+            plen = n;
+        }
+    }
+    free(prev);
+    free(rd.buf);
+    return 0;
+}
+
+// @sort is big enough for a file of its own; it needs the reader and writer above
+#include "mypipen_sort.h"
+
+static const char *const inproc_names[] = {"@wc", "@head", "@grep", "@cut", "@uniq", "@sort", NULL};
+
+// Whether cmd is one of the built-ins above
+static int is_inproc(const char *cmd) {
+    while (*cmd == ' ')
+        cmd++;
+    for (int k = 0; inproc_names[k] != NULL; k++) {
+        size_t len = strlen(inproc_names[k]);
+        if (strncmp(cmd, inproc_names[k], len) == 0 && (cmd[len] == '\0' || cmd[len] == ' '))
+            return 1;
+    }
+    return 0;
+}
+
+// Run a built-in from `in` to `out` on the calling thread
+static int run_inproc(const char *cmd, struct stream *in, struct stream *out) {
+    char *argv[BUILTIN_MAX_ARGS + 1];
+    char *copy = strdup(cmd);
+    int argc = split_args(copy, argv), status = 127;
+    struct writer *w = calloc(1, sizeof(struct writer));
+    w->out = out;
+    if (strcmp(argv[0], "@wc") == 0)
+        status = inproc_wc(argc, argv, in, w);
+    else if (strcmp(argv[0], "@head") == 0)
+        status = inproc_head(argc, argv, in, w);
+    else if (strcmp(argv[0], "@grep") == 0)
+        status = inproc_grep(argc, argv, in, w);
+    else if (strcmp(argv[0], "@cut") == 0)
+        status = inproc_cut(argc, argv, in, w);
+    else if (strcmp(argv[0], "@uniq") == 0)
+        status = inproc_uniq(argc, argv, in, w);
+    else if (strcmp(argv[0], "@sort") == 0)
+        status = inproc_sort(argc, argv, in, w);
+    flush_out(w);
+    free(w);
+    free(copy);
+    return status;
+}
+
+// Thread body of an in-process stage. Closing its ends is what the exit of
+// a process would do: EOF downstream, EPIPE upstream.
+static void *inproc_main(void *arg) {
+    struct inproc_stage *t = arg;
+    sigset_t pipe_set;
+
+    // A write into a pipe nobody reads fails with EPIPE instead of killing mypipen
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, NULL);
+
+    t->status = run_inproc(t->cmd, &t->in, &t->out);
+    if (t->out.ring != NULL)
+        ring_close(t->out.ring, &t->out.ring->eof);
+    else if (t->out.fd != STDOUT_FILENO)
+        close(t->out.fd);
+    if (t->in.ring != NULL)
+        ring_close(t->in.ring, &t->in.ring->gone);
+    else
+        close(t->in.fd);
+    if (t->stats != NULL) {
+        getrusage(RUSAGE_THREAD, &t->stats->ru);
+        t->stats->end_ns = now_ns();
+        t->stats->status = t->status << 8;
+        __atomic_store_n(&t->stats->exited, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// Whether cmd can run without sh: a first word that is not an assignment
+// and no metacharacters anywhere
+static int needs_shell(const char *cmd) {
+    size_t first = strcspn(cmd, " \t");
+    return strpbrk(cmd, SHELL_META) != NULL || memchr(cmd, '=', first) != NULL;
+}
+
+// Start an external command reading `in` and writing `out`, closing the
+// descriptors in `closefds` (and in, out themselves) in the child. Returns
+// the pid, or -1.
+static pid_t spawn_command(const char *cmd, int in, int out, const int *closefds, int nclose) {
+    char *argv[BUILTIN_MAX_ARGS + 1];
+    char *copy = NULL;
+    posix_spawn_file_actions_t fa;
+    pid_t pid;
+    int err;
+
+    if (needs_shell(cmd)) {
+        argv[0] = "sh";
+        argv[1] = "-c";
+        argv[2] = (char *)cmd;
+        argv[3] = NULL;
+    } else {
+        copy = strdup(cmd);
+        if (split_args(copy, argv) == 0) {
+            free(copy);
+            copy = NULL;
+            argv[0] = "true"; // An empty stage, as sh -c "" would be
+            argv[1] = NULL;
+        }
+    }
+    posix_spawn_file_actions_init(&fa);
+    if (in != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&fa, in, STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&fa, in);
+    }
+    if (out != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&fa, out, STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&fa, out);
+    }
+    for (int k = 0; k < nclose; k++)
+        posix_spawn_file_actions_addclose(&fa, closefds[k]);
+    err = posix_spawnp(&pid, argv[0], &fa, NULL, argv, environ);
+    if (err == ENOENT && copy != NULL) {
+        // Not a program: maybe a shell builtin or function
+        char *sh_argv[] = {"sh", "-c", (char *)cmd, NULL};
+        err = posix_spawnp(&pid, "sh", &fa, NULL, sh_argv, environ);
+    }
+    posix_spawn_file_actions_destroy(&fa);
+    free(copy);
+    if (err != 0) {
+        fprintf(stderr, "mypipen: %s: %s\n", cmd, strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+#endif
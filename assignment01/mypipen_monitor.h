@@ -0,0 +1,203 @@
+/*
+ * File: mypipen_monitor.h
+ * Purpose: Monitoring mode for mypipen (-m). Every link between two stages
+ *          gets a relay thread in the parent: stage i writes into one pipe,
+ *          the relay splices into a second pipe that stage i+1 reads. The
+ *          relay counts the bytes and times how long it waits for data
+ *          (stage i+1 starved by stage i) and for room (stage i stalled by
+ *          stage i+1). The parent reaps the stages with wait4 for their CPU
+ *          time, draws one live line per stage on a terminal and prints a
+ *          summary that names the stage busy for the longest time. A
+ *          stage's run ends when the relay after it sees EOF, or for the
+ *          last stage when it is reaped (on a 20 ms tick); built-in
+ *          stages record their own end.
+ * Author: Sean Balbale
+ * Date: 10/17/2026
+ */
+
+#ifndef MYPIPEN_MONITOR_H
+#define MYPIPEN_MONITOR_H
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+// One relayed link; the counters are written by its relay thread only
+struct link_stats {
+    int in, out; // Read end of the upstream pipe, write end of the downstream one
+    long long bytes;
+    long long starved_ns; // Waiting for stage i to write
+    long long stalled_ns; // Waiting for stage i+1 to read
+    long long start_ns, end_ns; // First byte, EOF
+    int done;
+    pthread_t tid;
+};
+
+// One stage, as seen by the parent
+struct stage_stats {
+    const char *cmd;
+    pid_t pid;
+    int exited;
+    int status;
+    long long end_ns;
+    struct rusage ru;
+};
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long load_ll(long long *p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static void add_ll(long long *p, long long v) {
+    __atomic_store_n(p, *p + v, __ATOMIC_RELAXED);
+}
+
+// Block in poll on one fd and charge the time to *counter
+static short timed_wait(int fd, short events, long long *counter) {
+    struct pollfd p = {fd, events, 0};
+    long long t0 = now_ns();
+    while (poll(&p, 1, -1) < 0 && errno == EINTR)
+        ;
+    add_ll(counter, now_ns() - t0);
+    return p.revents;
+}
+
+// Relay thread: non-blocking splice from the upstream pipe into the
+// downstream one. When splice would block, poll tells which side it is.
+static void *relay_main(void *arg) {
+    struct link_stats *ls = arg;
+    size_t chunk = splice_chunk(ls->in);
+    sigset_t pipe_set;
+
+    // A write to a stage that has exited fails with EPIPE here instead of
+    // killing mypipen; the signal stays pending on this thread only
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, NULL);
+
+    for (;;) {
+        ssize_t n = splice(ls->in, NULL, ls->out, NULL, chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            if (ls->bytes == 0)
+                __atomic_store_n(&ls->start_ns, now_ns(), __ATOMIC_RELAXED);
+            add_ll(&ls->bytes, n);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EINTR))
+            break; // EOF, or the reader is gone (EPIPE)
+        if (errno == EINTR)
+            continue;
+
+        struct pollfd p = {ls->in, POLLIN, 0};
+        poll(&p, 1, 0);
+        if (!(p.revents & (POLLIN | POLLHUP)))
+            timed_wait(ls->in, POLLIN, &ls->starved_ns);
+        else if (timed_wait(ls->out, POLLOUT, &ls->stalled_ns) & POLLERR)
+            break;
+    }
+    __atomic_store_n(&ls->end_ns, now_ns(), __ATOMIC_RELAXED);
+    // Closing the upstream end passes a downstream exit on as SIGPIPE
+    close(ls->in);
+    close(ls->out);
+    __atomic_store_n(&ls->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Reap whatever stages have exited, keeping each one's rusage
+static int reap_stages(struct stage_stats *st, int nstages) {
+    int status, left = 0;
+    struct rusage ru;
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+        for (int s = 0; s < nstages; s++) {
+            if (st[s].pid == pid) {
+                st[s].exited = 1;
+                st[s].status = status;
+                st[s].end_ns = now_ns();
+                st[s].ru = ru;
+            }
+        }
+    }
+    for (int s = 0; s < nstages; s++)
+        left += !st[s].exited;
+    return left;
+}
+
+static double tv_sec(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// One line per stage, redrawn in place: input rate, and the share of the
+// last interval it spent starved (input empty) or stalled (output full)
+static void draw_live(struct stage_stats *st, int nstages, struct link_stats *links, long long *last_bytes,
+                      long long *last_starved, long long *last_stalled, double interval, int redraw) {
+    if (redraw)
+        fprintf(stderr, "\033[%dA", nstages);
+    for (int s = 0; s < nstages; s++) {
+        double rate = 0.0, starved = 0.0, stalled = 0.0;
+        if (s > 0) {
+            struct link_stats *in = &links[s - 1];
+            long long b = load_ll(&in->bytes), w = load_ll(&in->starved_ns);
+            rate = (b - last_bytes[s - 1]) / interval / 1e6;
+            starved = (w - last_starved[s - 1]) / (interval * 1e9);
+        }
+        if (s < nstages - 1)
+            stalled = (load_ll(&links[s].stalled_ns) - last_stalled[s]) / (interval * 1e9);
+        fprintf(stderr, "\033[K[%d] %-28.28s in %9.1f MB/s  starved %5.1f%%  stalled %5.1f%%  %s\n", s + 1,
+                st[s].cmd, rate, 100.0 * starved, 100.0 * stalled, st[s].exited ? "exited" : "running");
+    }
+    for (int l = 0; l < nstages - 1; l++) {
+        last_bytes[l] = load_ll(&links[l].bytes);
+        last_starved[l] = load_ll(&links[l].starved_ns);
+        last_stalled[l] = load_ll(&links[l].stalled_ns);
+    }
+}
+
+// Final per-stage and per-link table. The stage that was neither starved
+// nor stalled for the longest time limits the pipeline: a short stage that
+// never waited does not, however busy it was while it ran.
+static void print_summary(struct stage_stats *st, int nstages, struct link_stats *links, long long start_ns) {
+    int busiest = 0;
+    double best = -1.0, best_wall = 0.0;
+    fprintf(stderr, "Stage  Command                       Wall(s)  User(s)   Sys(s)  Starved(s)  Stalled(s)  Busy(s)\n");
+    for (int s = 0; s < nstages; s++) {
+        long long end_ns = st[s].end_ns;
+        if (s < nstages - 1 && links[s].end_ns > 0 && links[s].end_ns < end_ns)
+            end_ns = links[s].end_ns; // Its output closed before the reap tick
+        double wall = (end_ns - start_ns) * 1e-9;
+        double starved = s > 0 ? links[s - 1].starved_ns * 1e-9 : 0.0;
+        double stalled = s < nstages - 1 ? links[s].stalled_ns * 1e-9 : 0.0;
+        double busy = wall - starved - stalled;
+        if (busy < 0.0)
+            busy = 0.0;
+        if (busy > best) {
+            best = busy;
+            best_wall = wall;
+            busiest = s;
+        }
+        fprintf(stderr, "%5d  %-28.28s %8.3f %8.3f %8.3f  %10.3f  %10.3f  %7.3f\n", s + 1, st[s].cmd, wall,
+                tv_sec(st[s].ru.ru_utime), tv_sec(st[s].ru.ru_stime), starved, stalled, busy);
+    }
+    fprintf(stderr, "Link   Bytes           MB/s\n");
+    for (int l = 0; l < nstages - 1; l++) {
+        double secs = (links[l].end_ns - links[l].start_ns) * 1e-9;
+        fprintf(stderr, "%2d->%-2d %-14lld %9.1f\n", l + 1, l + 2, links[l].bytes,
+                secs > 0 ? links[l].bytes / secs / 1e6 : 0.0);
+    }
+    fprintf(stderr, "Bottleneck: stage %d (%s), busy %.3f s, %.0f%% of its run\n", busiest + 1, st[busiest].cmd,
+            best, best_wall > 0 ? 100.0 * best / best_wall : 0.0);
+}
+
+#endif
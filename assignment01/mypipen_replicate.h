@@ -0,0 +1,348 @@
+/*
+ * File: mypipen_replicate.h
+ * Purpose: Stage replication for mypipen (-r STAGE=K[:MODE]). The stage's
+ *          process becomes a splitter/merger that runs K copies of the
+ *          command and cuts its input on newlines only:
+ *            rr     blocks of whole lines go to the next idle copy
+ *            hash   each line goes to copy hash(line) % K, so equal lines
+ *                   meet in the same copy (uniq -c, sort | uniq, ...)
+ *            order  every chunk of about REPLICATE_CHUNK bytes gets its
+ *                   own process, at most K at a time, and the outputs are
+ *                   written back in input order (like parallel -k)
+ *          In rr and hash mode the outputs are merged a line at a time as
+ *          they arrive, so lines from different copies never interleave.
+ *          Everything runs in one poll loop over non-blocking pipes.
+ * Author: Sean Balbale
+ * Date: 10/17/2026
+ */
+
+#ifndef MYPIPEN_REPLICATE_H
+#define MYPIPEN_REPLICATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define REPLICATE_MAX 256
+#define REPLICATE_BLOCK 65536     // rr/hash: input handed out per round
+#define REPLICATE_CHUNK (1 << 20) // order: input per process
+
+enum { REP_RR, REP_HASH, REP_ORDER };
+
+// One copy of the stage, seen from the splitter/merger
+struct replica {
+    pid_t pid;
+    int in, out;           // Our ends of its stdin and stdout, -1 once closed
+    char *ibuf;            // Input still to write
+    size_t ilen, ioff, icap;
+    char *obuf;            // Output not yet written on
+    size_t olen, ocap;
+    long long seq;         // order: chunk number
+    int busy;              // order: slot holds a chunk whose output is not all out yet
+};
+
+// Run one command in the current (child) process
+static void __attribute__((noreturn)) exec_command(const char *cmd) {
+    if (is_inproc(cmd)) {
+        struct stream in = {STDIN_FILENO, NULL}, out = {STDOUT_FILENO, NULL};
+        exit(run_inproc(cmd, &in, &out));
+    }
+    if (is_builtin(cmd))
+        exit(run_builtin(cmd));
+    if (!needs_shell(cmd)) {
+        char *argv[BUILTIN_MAX_ARGS + 1];
+        if (split_args(strdup(cmd), argv) > 0)
+            execvp(argv[0], argv); // If that fails, sh may still know it
+    }
+    execlp("sh", "sh", "-c", cmd, (char *)NULL);
+    perror("exec");
+    exit(1);
+}
+
+// "4", "4:hash", "8:order": the copy count, or -1; *mode gets the mode
+static int parse_replicas(const char *s, int *mode) {
+    char *end;
+    long k = strtol(s, &end, 10);
+    *mode = REP_RR;
+    if (*end == ':') {
+        end++;
+        if (strcmp(end, "rr") == 0)
+            *mode = REP_RR;
+        else if (strcmp(end, "hash") == 0)
+            *mode = REP_HASH;
+        else if (strcmp(end, "order") == 0)
+            *mode = REP_ORDER;
+        else
+            return -1;
+    } else if (*end != '\0') {
+        return -1;
+    }
+    return (k >= 1 && k <= REPLICATE_MAX) ? (int)k : -1;
+}
+
+static void buf_append(char **buf, size_t *len, size_t *cap, const char *data, size_t n) {
+    if (*len + n > *cap) {
+        *cap = (*len + n) * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+}
+
+static unsigned int line_hash(const char *line, size_t len) {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (size_t n = 0; n < len; n++)
+        h = (h ^ (unsigned char)line[n]) * 16777619u;
+    return h;
+}
+
+// Start copy r of the command on a fresh pair of pipes
+static void spawn_replica(const char *cmd, struct replica *reps, int k, struct replica *r) {
+    int in[2], out[2];
+    if (pipe(in) < 0 || pipe(out) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    switch ((r->pid = fork()))
+    {
+    case -1:
+        perror("Fork");
+        exit(1);
+    case 0: /* child */
+        signal(SIGPIPE, SIG_DFL);
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        // Another copy's input only sees EOF once every holder closes it
+        for (int j = 0; j < k; j++) {
+            if (reps[j].in >= 0)
+                close(reps[j].in);
+            if (reps[j].out >= 0)
+                close(reps[j].out);
+        }
+        exec_command(cmd);
+    default: /* parent */
+        close(in[0]);
+        close(out[1]);
+        r->in = in[1];
+        r->out = out[0];
+        fcntl(r->in, F_SETFL, O_NONBLOCK);
+        fcntl(r->out, F_SETFL, O_NONBLOCK);
+        r->ilen = r->ioff = r->olen = 0;
+        break;
+    }
+}
+
+// Pass output on. rr/hash: whole lines only, or everything at EOF. order:
+// only the oldest chunk's output goes straight out, the rest waits.
+static int emit_output(struct replica *r, int mode, long long next_out, int eof) {
+    size_t n = r->olen;
+    if (mode == REP_ORDER && r->seq != next_out)
+        return 0;
+    if (mode != REP_ORDER && !eof)
+        n = line_end(r->obuf, r->olen);
+    if (n == 0)
+        return 0;
+    if (write_all(STDOUT_FILENO, r->obuf, n) < 0)
+        return -1;
+    memmove(r->obuf, r->obuf + n, r->olen - n);
+    r->olen -= n;
+    return 0;
+}
+
+// Hand out the complete lines in stage[0..*len) (all of it at EOF) for
+// as long as some copy can take them
+static void dispatch_input(const char *cmd, struct replica *reps, int k, int mode, char *stage, size_t *len,
+                           int in_eof, int *rr, long long *next_seq) {
+    for (;;) {
+        size_t n = in_eof ? *len : line_end(stage, *len);
+        if (mode == REP_ORDER && !in_eof && *len < REPLICATE_CHUNK)
+            n = 0; // Wait for a full chunk
+        if (n == 0)
+            return;
+
+        if (mode == REP_HASH) {
+            for (int j = 0; j < k; j++) {
+                if (reps[j].in >= 0 && reps[j].ilen - reps[j].ioff >= REPLICATE_BLOCK)
+                    return; // One copy is behind; the others wait for it
+            }
+            for (size_t pos = 0; pos < n;) {
+                const char *nl = memchr(stage + pos, '\n', n - pos);
+                size_t end = nl ? (size_t)(nl - stage) + 1 : n;
+                size_t keylen = end - pos - (nl != NULL);
+                struct replica *r = &reps[line_hash(stage + pos, keylen) % k];
+                if (r->in >= 0)
+                    buf_append(&r->ibuf, &r->ilen, &r->icap, stage + pos, end - pos);
+                pos = end;
+            }
+        } else {
+            // The next copy with nothing queued, or the next free slot
+            struct replica *r = NULL;
+            for (int j = 0; j < k && r == NULL; j++) {
+                struct replica *c = &reps[(*rr + j) % k];
+                if (mode == REP_ORDER ? !c->busy : (c->in >= 0 && c->ilen == c->ioff))
+                    r = c;
+            }
+            if (r == NULL)
+                return;
+            *rr = (int)(r - reps + 1) % k;
+            if (mode == REP_ORDER) {
+                spawn_replica(cmd, reps, k, r);
+                r->busy = 1;
+                r->seq = (*next_seq)++;
+            }
+            r->ilen = r->ioff = 0;
+            buf_append(&r->ibuf, &r->ilen, &r->icap, stage, n);
+        }
+        memmove(stage, stage + n, *len - n);
+        *len -= n;
+    }
+}
+
+// The replicated stage: runs in the stage's child process in place of the
+// command. Returns the exit status for the stage.
+static int run_replicated(const char *cmd, int k, int mode) {
+    struct replica reps[REPLICATE_MAX];
+    struct pollfd pfd[2 * REPLICATE_MAX + 1];
+    int who[2 * REPLICATE_MAX + 1];
+    size_t cap = mode == REP_ORDER ? 2 * REPLICATE_CHUNK : 2 * REPLICATE_BLOCK;
+    size_t want = mode == REP_ORDER ? REPLICATE_CHUNK : REPLICATE_BLOCK;
+    char *stage = malloc(cap);
+    size_t len = 0;
+    int in_eof = 0, rr = 0, failed = 0, status;
+    long long next_seq = 0, next_out = 0;
+
+    // A copy that exits early shows up as EPIPE on its input
+    signal(SIGPIPE, SIG_IGN);
+    memset(reps, 0, sizeof(reps));
+    for (int j = 0; j < k; j++)
+        reps[j].in = reps[j].out = -1;
+    if (mode != REP_ORDER) {
+        for (int j = 0; j < k; j++)
+            spawn_replica(cmd, reps, k, &reps[j]);
+    }
+
+    for (;;) {
+        dispatch_input(cmd, reps, k, mode, stage, &len, in_eof, &rr, &next_seq);
+
+        int nfds = 0, alive = 0;
+        // Read more only once the last round is handed out; a line longer
+        // than the buffer makes it grow
+        if (!in_eof && (len < want || line_end(stage, len) == 0)) {
+            if (cap - len < want) {
+                cap *= 2;
+                stage = realloc(stage, cap);
+            }
+            pfd[nfds] = (struct pollfd){STDIN_FILENO, POLLIN, 0};
+            who[nfds++] = -1;
+        }
+        for (int j = 0; j < k; j++) {
+            struct replica *r = &reps[j];
+            if (r->in >= 0 && r->ioff == r->ilen && (mode == REP_ORDER ? r->busy : in_eof && len == 0)) {
+                close(r->in); // Nothing more for this copy
+                r->in = -1;
+            }
+            if (r->in >= 0 && r->ioff < r->ilen) {
+                pfd[nfds] = (struct pollfd){r->in, POLLOUT, 0};
+                who[nfds++] = j;
+            }
+            if (r->out >= 0) {
+                pfd[nfds] = (struct pollfd){r->out, POLLIN, 0};
+                who[nfds++] = j;
+                alive++;
+            }
+        }
+        if (nfds == 0 || (alive == 0 && mode != REP_ORDER))
+            break; // Done, or every copy is gone
+        if (poll(pfd, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return 1;
+        }
+
+        for (int p = 0; p < nfds; p++) {
+            if (pfd[p].revents == 0)
+                continue;
+            if (who[p] < 0) {
+                ssize_t n = read(STDIN_FILENO, stage + len, cap - len);
+                if (n > 0)
+                    len += n;
+                else if (n == 0 || errno != EINTR)
+                    in_eof = 1;
+                continue;
+            }
+            struct replica *r = &reps[who[p]];
+            if (pfd[p].fd == r->in) {
+                ssize_t n = write(r->in, r->ibuf + r->ioff, r->ilen - r->ioff);
+                if (n > 0)
+                    r->ioff += n;
+                else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                    close(r->in); // EPIPE: it stopped reading; drop its share
+                    r->in = -1;
+                    r->ioff = r->ilen;
+                }
+                if (r->ioff == r->ilen)
+                    r->ilen = r->ioff = 0;
+                continue;
+            }
+
+            char buf[COPY_BUF_SIZE];
+            ssize_t n = read(r->out, buf, sizeof(buf));
+            if (n < 0 && (errno == EAGAIN || errno == EINTR))
+                continue;
+            if (n > 0) {
+                buf_append(&r->obuf, &r->olen, &r->ocap, buf, n);
+                if (emit_output(r, mode, next_out, 0) < 0)
+                    return 1; // Downstream is gone
+                continue;
+            }
+            // Its output ended: flush it and reap it
+            close(r->out);
+            r->out = -1;
+            if (r->in >= 0) {
+                close(r->in);
+                r->in = -1;
+            }
+            r->ilen = r->ioff = 0;
+            waitpid(r->pid, &status, 0);
+            failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            if (emit_output(r, mode, next_out, 1) < 0)
+                return 1;
+            // order: the chunks after it may already be finished
+            while (mode == REP_ORDER) {
+                struct replica *head = NULL;
+                for (int j = 0; j < k; j++) {
+                    if (reps[j].busy && reps[j].seq == next_out)
+                        head = &reps[j];
+                }
+                if (head == NULL)
+                    break;
+                if (emit_output(head, mode, next_out, 1) < 0)
+                    return 1;
+                if (head->out >= 0)
+                    break; // Still running; the rest streams as it comes
+                head->busy = 0;
+                next_out++;
+            }
+        }
+    }
+    for (int j = 0; j < k; j++) {
+        if (reps[j].out >= 0) {
+            close(reps[j].out);
+            waitpid(reps[j].pid, &status, 0);
+        }
+    }
+    return failed;
+}
+
+#endif
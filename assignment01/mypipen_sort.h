@@ -0,0 +1,467 @@
+/*
+ * File: mypipen_sort.h
+ * Purpose: @sort, an external merge sort for inputs larger than memory:
+ *            @sort [-brn] [-k F[brn][,G[brn]]] [-t C] [-S SIZE] [-T DIR] [--parallel=N]
+ *          Input is read in runs of at most SIZE bytes (lines plus their
+ *          index, 64M by default). Each run is cut into one slice per
+ *          thread, the slices are sorted in parallel and a loser tree
+ *          merges them into a temporary file under DIR ($TMPDIR, /tmp),
+ *          which is unlinked at once. The final merge takes the spilled
+ *          runs and the slices of the last run and writes to the next stage
+ *          as it goes. The key is fields F..G (runs of blanks separate
+ *          fields, or C with -t); as in sort(1) a blank-separated field
+ *          keeps the blanks before it unless -b skips them. -n compares
+ *          the key's leading number. As in sort(1), b, r and n after a
+ *          key field apply to that key alone, and -b/-r/-n then only to
+ *          the whole-line comparison that breaks ties.
+ *          Ties fall back to the whole line in byte order.
+ *          Uses the stream, reader and writer of mypipen_inproc.h.
+ * Author: Sean Balbale
+ * Date: 10/17/2026
+ */
+
+#ifndef MYPIPEN_SORT_H
+#define MYPIPEN_SORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define SORT_MEMORY_DEFAULT (64L << 20)
+#define SORT_MAX_THREADS 64
+#define SORT_MIN_SLICE 16384 // Lines; smaller runs are not worth a thread
+#define SORT_FANIN 128       // Spilled runs merged at once; more are merged down first
+
+struct sort_opts {
+    int reverse, numeric, blanks; // For the key
+    int reverse_ties;             // For the whole-line tie break
+    int kfirst, klast; // Key fields, 1-based; 0 = the whole line, or to its end
+    char sep;          // -t, or 0 for blanks
+    long memory;
+    int threads;
+    const char *tmpdir;
+};
+
+struct sort_line {
+    const char *p;
+    unsigned int n, koff, klen, pad; // The key is p[koff..koff+klen); 32 bytes in all
+    union {
+        double num;                // -n: the key's value
+        unsigned long long prefix; // Otherwise its first 8 bytes, big-endian, to compare most keys in one step
+    };
+};
+
+// Past one field and the separator after it
+static const char *skip_field(const struct sort_opts *o, const char *p, const char *end) {
+    if (o->sep) {
+        const char *s = memchr(p, o->sep, end - p);
+        return s ? s + 1 : end;
+    }
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    while (p < end && *p != ' ' && *p != '\t')
+        p++;
+    return p;
+}
+
+// Leading [-]digits[.digits] after blanks; anything else counts as 0
+static double key_number(const char *p, const char *end) {
+    double v = 0.0, scale = 1.0;
+    int neg = 0;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (p < end && *p == '-') {
+        neg = 1;
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9')
+        v = v * 10 + (*p++ - '0');
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+            v += (*p - '0') * (scale *= 0.1);
+    }
+    return neg ? -v : v;
+}
+
+static void sort_key(const struct sort_opts *o, struct sort_line *l) {
+    const char *p = l->p, *end = l->p + l->n, *q;
+    for (int f = 1; f < o->kfirst && p < end; f++)
+        p = skip_field(o, p, end);
+    while (o->blanks && p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    q = end;
+    if (o->klast > 0) {
+        int f = o->kfirst;
+        for (q = p; f <= o->klast && q < end; f++)
+            q = skip_field(o, q, end);
+        if (o->sep && f > o->klast && q > p && q[-1] == o->sep)
+            q--; // Not the separator after field G
+    }
+    l->koff = p - l->p;
+    l->klen = q - p;
+    if (o->numeric) {
+        l->num = key_number(p, q);
+        return;
+    }
+    l->prefix = 0;
+    for (int b = 0; b < 8; b++)
+        l->prefix = l->prefix << 8 | (p + b < q ? (unsigned char)p[b] : 0);
+}
+
+static int bytes_cmp(const char *a, size_t an, const char *b, size_t bn) {
+    int c = memcmp(a, b, an < bn ? an : bn);
+    return c ? c : (an > bn) - (an < bn);
+}
+
+static int sort_cmp(const void *a, const void *b, void *arg) {
+    const struct sort_line *x = a, *y = b;
+    const struct sort_opts *o = arg;
+    int c = 0;
+    if (o->numeric) {
+        c = (x->num > y->num) - (x->num < y->num);
+    } else {
+        c = (x->prefix > y->prefix) - (x->prefix < y->prefix);
+        if (c == 0)
+            c = bytes_cmp(x->p + x->koff, x->klen, y->p + y->koff, y->klen);
+    }
+    if (c != 0)
+        return o->reverse ? -c : c;
+    if (o->numeric || o->blanks || o->kfirst > 0)
+        c = bytes_cmp(x->p, x->n, y->p, y->n);
+    return o->reverse_ties ? -c : c;
+}
+
+// One slice of a run, keyed and sorted by its own thread
+struct sort_slice {
+    struct sort_line *lines;
+    size_t n;
+    const struct sort_opts *o;
+    pthread_t tid;
+    int threaded;
+};
+
+static void *sort_slice_main(void *arg) {
+    struct sort_slice *sl = arg;
+    for (size_t k = 0; k < sl->n; k++)
+        sort_key(sl->o, &sl->lines[k]);
+    qsort_r(sl->lines, sl->n, sizeof(struct sort_line), sort_cmp, (void *)sl->o);
+    return NULL;
+}
+
+// Sort lines[0..n) as up to o->threads sorted slices. Returns the count.
+static int sort_slices(const struct sort_opts *o, struct sort_line *lines, size_t n, struct sort_slice *sl) {
+    size_t t = n / SORT_MIN_SLICE;
+    if (t > (size_t)o->threads)
+        t = o->threads;
+    if (t < 1)
+        t = 1;
+    for (size_t k = 0; k < t; k++) {
+        sl[k].lines = lines + n * k / t;
+        sl[k].n = n * (k + 1) / t - n * k / t;
+        sl[k].o = o;
+        sl[k].threaded = k > 0 && pthread_create(&sl[k].tid, NULL, sort_slice_main, &sl[k]) == 0;
+    }
+    for (size_t k = 0; k < t; k++) {
+        if (!sl[k].threaded)
+            sort_slice_main(&sl[k]); // The first one, or no thread to spare
+    }
+    for (size_t k = 1; k < t; k++) {
+        if (sl[k].threaded)
+            pthread_join(sl[k].tid, NULL);
+    }
+    return (int)t;
+}
+
+// A sorted sequence being merged: a slice in memory, or a spilled run
+struct merge_src {
+    struct sort_line cur;
+    int done;
+    struct sort_line *lines;
+    size_t n, pos;
+    int fd; // Spilled run, or -1
+    struct stream st;
+    struct reader rd;
+};
+
+static void src_next(const struct sort_opts *o, struct merge_src *m) {
+    if (m->fd < 0) {
+        if (m->pos < m->n)
+            m->cur = m->lines[m->pos++];
+        else
+            m->done = 1;
+        return;
+    }
+    size_t n;
+    char *p = next_line(&m->rd, &n);
+    if (p == NULL) {
+        m->done = 1;
+        return;
+    }
+    m->cur.p = p;
+    m->cur.n = n;
+    sort_key(o, &m->cur);
+}
+
+// Loser tree over k sources: tree[0] is the current winner, tree[1..k-1]
+// the loser of each match, index k a sentinel that beats everything
+struct loser_tree {
+    int k;
+    int *tree;
+    struct merge_src *src;
+    const struct sort_opts *o;
+};
+
+static int lt_before(struct loser_tree *lt, int a, int b) {
+    if (a == lt->k)
+        return 1;
+    if (b == lt->k || lt->src[a].done)
+        return 0;
+    if (lt->src[b].done)
+        return 1;
+    int c = sort_cmp(&lt->src[a].cur, &lt->src[b].cur, (void *)lt->o);
+    return c < 0 || (c == 0 && a < b); // Earlier runs first on a tie
+}
+
+// Replay source s from its leaf to the root
+static void lt_adjust(struct loser_tree *lt, int s) {
+    for (int t = (s + lt->k) / 2; t > 0; t /= 2) {
+        if (lt_before(lt, lt->tree[t], s)) {
+            int winner = lt->tree[t];
+            lt->tree[t] = s;
+            s = winner;
+        }
+    }
+    lt->tree[0] = s;
+}
+
+// Merge k sources into w, one line each step and log2(k) comparisons
+static void merge_sources(const struct sort_opts *o, struct merge_src *src, int k, struct writer *w) {
+    struct loser_tree lt = {k, malloc((k + 1) * sizeof(int)), src, o};
+    for (int s = 0; s < k; s++) {
+        src[s].done = 0;
+        src_next(o, &src[s]);
+    }
+    for (int t = 0; t <= k; t++)
+        lt.tree[t] = k;
+    for (int s = k - 1; s >= 0; s--)
+        lt_adjust(&lt, s);
+    while (k > 0 && !w->failed) {
+        int s = lt.tree[0];
+        if (src[s].done)
+            break;
+        put_line(w, src[s].cur.p, src[s].cur.n);
+        src_next(o, &src[s]);
+        lt_adjust(&lt, s);
+    }
+    flush_out(w);
+    free(lt.tree);
+}
+
+static void src_from_file(struct merge_src *m, int fd) {
+    memset(m, 0, sizeof(*m));
+    m->fd = fd;
+    m->st = (struct stream){fd, NULL};
+    m->rd.in = &m->st;
+}
+
+// An unlinked temporary file for a run
+static int spill_file(const struct sort_opts *o) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/mypipen-sort.XXXXXX", o->tmpdir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    unlink(path);
+    return fd;
+}
+
+// Merge sources into a new spilled run; returns its fd, rewound
+static int spill(const struct sort_opts *o, struct merge_src *src, int k) {
+    int fd = spill_file(o);
+    if (fd < 0)
+        return -1;
+    struct stream st = {fd, NULL};
+    struct writer *w = calloc(1, sizeof(struct writer));
+    w->out = &st;
+    merge_sources(o, src, k, w);
+    int failed = w->failed;
+    free(w);
+    if (failed || lseek(fd, 0, SEEK_SET) < 0) {
+        perror("@sort: spill");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int sort_usage(void) {
+    fprintf(stderr, "usage: @sort [-brn] [-k F[brn][,G[brn]]] [-t C] [-S SIZE] [-T DIR] [--parallel=N]\n");
+    return 2;
+}
+
+static int inproc_sort(int argc, char **argv, struct stream *in, struct writer *w) {
+    struct sort_opts o = {0, 0, 0, 0, 0, 0, 0, SORT_MEMORY_DEFAULT, 1, NULL};
+    int kmods = 0, kr = 0, kn = 0, kb = 0; // Modifiers given with -k
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    o.threads = cpus < 1 ? 1 : cpus > SORT_MAX_THREADS ? SORT_MAX_THREADS : (int)cpus;
+    o.tmpdir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    for (int k = 1; k < argc; k++) {
+        char *a = argv[k];
+        if (strncmp(a, "--parallel=", 11) == 0) {
+            o.threads = atoi(a + 11);
+            if (o.threads < 1 || o.threads > SORT_MAX_THREADS)
+                return sort_usage();
+        } else if (a[0] == '-' && a[1] != '\0' && strchr("ktST", a[1]) != NULL) {
+            // The value is attached (-k2) or the next word
+            char *val = a[2] ? a + 2 : (k + 1 < argc ? argv[++k] : NULL);
+            char *end;
+            if (val == NULL)
+                return sort_usage();
+            switch (a[1])
+            {
+            case 'k':
+                if (o.kfirst > 0)
+                    return sort_usage(); // One key only
+                o.kfirst = (int)strtol(val, &end, 10);
+                for (; *end != '\0' && strchr("brn", *end) != NULL; end++) {
+                    kmods = 1;
+                    kr |= *end == 'r';
+                    kn |= *end == 'n';
+                    kb |= *end == 'b';
+                }
+                if (*end == ',' && end[1] >= '0' && end[1] <= '9') {
+                    o.klast = (int)strtol(end + 1, &end, 10);
+                    // b after G only moves an end inside a field, which F.C would need
+                    for (; *end != '\0' && strchr("brn", *end) != NULL; end++) {
+                        kmods = 1;
+                        kr |= *end == 'r';
+                        kn |= *end == 'n';
+                    }
+                }
+                // F.C character positions and other modifiers are not supported
+                if (*end != '\0' || o.kfirst < 1 || (o.klast != 0 && o.klast < o.kfirst))
+                    return sort_usage();
+                break;
+            case 't':
+                o.sep = val[0];
+                break;
+            case 'S':
+                o.memory = parse_size(val);
+                if (o.memory < (1L << 20))
+                    return sort_usage();
+                break;
+            default:
+                o.tmpdir = val;
+                break;
+            }
+        } else if (a[0] == '-' && a[strspn(a + 1, "rnb") + 1] == '\0') {
+            o.reverse |= strchr(a, 'r') != NULL;
+            o.numeric |= strchr(a, 'n') != NULL;
+            o.blanks |= strchr(a, 'b') != NULL;
+        } else {
+            return sort_usage();
+        }
+    }
+    o.reverse_ties = o.reverse;
+    if (kmods) {
+        // The key has its own modifiers and takes none of the global ones
+        o.reverse = kr;
+        o.numeric = kn;
+        o.blanks = kb;
+    }
+
+    struct sort_slice slices[SORT_MAX_THREADS];
+    struct merge_src *src = calloc(SORT_FANIN + SORT_MAX_THREADS, sizeof(struct merge_src));
+    int nruns = 0, eof = 0, status = 0;
+    size_t cap = o.memory / 2, len = 0, lcap = 1024;
+    char *data = malloc(cap);
+    struct sort_line *lines = malloc(lcap * sizeof(struct sort_line));
+
+    while (!eof) {
+        // Fill a run: the carried partial line, then whole reads until the
+        // text plus one index entry per line reaches the budget, or past it
+        // until a line longer than the budget is complete
+        size_t newlines = 0;
+        for (char *p = data; (p = memchr(p, '\n', data + len - p)) != NULL; p++)
+            newlines++;
+        while (newlines == 0 || len + newlines * sizeof(struct sort_line) < (size_t)o.memory) {
+            if (cap - len < COPY_BUF_SIZE) {
+                if (newlines > 0)
+                    break; // Full
+                cap *= 2; // One line longer than the budget
+                data = realloc(data, cap);
+            }
+            ssize_t got = stream_read(in, data + len, cap - len);
+            if (got <= 0) {
+                eof = 1;
+                break;
+            }
+            for (char *p = data + len; (p = memchr(p, '\n', data + len + got - p)) != NULL; p++)
+                newlines++;
+            len += got;
+        }
+
+        // Index the whole lines (and at EOF an unterminated last one)
+        size_t used = eof ? len : line_end(data, len), nlines = 0;
+        for (size_t off = 0; off < used;) {
+            char *nl = memchr(data + off, '\n', used - off);
+            size_t end = nl ? (size_t)(nl - data) : used;
+            if (nlines == lcap) {
+                lcap *= 2;
+                lines = realloc(lines, lcap * sizeof(struct sort_line));
+            }
+            lines[nlines].p = data + off;
+            lines[nlines++].n = end - off;
+            off = end + 1;
+        }
+        int nslices = sort_slices(&o, lines, nlines, slices);
+        for (int s = 0; s < nslices; s++) {
+            struct merge_src *m = &src[nruns + s];
+            memset(m, 0, sizeof(*m));
+            m->fd = -1;
+            m->lines = slices[s].lines;
+            m->n = slices[s].n;
+        }
+        if (eof) {
+            // Last run: merge it with the spilled ones straight into the output
+            merge_sources(&o, src, nruns + nslices, w);
+            break;
+        }
+
+        if (used == 0)
+            continue; // Nothing whole yet; never spill an empty run
+        int fd = spill(&o, src + nruns, nslices);
+        if (fd >= 0 && nruns + 1 == SORT_FANIN) {
+            // Too many files open: merge them down to one
+            src_from_file(&src[nruns++], fd);
+            fd = spill(&o, src, nruns);
+            for (int r = 0; r < nruns; r++) {
+                close(src[r].fd);
+                free(src[r].rd.buf);
+            }
+            nruns = 0;
+        }
+        if (fd < 0) {
+            status = 2;
+            break;
+        }
+        src_from_file(&src[nruns++], fd);
+        memmove(data, data + used, len - used);
+        len -= used;
+    }
+
+    for (int r = 0; r < nruns; r++) {
+        close(src[r].fd);
+        free(src[r].rd.buf);
+    }
+    free(lines);
+    free(data);
+    free(src);
+    return status;
+}
+
+#endif
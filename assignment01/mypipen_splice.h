@@ -0,0 +1,270 @@
+/*
+ * File: mypipen_splice.h
+ * Purpose: Built-in forwarding stages for mypipen. They move data with
+ *          splice(2) and tee(2), so the bytes stay in pipe buffers instead
+ *          of being copied into a process and back out:
+ *            @cat          pass stdin through to stdout
+ *            @tee FILE...  pass stdin through and copy it into each FILE
+ *          Either end may be a file or terminal; the stage then feeds
+ *          itself through a private pipe, or falls back to read/write
+ *          where the kernel cannot splice. Also parses pipe sizes
+ *          (F_SETPIPE_SZ) for the links.
+ * Author: Sean Balbale
+ * Date: 10/17/2026
+ */
+
+#ifndef MYPIPEN_SPLICE_H
+#define MYPIPEN_SPLICE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#define BUILTIN_MAX_ARGS 64
+#define COPY_BUF_SIZE 65536
+#define SHELL_META "|&;<>()$`\\\"'*?[]#~{}!\n" // A command with any of these needs sh -c
+
+// "65536", "64K", "1M", "2G": bytes, or -1 if malformed
+static long parse_size(const char *s) {
+    char *end;
+    long size = strtol(s, &end, 10);
+    if (end == s || size <= 0)
+        return -1;
+    if (*end == 'K' || *end == 'k')
+        size <<= 10, end++;
+    else if (*end == 'M' || *end == 'm')
+        size <<= 20, end++;
+    else if (*end == 'G' || *end == 'g')
+        size <<= 30, end++;
+    return *end == '\0' ? size : -1;
+}
+
+// Resize a pipe; the kernel rounds up to a power-of-two number of pages
+static void set_pipe_size(int fd, long size) {
+    if (size > 0 && fcntl(fd, F_SETPIPE_SZ, (int)size) < 0)
+        fprintf(stderr, "mypipen: F_SETPIPE_SZ %ld: %s (see /proc/sys/fs/pipe-max-size)\n", size,
+                strerror(errno));
+}
+
+static int is_pipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+// How much to move per call: the size of the pipe on either side
+static size_t splice_chunk(int fd) {
+    int size = fcntl(fd, F_GETPIPE_SZ);
+    return size > 0 ? (size_t)size : COPY_BUF_SIZE;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// The user-space path: copy `limit` bytes, or everything up to EOF if
+// limit < 0. Returns the bytes copied, or -1.
+static long copy_bytes(int in, int out, long limit) {
+    char buf[COPY_BUF_SIZE];
+    long total = 0;
+    while (limit < 0 || total < limit) {
+        size_t want = (limit < 0 || limit - total > COPY_BUF_SIZE) ? COPY_BUF_SIZE : (size_t)(limit - total);
+        ssize_t n = read(in, buf, want);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0 || write_all(out, buf, n) < 0)
+            break;
+        total += n;
+    }
+    return total;
+}
+
+// Move exactly n bytes out of pipe `in` into `out`, whatever `out` is
+static int move_bytes(int in, int out, long n) {
+    while (n > 0) {
+        ssize_t moved = splice(in, NULL, out, NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved < 0 && errno == EINTR)
+            continue;
+        if (moved < 0 && errno == EINVAL)
+            return copy_bytes(in, out, n) == n ? 0 : -1; // No splice_write (a terminal, O_APPEND)
+        if (moved <= 0)
+            return -1;
+        n -= moved;
+    }
+    return 0;
+}
+
+// @cat: splice needs a pipe on one side, which is the normal case inside
+// a pipeline
+static int builtin_cat(void) {
+    size_t chunk = splice_chunk(is_pipe(STDIN_FILENO) ? STDIN_FILENO : STDOUT_FILENO);
+    if (!is_pipe(STDIN_FILENO) && !is_pipe(STDOUT_FILENO))
+        return copy_bytes(STDIN_FILENO, STDOUT_FILENO, -1) < 0;
+    for (;;) {
+        ssize_t n = splice(STDIN_FILENO, NULL, STDOUT_FILENO, NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == 0)
+            return 0;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EINVAL)
+            return copy_bytes(STDIN_FILENO, STDOUT_FILENO, -1) < 0;
+        if (n < 0) {
+            perror("@cat: splice");
+            return 1;
+        }
+    }
+}
+
+// @tee: each round tee(2) duplicates n bytes of the input pipe into the
+// next stage's pipe (or into a scratch pipe when stdout is not a pipe),
+// the other files get their copy through the scratch pipe, and the last
+// one consumes the n bytes with splice(2).
+static int builtin_tee(int nfiles, char **files) {
+    int targets[BUILTIN_MAX_ARGS + 1];
+    int ntargets = 0, src = STDIN_FILENO;
+    int feed[2] = {-1, -1}, scratch[2];
+    int out_pipe = is_pipe(STDOUT_FILENO);
+    long pending = 0; // Bytes in the feed pipe
+
+    for (int k = 0; k < nfiles; k++) {
+        targets[ntargets] = open(files[k], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (targets[ntargets++] < 0) {
+            perror(files[k]);
+            return 1;
+        }
+    }
+    if (!out_pipe)
+        targets[ntargets++] = STDOUT_FILENO; // Just another file
+    if (pipe(scratch) < 0 || (!is_pipe(STDIN_FILENO) && pipe(feed) < 0)) {
+        perror("@tee: pipe");
+        return 1;
+    }
+    if (feed[0] >= 0)
+        src = feed[0]; // tee(2) only reads from a pipe
+    set_pipe_size(scratch[1], fcntl(src, F_GETPIPE_SZ)); // Always room for a whole round
+
+    for (;;) {
+        ssize_t n;
+        if (feed[0] >= 0 && pending == 0) {
+            ssize_t got = splice(STDIN_FILENO, NULL, feed[1], NULL, splice_chunk(feed[1]), SPLICE_F_MOVE);
+            if (got < 0 && errno == EINVAL) {
+                // A terminal: read into the feed pipe instead
+                char buf[COPY_BUF_SIZE];
+                got = read(STDIN_FILENO, buf, sizeof(buf));
+                if (got > 0 && write_all(feed[1], buf, got) < 0)
+                    got = -1;
+            }
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                break;
+            pending = got;
+        }
+        long limit = feed[0] >= 0 ? pending : INT_MAX;
+        if (out_pipe)
+            n = tee(src, STDOUT_FILENO, limit, 0);
+        else
+            n = tee(src, scratch[1], limit, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        int first = 0;
+        if (!out_pipe && move_bytes(scratch[0], targets[first++], n) < 0)
+            break;
+        for (int k = first; k < ntargets - 1; k++) {
+            if (tee(src, scratch[1], n, 0) != n || move_bytes(scratch[0], targets[k], n) < 0) {
+                perror("@tee");
+                return 1;
+            }
+        }
+        if (move_bytes(src, targets[ntargets - 1], n) < 0) {
+            perror("@tee");
+            return 1;
+        }
+        pending -= n;
+    }
+    for (int k = 0; k < nfiles; k++)
+        close(targets[k]);
+    return 0;
+}
+
+static int is_builtin(const char *cmd) {
+    return cmd[0] == '@';
+}
+
+// Split a command in place on blanks; '...' or "..." keeps blanks inside a
+// word (no escapes). argv gets at most BUILTIN_MAX_ARGS words and a NULL.
+static int split_args(char *line, char **argv) {
+    int argc = 0;
+    char *p = line;
+    while (argc < BUILTIN_MAX_ARGS) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '\0')
+            break;
+        char *word = p, *to = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t') {
+            if (*p == '\'' || *p == '"') {
+                char quote = *p++;
+                while (*p != '\0' && *p != quote)
+                    *to++ = *p++;
+                if (*p == quote)
+                    p++;
+            } else {
+                *to++ = *p++;
+            }
+        }
+        if (*p != '\0')
+            p++;
+        *to = '\0';
+        argv[argc++] = word;
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+// Run a built-in stage in the current (child) process
+static int run_builtin(const char *cmd) {
+    char *argv[BUILTIN_MAX_ARGS + 1];
+    int argc = split_args(strdup(cmd), argv);
+
+    if (strcmp(argv[0], "@cat") == 0 && argc == 1)
+        return builtin_cat();
+    if (strcmp(argv[0], "@tee") == 0)
+        return argc == 1 ? builtin_cat() : builtin_tee(argc - 1, argv + 1);
+    fprintf(stderr, "mypipen: unknown builtin %s\n", argv[0]);
+    return 127;
+}
+
+// -z: a stage that is plain "cat" or "tee FILE..." (no options, no shell
+// syntax) becomes the built-in. Returns the command to run.
+static const char *zero_copy_rewrite(const char *cmd) {
+    while (*cmd == ' ')
+        cmd++;
+    if (strpbrk(cmd, SHELL_META) != NULL || strstr(cmd, " -") != NULL)
+        return cmd;
+    if (strcmp(cmd, "cat") != 0 && strncmp(cmd, "tee ", 4) != 0)
+        return cmd;
+    char *rewritten = malloc(strlen(cmd) + 2);
+    sprintf(rewritten, "@%s", cmd);
+    return rewritten;
+}
+
+#endif
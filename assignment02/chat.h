@@ -0,0 +1,197 @@
+/*
+ * File: chat.h
+ * Purpose: Names and helpers shared by the FIFO chat server and client.
+ *          The server reads registrations from one well-known request
+ *          FIFO; each client creates a private pair of FIFOs named after
+ *          its pid, sends a JOIN frame and then talks to the server over
+ *          its pair only.
+ *          Everything on the FIFOs is framed: an 8-byte header (payload
+ *          length, frame type) followed by the payload. A reader keeps a
+ *          frame_buf per stream, so a frame split over two reads or many
+ *          frames arriving in one read come out the same.
+ *          A struct chan is one side of a client's connection: its FIFO
+ *          pair, or the shared-memory rings of chat_shm.h with the FIFOs
+ *          as doorbells. chan_read()/chan_writev() work the same on both.
+ * Author: Sean Balbale
+ * Date: 10/17/2026
+ */
+
+#ifndef CHAT_H
+#define CHAT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "chat_shm.h"
+
+#define REQUEST_FIFO "/tmp/seanb_FIFO_REQ"
+#define CLIENT_FIFO_FMT "/tmp/seanb_%d_%s" // pid, then "s2c" (server to client) or "c2s"
+#define NAME_LEN 32
+#define LINE_MAX_LEN 16384 // Longer lines are cut into pieces
+#define LINE_BUF (4 * LINE_MAX_LEN)
+
+// Frame types
+#define FRAME_JOIN 1 // Client to request FIFO: "<pid> <name> [shm]"
+#define FRAME_TEXT 2 // One chat line, no '\n'; may hold any bytes
+#define FRAME_BYE 3  // Leaving (client) or chat over (server); no payload
+
+// Both ends run on the same machine, so the header is in host byte order
+struct frame_hdr
+{
+    uint32_t len; // Payload bytes after the header
+    uint32_t type;
+};
+
+#define FRAME_MAX (LINE_MAX_LEN + 2 * NAME_LEN + 32) // A line plus the server's "name: "
+#define FRAME_BUF (4 * (sizeof(struct frame_hdr) + FRAME_MAX))
+
+// Bytes read from a stream, handed out a frame at a time.
+// data holds FRAME_BUF bytes; data[off..len) is not consumed yet.
+struct frame_buf
+{
+    char *data;
+    size_t off, len;
+};
+
+// One end of a connection
+struct chan
+{
+    int rfd, wfd;              // The FIFO pair, or just the doorbells
+    struct shm_ring *in, *out; // Shared-memory rings, or NULL to use the FIFOs
+};
+
+// Bytes read from a stream, handed out a line at a time
+struct line_buf
+{
+    char data[LINE_BUF];
+    size_t len;
+};
+
+// read() from the connection: bytes read, 0 at EOF, -1 with errno EAGAIN
+// when nothing is waiting
+static inline ssize_t chan_read(struct chan *ch, char *buf, size_t len)
+{
+    ssize_t n;
+    if (ch->in != NULL)
+        return ring_read(ch->in, buf, len, ch->rfd, ch->wfd);
+    do
+    {
+        n = read(ch->rfd, buf, len);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+// writev() to the connection; may write less than all of iov
+static inline ssize_t chan_writev(struct chan *ch, const struct iovec *iov, int cnt)
+{
+    ssize_t n;
+    if (ch->out != NULL)
+        return ring_writev(ch->out, iov, cnt, ch->rfd, ch->wfd);
+    do
+    {
+        n = writev(ch->wfd, iov, cnt);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+// Write a frame into buf (room for a header plus len). Returns its size.
+static inline size_t put_frame(char *buf, uint32_t type, const char *payload, size_t len)
+{
+    struct frame_hdr hdr = {(uint32_t)len, type};
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), payload, len);
+    return sizeof(hdr) + len;
+}
+
+// Take the next whole frame out of fb. Returns 1 with *hdr and *payload
+// set (the payload stays valid until the next fill), 0 if the rest of the
+// frame has not arrived yet, -1 if the stream is corrupt.
+static inline int take_frame(struct frame_buf *fb, struct frame_hdr *hdr, char **payload)
+{
+    size_t avail = fb->len - fb->off;
+    if (avail < sizeof(*hdr))
+        return 0;
+    memcpy(hdr, fb->data + fb->off, sizeof(*hdr));
+    if (hdr->len > FRAME_MAX || hdr->type < FRAME_JOIN || hdr->type > FRAME_BYE)
+        return -1;
+    if (avail < sizeof(*hdr) + hdr->len)
+        return 0;
+    *payload = fb->data + fb->off + sizeof(*hdr);
+    fb->off += sizeof(*hdr) + hdr->len;
+    return 1;
+}
+
+// Move a partial frame to the front of fb and append what ch has. Take
+// every whole frame first: a partial one always leaves room to read.
+// Returns bytes read, 0 at EOF, -1 with errno EAGAIN when nothing is waiting.
+static inline ssize_t fill_frame_buf(struct chan *ch, struct frame_buf *fb)
+{
+    memmove(fb->data, fb->data + fb->off, fb->len - fb->off);
+    fb->len -= fb->off;
+    fb->off = 0;
+    ssize_t n = chan_read(ch, fb->data + fb->len, FRAME_BUF - fb->len);
+    if (n > 0)
+        fb->len += n;
+    return n;
+}
+
+// Length of the line at lb->data + off, without its '\n'; *skip is set to
+// the bytes it takes up. Returns -1 if it is not complete yet. At EOF an
+// unterminated last line counts as complete.
+static inline ssize_t line_at(const struct line_buf *lb, size_t off, size_t *skip, int at_eof)
+{
+    size_t avail = lb->len - off;
+    char *nl = memchr(lb->data + off, '\n', avail < LINE_MAX_LEN + 1 ? avail : LINE_MAX_LEN + 1);
+    if (nl != NULL)
+    {
+        *skip = nl - (lb->data + off) + 1;
+        return *skip - 1;
+    }
+    if (avail >= LINE_MAX_LEN || (at_eof && avail > 0))
+    {
+        *skip = avail < LINE_MAX_LEN ? avail : LINE_MAX_LEN;
+        return *skip;
+    }
+    return -1;
+}
+
+// Forget the first n bytes of lb
+static inline void drop_bytes(struct line_buf *lb, size_t n)
+{
+    memmove(lb->data, lb->data + n, lb->len - n);
+    lb->len -= n;
+}
+
+// Take the next complete line (without '\n', NUL-terminated) out of lb
+// into line, which has room for LINE_MAX_LEN + 1 bytes. Returns 0 if no
+// complete line is buffered yet.
+static inline int take_line(struct line_buf *lb, char *line)
+{
+    size_t skip;
+    ssize_t n = line_at(lb, 0, &skip, 0);
+    if (n < 0)
+        return 0;
+    memcpy(line, lb->data, n);
+    line[n] = '\0';
+    drop_bytes(lb, skip);
+    return 1;
+}
+
+// Append what fd has to lb. Returns bytes read, 0 at EOF, -1 with errno
+// EAGAIN when nothing is waiting.
+static inline ssize_t fill_line_buf(int fd, struct line_buf *lb)
+{
+    ssize_t n;
+    do
+    {
+        n = read(fd, lb->data + lb->len, sizeof(lb->data) - lb->len);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0)
+        lb->len += n;
+    return n;
+}
+
+#endif
@@ -0,0 +1,265 @@
+/*
+ * File: chat_bench.c
+ * Purpose: Ping-pong benchmark of the chat transports. A parent and a
+ *          forked child exchange TEXT frames first over a pipe pair (the
+ *          kernel object behind the chat's FIFOs), then over the
+ *          shared-memory rings of chat_shm.h with the pipes as doorbells,
+ *          through the same chan_read()/chan_writev() the chat uses.
+ *          Reports round-trip latency (mean, p50, p99) and the one-way
+ *          throughput of a stream of frames sent one call each.
+ *          With more than one CPU the shared-memory side spins briefly
+ *          before it sleeps on a doorbell.
+ *          Usage: ./chat_bench [-n ROUNDS] [-m MESSAGES] [-b BYTES]
+ * Build: gcc -O2 chat_bench.c -o chat_bench
+ * Author: Sean Balbale
+ * Date: 10/17/2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "chat.h"
+
+#define SPIN_ROUNDS 20000 // Checks of the rings before sleeping, with several CPUs
+
+// One end: the connection and its unread frames
+struct side
+{
+    struct chan ch;
+    struct frame_buf in;
+    int spin;
+};
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted sample
+double percentile(const double *sorted, int n, double p)
+{
+    int rank = (int)(p * n + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    if (rank > n)
+        rank = n;
+    return sorted[rank - 1];
+}
+
+// Wait for the other side after a read or write said EAGAIN
+static void wait_for(struct side *s)
+{
+    for (int k = 0; k < s->spin; k++)
+    {
+        if (ring_avail(s->ch.in) > 0 || RING_SIZE - ring_avail(s->ch.out) > 0)
+            return;
+    }
+    struct pollfd pfd = {s->ch.rfd, POLLIN, 0};
+    poll(&pfd, 1, -1);
+}
+
+// Send one frame whole
+static void send_frame(struct side *s, uint32_t type, const char *payload, size_t len)
+{
+    struct frame_hdr hdr = {(uint32_t)len, type};
+    struct iovec iov[2] = {{&hdr, sizeof(hdr)}, {(char *)payload, len}};
+    struct iovec *v = iov;
+    int cnt = len > 0 ? 2 : 1;
+    while (cnt > 0)
+    {
+        ssize_t n = chan_writev(&s->ch, v, cnt);
+        if (n < 0 && errno == EAGAIN)
+        {
+            wait_for(s);
+            continue;
+        }
+        if (n < 0)
+        {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        while (cnt > 0 && (size_t)n >= v->iov_len)
+        {
+            n -= v->iov_len;
+            v++;
+            cnt--;
+        }
+        if (cnt > 0)
+        {
+            v->iov_base = (char *)v->iov_base + n;
+            v->iov_len -= n;
+        }
+    }
+}
+
+// The next frame from the other side; *payload stays valid until the next call
+static struct frame_hdr recv_frame(struct side *s, char **payload)
+{
+    struct frame_hdr hdr;
+    for (;;)
+    {
+        int got = take_frame(&s->in, &hdr, payload);
+        if (got > 0)
+            return hdr;
+        ssize_t n = got < 0 ? -1 : fill_frame_buf(&s->ch, &s->in);
+        if (n < 0 && errno == EAGAIN)
+            wait_for(s);
+        else if (n <= 0)
+        {
+            fprintf(stderr, "chat_bench: %s\n", got < 0 ? "bad frame" : "peer closed");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// The child echoes every frame until BYE, then counts frames until the
+// next BYE and answers with the count
+static void echo_side(struct side *s)
+{
+    struct frame_hdr hdr;
+    char *payload;
+    long count = 0;
+    while ((hdr = recv_frame(s, &payload)).type != FRAME_BYE)
+        send_frame(s, FRAME_TEXT, payload, hdr.len);
+    while ((hdr = recv_frame(s, &payload)).type != FRAME_BYE)
+        count++;
+    send_frame(s, FRAME_TEXT, (char *)&count, sizeof(count));
+    exit(0);
+}
+
+// One transport: fork the echo side, time ping-pongs, then a stream
+static void run(const char *label, int use_shm, int rounds, long messages, size_t bytes, int spin)
+{
+    int up[2], down[2];
+    struct shm_chan *shm = NULL;
+    if (pipe(up) == -1 || pipe(down) == -1)
+    {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    if (use_shm)
+    {
+        if ((shm = shm_chan_map(getpid(), 1)) == NULL)
+        {
+            perror("shm_open");
+            exit(EXIT_FAILURE);
+        }
+        shm_chan_unlink(getpid()); // The mapping is inherited by the child
+        // Doorbells are drained without blocking
+        fcntl(up[0], F_SETFL, O_NONBLOCK);
+        fcntl(down[0], F_SETFL, O_NONBLOCK);
+        fcntl(up[1], F_SETFL, O_NONBLOCK);
+        fcntl(down[1], F_SETFL, O_NONBLOCK);
+    }
+
+    struct side me = {{down[0], up[1], shm ? &shm->down : NULL, shm ? &shm->up : NULL}, {malloc(FRAME_BUF), 0, 0}, use_shm ? spin : 0};
+    fflush(stdout); // Or the child prints it again
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        struct side peer = {{up[0], down[1], shm ? &shm->up : NULL, shm ? &shm->down : NULL}, {malloc(FRAME_BUF), 0, 0}, me.spin};
+        close(down[0]);
+        close(up[1]);
+        echo_side(&peer);
+    }
+    close(up[0]);
+    close(down[1]);
+
+    char *msg = malloc(bytes), *payload;
+    double *rtt = malloc(rounds * sizeof(double)), sum = 0;
+    memset(msg, 'x', bytes);
+    for (int k = 0; k < rounds / 10; k++) // Warm up
+    {
+        send_frame(&me, FRAME_TEXT, msg, bytes);
+        recv_frame(&me, &payload);
+    }
+    for (int k = 0; k < rounds; k++)
+    {
+        long long t0 = now_ns();
+        send_frame(&me, FRAME_TEXT, msg, bytes);
+        recv_frame(&me, &payload);
+        rtt[k] = (now_ns() - t0) / 1000.0;
+        sum += rtt[k];
+    }
+    send_frame(&me, FRAME_BYE, NULL, 0);
+
+    long long t0 = now_ns();
+    for (long k = 0; k < messages; k++)
+        send_frame(&me, FRAME_TEXT, msg, bytes);
+    send_frame(&me, FRAME_BYE, NULL, 0);
+    struct frame_hdr hdr = recv_frame(&me, &payload);
+    double secs = (now_ns() - t0) / 1e9;
+    long count = 0;
+    if (hdr.len == sizeof(count))
+        memcpy(&count, payload, sizeof(count));
+    if (count != messages)
+        fprintf(stderr, "chat_bench: %s: %ld of %ld frames arrived\n", label, count, messages);
+
+    qsort(rtt, rounds, sizeof(double), cmp_double);
+    printf("%-6s %10.2f %10.2f %10.2f %12.0f %10.1f\n", label, sum / rounds, percentile(rtt, rounds, 0.50),
+           percentile(rtt, rounds, 0.99), messages / secs, messages * (bytes + sizeof(hdr)) / secs / 1e6);
+
+    close(down[0]);
+    close(up[1]);
+    waitpid(pid, NULL, 0);
+    if (shm != NULL)
+        munmap(shm, sizeof(*shm));
+    free(me.in.data);
+    free(msg);
+    free(rtt);
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = 100000;
+    long messages = 1000000;
+    long bytes = 64;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:m:b:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        case 'm':
+            messages = atol(optarg);
+            break;
+        case 'b':
+            bytes = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n ROUNDS] [-m MESSAGES] [-b BYTES]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (rounds < 1 || messages < 1 || bytes < 1 || bytes > LINE_MAX_LEN)
+    {
+        fprintf(stderr, "%s: need ROUNDS, MESSAGES >= 1 and 1 <= BYTES <= %d\n", argv[0], LINE_MAX_LEN);
+        exit(EXIT_FAILURE);
+    }
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int spin = ncpu > 1 ? SPIN_ROUNDS : 0;
+
+    printf("%d round trips, %ld one-way frames of %ld bytes, %ld CPU(s)%s\n", rounds, messages, bytes, ncpu,
+           spin ? "" : ", no spinning");
+    printf("%-6s %10s %10s %10s %12s %10s\n", "", "rtt_us", "p50_us", "p99_us", "msgs/s", "MB/s");
+    fflush(stdout);
+    run("fifo", 0, rounds, messages, bytes, spin);
+    run("shm", 1, rounds, messages, bytes, spin);
+    return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * File: chat_shm.h
+ * Purpose: Shared-memory transport for the FIFO chat. A client started
+ *          with -s creates a POSIX shared-memory segment named after its
+ *          pid, holding two single-producer/single-consumer rings, one per
+ *          direction, and asks for it in its JOIN. Frames then travel as
+ *          plain memory copies instead of through the kernel.
+ *          The client's FIFO pair stays open as a doorbell only: a side
+ *          writes one byte to it when the other side has said it is going
+ *          to sleep on an empty ring (waiting for data) or a full one
+ *          (waiting for room). While both sides keep up, no system call is
+ *          made at all. A closed doorbell still means the peer is gone.
+ * Author: Sean Balbale
+ * Date: 10/17/2026
+ */
+
+#ifndef CHAT_SHM_H
+#define CHAT_SHM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#define SHM_NAME_FMT "/seanb_%d" // Client pid
+#define RING_SIZE (64 << 10)     // Bytes per direction, as much as a pipe holds; a power of two
+
+// head and tail only grow; head - tail bytes are waiting at data[tail % RING_SIZE].
+// Each field sits on its own cache line so the two sides do not share one.
+struct shm_ring
+{
+    _Atomic uint64_t head; // Bytes written so far; stored by the producer only
+    char pad1[56];
+    _Atomic uint64_t tail; // Bytes read so far; stored by the consumer only
+    char pad2[56];
+    _Atomic int sleeping; // The consumer found the ring empty: ring its doorbell
+    char pad3[60];
+    _Atomic int blocked; // The producer found the ring full: ring its doorbell
+    char pad4[60];
+    char data[RING_SIZE];
+};
+
+struct shm_chan
+{
+    struct shm_ring up;   // Client to server
+    struct shm_ring down; // Server to client
+};
+
+// Map the segment of client pid: created by the client, opened by the
+// server. Returns NULL on failure.
+static inline struct shm_chan *shm_chan_map(int pid, int create)
+{
+    char name[32];
+    snprintf(name, sizeof(name), SHM_NAME_FMT, pid);
+    if (create)
+        shm_unlink(name); // Left behind by an earlier process with this pid
+    int fd = shm_open(name, create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+    if (fd == -1)
+        return NULL;
+    if (create && ftruncate(fd, sizeof(struct shm_chan)) == -1)
+    {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    struct shm_chan *sc = mmap(NULL, sizeof(struct shm_chan), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (sc == MAP_FAILED)
+    {
+        if (create)
+            shm_unlink(name);
+        return NULL;
+    }
+    if (create)
+    {
+        // Both consumers start out waiting, so the first frame rings
+        atomic_store(&sc->up.sleeping, 1);
+        atomic_store(&sc->down.sleeping, 1);
+    }
+    return sc;
+}
+
+static inline void shm_chan_unlink(int pid)
+{
+    char name[32];
+    snprintf(name, sizeof(name), SHM_NAME_FMT, pid);
+    shm_unlink(name);
+}
+
+// Wake the other side. A full doorbell FIFO already has a byte waiting.
+static inline void ring_bell(int fd)
+{
+    char b = 0;
+    while (write(fd, &b, 1) < 0 && errno == EINTR)
+        ;
+}
+
+static inline uint64_t ring_avail(struct shm_ring *r)
+{
+    return atomic_load_explicit(&r->head, memory_order_acquire) - atomic_load_explicit(&r->tail, memory_order_relaxed);
+}
+
+// Empty a doorbell before asking for a new one. Returns 1 if the other
+// side has closed it.
+static inline int ring_drain(int bell_in)
+{
+    char junk[64];
+    ssize_t n;
+    while ((n = read(bell_in, junk, sizeof(junk))) > 0 || (n < 0 && errno == EINTR))
+        ;
+    return n == 0;
+}
+
+// Copy as much of iov[0..cnt) into r as fits, like writev() on a
+// non-blocking pipe. If r is full, returns -1 with errno EAGAIN, and the
+// consumer rings bell_in once it makes room. Rings bell_out if the
+// consumer is asleep.
+// Drains bell_in when r is full, so a caller that also reads must retry
+// its reads after a full ring.
+static inline ssize_t ring_writev(struct shm_ring *r, const struct iovec *iov, int cnt, int bell_in, int bell_out)
+{
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint64_t room = RING_SIZE - (head - atomic_load_explicit(&r->tail, memory_order_acquire));
+    if (room == 0)
+    {
+        // Going to wait: clear old doorbells, ask for a new one, look
+        // again in case the consumer made room before it saw the request
+        ring_drain(bell_in);
+        atomic_store(&r->blocked, 1);
+        room = RING_SIZE - (head - atomic_load(&r->tail));
+        if (room == 0)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        atomic_store_explicit(&r->blocked, 0, memory_order_relaxed);
+    }
+
+    uint64_t at = head;
+    for (int k = 0; k < cnt && at - head < room; k++)
+    {
+        size_t len = iov[k].iov_len;
+        if (len > room - (at - head))
+            len = room - (at - head);
+        size_t off = at % RING_SIZE, first = len < RING_SIZE - off ? len : RING_SIZE - off;
+        memcpy(r->data + off, iov[k].iov_base, first);
+        memcpy(r->data, (char *)iov[k].iov_base + first, len - first);
+        at += len;
+    }
+    // Publish, then check for a sleeper; both sequentially consistent so
+    // that either the consumer sees the data or we see its flag
+    atomic_store(&r->head, at);
+    if (atomic_load(&r->sleeping) && atomic_exchange(&r->sleeping, 0))
+        ring_bell(bell_out);
+    return at - head;
+}
+
+// Copy up to len bytes out of r, like read() on a non-blocking pipe: the
+// count, -1 with errno EAGAIN if r is empty (the producer rings bell_in
+// when it writes), or 0 if it is empty and the producer has closed
+// bell_in. Rings bell_out if the producer was waiting for room.
+// Drains bell_in when r is empty, so a caller that also writes must retry
+// its writes after every read.
+static inline ssize_t ring_read(struct shm_ring *r, char *buf, size_t len, int bell_in, int bell_out)
+{
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint64_t avail = atomic_load_explicit(&r->head, memory_order_acquire) - tail;
+    if (avail == 0)
+    {
+        // Going to sleep: clear old doorbells, ask for a new one, look again
+        int closed = ring_drain(bell_in);
+        atomic_store(&r->sleeping, 1);
+        avail = atomic_load(&r->head) - tail;
+        if (avail == 0)
+        {
+            if (closed)
+                return 0;
+            errno = EAGAIN;
+            return -1;
+        }
+        atomic_store_explicit(&r->sleeping, 0, memory_order_relaxed);
+    }
+
+    if (len > avail)
+        len = avail;
+    size_t off = tail % RING_SIZE, first = len < RING_SIZE - off ? len : RING_SIZE - off;
+    memcpy(buf, r->data + off, first);
+    memcpy(buf + first, r->data, len - first);
+    atomic_store(&r->tail, tail + len);
+    if (atomic_load(&r->blocked) && atomic_exchange(&r->blocked, 0))
+        ring_bell(bell_out);
+    return len;
+}
+
+#endif
@@ -1,6 +1,13 @@
 /*
  * File: client.c
- * Purpose: Implements a simple client for server-client chat using named pipes (FIFOs)
+ * Purpose: Implements a client for the multi-client FIFO chat server.
+ *          It creates its own FIFO pair, registers through the server's
+ *          request FIFO and then, in one poll loop, sends what is typed
+ *          and prints what arrives. Usage: ./client [-s] [name]
+ *          Typed lines are sent as frames, as many as are waiting in one
+ *          writev(), so a file can be piped through the chat.
+ *          With -s, frames go through shared-memory rings instead and the
+ *          FIFOs only carry wakeups (see chat_shm.h).
  * Author: Sean Balbale
  * Date: 2/6/2026
  */
@@ -12,117 +19,241 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <poll.h>
 #include <signal.h>
-#include <sys/wait.h>
 #include <errno.h>
+#include "chat.h"
 
-#define FIFO1 "/tmp/seanb_FIFO1"
-#define FIFO2 "/tmp/seanb_FIFO2"
+#define BATCH 256 // Lines per writev(), two iovecs each
 
-int main()
+static char s2c[64], c2s[64];
+static struct chan ch;
+static struct frame_buf incoming;
+
+void cleanup_and_exit(int signo)
 {
-    int fd1, fd2;
-    char buf[BUFSIZ];
-    pid_t pid;
+    (void)signo;
+    unlink(s2c);
+    unlink(c2s);
+    shm_chan_unlink(getpid());
+    exit(EXIT_FAILURE);
+}
 
-    printf("Client connecting...\n");
+// Print every frame the server has sent so far. Returns 1 once the
+// server has gone or ended the chat.
+static int receive(void)
+{
+    struct frame_hdr hdr;
+    char *payload;
+    int got;
+    ssize_t n;
+    do
+    {
+        n = fill_frame_buf(&ch, &incoming);
+        while ((got = take_frame(&incoming, &hdr, &payload)) > 0 && hdr.type == FRAME_TEXT)
+        {
+            fwrite(payload, 1, hdr.len, stdout);
+            putchar('\n');
+        }
+    } while (n > 0 && got == 0);
+    fflush(stdout);
+    if (got != 0 || n == 0 || (n < 0 && errno != EAGAIN))
+    {
+        printf(got < 0 ? "Bad data from server.\n" : "Server disconnected.\n");
+        return 1;
+    }
+    return 0;
+}
 
-    // Client opens the existing pipes
-    // Must match the Server's order to avoid deadlock
-    // Server: open(FIFO1, WR), open(FIFO2, RD)
+// Send every byte of iov[0..cnt); modifies iov. A full FIFO or ring
+// means waiting for room, and printing whatever the server sends
+// meanwhile: it stops reading from us while our side of the chat backs
+// up. Returns -1 if the server is gone.
+static int send_all(struct iovec *iov, int cnt)
+{
+    while (cnt > 0)
+    {
+        ssize_t n = chan_writev(&ch, iov, cnt);
+        if (n < 0 && errno == EAGAIN)
+        {
+            // The ring's room is announced on the doorbell, the FIFO's by POLLOUT
+            struct pollfd pfd[2] = {{ch.rfd, POLLIN, 0}, {ch.wfd, POLLOUT, 0}};
+            if (poll(pfd, ch.out != NULL ? 1 : 2, -1) < 0 && errno != EINTR)
+                return -1;
+            if ((ch.out != NULL || pfd[0].revents) && receive())
+                return -1;
+            continue;
+        }
+        if (n < 0)
+            return -1;
+        while (cnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
 
-    // 1. Open FIFO1 for reading
-    // This unblocks the Server's open(FIFO1, WR)
-    fd1 = open(FIFO1, O_RDONLY);
-    if (fd1 == -1)
+// Send every complete line in lb as a TEXT frame, BATCH lines per
+// writev(), and drop them from lb. A line "." is sent as BYE and ends it.
+// Returns 1 after BYE, -1 if the server is gone, else 0.
+static int send_lines(struct line_buf *lb, int at_eof)
+{
+    struct frame_hdr hdr[BATCH];
+    struct iovec iov[2 * BATCH];
+    size_t off = 0, skip;
+    ssize_t len;
+    int nhdr = 0, niov = 0, bye = 0;
+    do
     {
-        if (errno == ENOENT)
+        len = line_at(lb, off, &skip, at_eof);
+        if (len >= 0)
         {
-            fprintf(stderr, "Error: FIFO1 not found. Start the server first.\n");
+            bye = len == 1 && lb->data[off] == '.';
+            hdr[nhdr].len = bye ? 0 : len;
+            hdr[nhdr].type = bye ? FRAME_BYE : FRAME_TEXT;
+            iov[niov++] = (struct iovec){&hdr[nhdr++], sizeof(hdr[0])};
+            if (hdr[nhdr - 1].len > 0)
+                iov[niov++] = (struct iovec){lb->data + off, len};
+            off += skip;
         }
-        else
+        if (nhdr == BATCH || (nhdr > 0 && (len < 0 || bye)))
         {
-            perror("open FIFO1");
+            if (send_all(iov, niov) < 0)
+                return -1;
+            nhdr = niov = 0;
         }
-        exit(EXIT_FAILURE);
+    } while (len >= 0 && !bye);
+    drop_bytes(lb, off);
+    return bye;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct line_buf typed;
+    static char inbuf[FRAME_BUF];
+    struct frame_hdr hdr;
+    char name[NAME_LEN], join[64];
+    pid_t pid = getpid();
+    int arg = 1, use_shm = 0;
+
+    if (arg < argc && strcmp(argv[arg], "-s") == 0)
+    {
+        use_shm = 1;
+        arg++;
     }
+    incoming.data = inbuf;
+    if (arg < argc)
+        snprintf(name, sizeof(name), "%s", argv[arg]);
+    else
+        snprintf(name, sizeof(name), "user%d", (int)pid);
+    snprintf(s2c, sizeof(s2c), CLIENT_FIFO_FMT, (int)pid, "s2c");
+    snprintf(c2s, sizeof(c2s), CLIENT_FIFO_FMT, (int)pid, "c2s");
 
-    // 2. Open FIFO2 for writing
-    // This unblocks the Server's open(FIFO2, RD)
-    fd2 = open(FIFO2, O_WRONLY);
-    if (fd2 == -1)
+    signal(SIGTERM, cleanup_and_exit);
+    signal(SIGINT, cleanup_and_exit);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Client connecting...\n");
+
+    // Our private pair; the server opens the other ends
+    if ((mkfifo(s2c, 0666) == -1 && errno != EEXIST) || (mkfifo(c2s, 0666) == -1 && errno != EEXIST))
     {
-        perror("open FIFO2");
-        exit(EXIT_FAILURE);
+        perror("mkfifo");
+        cleanup_and_exit(0);
+    }
+    // The rings have to exist before the server hears of them
+    struct shm_chan *shm = NULL;
+    if (use_shm && (shm = shm_chan_map(pid, 1)) == NULL)
+    {
+        perror("shm_open");
+        cleanup_and_exit(0);
     }
 
-    printf("Connected to server. Start typing. (Send '.' to exit)\n");
+    // 1. Open s2c for reading first, so the server's non-blocking open
+    //    for writing finds a reader
+    int fd1 = open(s2c, O_RDONLY | O_NONBLOCK);
 
-    pid = fork();
-    if (pid < 0)
+    // 2. Register. The request FIFO only opens while the server reads it.
+    int req = open(REQUEST_FIFO, O_WRONLY | O_NONBLOCK);
+    if (fd1 == -1 || req == -1)
     {
-        perror("fork");
-        exit(EXIT_FAILURE);
+        if (req == -1 && (errno == ENOENT || errno == ENXIO))
+            fprintf(stderr, "Error: %s not found. Start the server first.\n", REQUEST_FIFO);
+        else
+            perror("open");
+        cleanup_and_exit(0);
     }
+    int len = snprintf(join + sizeof(hdr), sizeof(join) - sizeof(hdr), "%d %s%s", (int)pid, name, use_shm ? " shm" : "");
+    len = put_frame(join, FRAME_JOIN, join + sizeof(hdr), len);
+    if (write(req, join, len) != len) // One write under PIPE_BUF: never mixed with another client's
+    {
+        perror("register");
+        cleanup_and_exit(0);
+    }
+    close(req);
 
-    if (pid > 0)
+    // 3. Open c2s for writing; this waits until the server opens it.
+    //    Then make it non-blocking, so a full FIFO never stops us reading.
+    int fd2 = open(c2s, O_WRONLY);
+    if (fd2 == -1)
     {
-        // Parent process: Monitors stdin and writes to the outgoing FIFO (FIFO2)
-        while (1)
-        {
-            // Read from stdin
-            if (fgets(buf, BUFSIZ, stdin) == NULL)
-            {
-                break;
-            }
+        perror("open c2s");
+        cleanup_and_exit(0);
+    }
+    fcntl(fd2, F_SETFL, fcntl(fd2, F_GETFL) | O_NONBLOCK);
+    // Both ends are open (and the server maps the rings before it opens
+    // them), so the names are no longer needed
+    unlink(s2c);
+    unlink(c2s);
+    if (shm != NULL)
+        shm_chan_unlink(pid);
+    ch = (struct chan){fd1, fd2, shm ? &shm->down : NULL, shm ? &shm->up : NULL};
 
-            // Write to FIFO2
-            write(fd2, buf, strlen(buf) + 1);
+    printf("Connected to server. Start typing. (Send '.' to exit)\n");
+    fflush(stdout);
 
-            // Check for exit condition
-            if (strcmp(buf, ".\n") == 0)
-            {
-                break;
-            }
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {fd1, POLLIN, 0}};
+    int done = 0;
+    while (!done)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
         }
 
-        // Cleanup
-        close(fd1);
-        close(fd2);
+        if (fds[1].revents && receive())
+            break;
 
-        kill(pid, SIGTERM);
-        wait(NULL);
-        printf("Client exited.\n");
-        exit(0);
-    }
-    else
-    {
-        // Child process: Blocks on the incoming FIFO (FIFO1) and renders received data
-        while (1)
+        if (fds[0].revents)
         {
-            ssize_t n = read(fd1, buf, BUFSIZ); // Read from FIFO1
-            if (n <= 0)
-            {
-                break; // EOF or error
-            }
-
-            // Check for exit condition from Server
-            if (strcmp(buf, ".\n") == 0)
-            { // Server signals exit
+            // Typed lines: send each one, stop after "." or at end of input
+            ssize_t n = fill_line_buf(STDIN_FILENO, &typed);
+            int sent = send_lines(&typed, n == 0);
+            if (sent < 0)
                 printf("Server disconnected.\n");
-                kill(getppid(), SIGTERM); // Notify parent to exit
-                break;
+            else if (sent == 0 && n == 0)
+            {
+                hdr = (struct frame_hdr){0, FRAME_BYE};
+                struct iovec iov = {&hdr, sizeof(hdr)};
+                send_all(&iov, 1);
             }
-
-            // Print received message
-            printf("Server: %s", buf);
-            fflush(stdout);
+            done = sent != 0 || n == 0;
         }
-
-        close(fd1);
-        close(fd2);
-        exit(0);
     }
 
+    close(fd1);
+    close(fd2);
+    printf("Client exited.\n");
     return 0;
 }
@@ -1,155 +1,591 @@
 /*
  * File: server.c
- * Purpose: Implements a simple server-client chat using named pipes (FIFOs)
+ * Purpose: Implements a multi-client chat server using named pipes (FIFOs).
+ *          Clients register through the well-known request FIFO and each
+ *          gets its own FIFO pair (see chat.h). One epoll loop serves every
+ *          client and the server console with non-blocking I/O; output a
+ *          client cannot take yet is queued per client.
+ *          A line from a client goes to everyone else, "/to NAME text" to
+ *          one client only, "/who" lists who is here and "." leaves.
+ *          A line typed at the server goes to everyone; "." ends the chat.
+ *          Frames queued for a client during one round of events go out
+ *          together in a single write at the end of the round. While any
+ *          client is backed up, the server stops reading chat input, so
+ *          fast senders block instead of being dropped.
+ *          A client that asks for shared memory in its JOIN is served
+ *          through the rings of chat_shm.h, with its FIFOs as doorbells.
  * Author: Sean Balbale
  * Date: 2/6/2026
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <time.h>
 #include <signal.h>
-#include <sys/wait.h>
 #include <errno.h>
+#include "chat.h"
 
-#define FIFO1 "/tmp/seanb_FIFO1"
-#define FIFO2 "/tmp/seanb_FIFO2"
+#define MAX_CLIENTS 1024
+#define MAX_EVENTS 64
+#define OUT_LIMIT (4 << 20)  // Output queued for one client before it is dropped
+#define HIGH_WATER (256 << 10) // Queued output that pauses reading from clients
+#define STUCK_SECS 10          // How long a client may stay above HIGH_WATER
+
+// epoll tags: client slot * 2 + 0 for its input, + 1 for its output, with
+// the slot's generation in the upper 32 bits (see client_tag())
+#define TAG_STDIN 0xFFFFFFFEu
+#define TAG_REQUEST 0xFFFFFFFDu
+
+struct client
+{
+    int used;
+    pid_t pid;
+    char name[NAME_LEN];
+    struct chan ch;       // rfd: client to server FIFO, read end; wfd: server to client, write end
+    struct shm_chan *shm; // Mapped rings of a shared-memory client, or NULL
+    int ready;            // On the ready list
+    struct frame_buf in;
+    char *out;            // Frames not written yet: out[outoff..outlen)
+    size_t outoff, outlen, outcap;
+    int want_out;         // The write end is watched for EPOLLOUT
+    int dirty;            // On the flush list
+    time_t backed_since;  // When it went above HIGH_WATER, or 0
+    unsigned int gen;     // Bumped each time the slot is reused
+};
+
+static struct client clients[MAX_CLIENTS];
+static int epfd;
+static int nclients;
+static int dirty[MAX_CLIENTS], ndirty; // Clients with frames queued this round
+static int ready[MAX_CLIENTS], nready; // Shared-memory clients with input left in their ring
+static int nbacked;                    // Clients above HIGH_WATER
+static int paused;                     // Client input is not being read
 
 void cleanup_and_exit(int signo)
 {
+    (void)signo;
     printf("\nConversation ended.\n");
-    unlink(FIFO1);
-    unlink(FIFO2);
+    unlink(REQUEST_FIFO);
     exit(0);
 }
 
-int main()
+static void watch(int op, int fd, unsigned int events, uint64_t tag)
 {
-    int fd1, fd2;
-    char buf[BUFSIZ];
-    pid_t pid;
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = tag;
+    if (epoll_ctl(epfd, op, fd, &ev) == -1 && op != EPOLL_CTL_DEL)
+    {
+        perror("epoll_ctl");
+        exit(EXIT_FAILURE);
+    }
+}
 
-    // Handle termination signal to clean up pipes
-    signal(SIGTERM, cleanup_and_exit);
+// A client's tag carries its slot's generation, so events still queued
+// for a client dropped earlier in the round cannot reach the next one
+static uint64_t client_tag(int idx, int out)
+{
+    return (uint64_t)clients[idx].gen << 32 | (unsigned int)(idx * 2 + out);
+}
+
+static void mark_dirty(int idx)
+{
+    if (!clients[idx].dirty)
+    {
+        clients[idx].dirty = 1;
+        dirty[ndirty++] = idx;
+    }
+}
+
+static void mark_ready(int idx)
+{
+    if (!clients[idx].ready)
+    {
+        clients[idx].ready = 1;
+        ready[nready++] = idx;
+    }
+}
 
-    // Create FIFOs
-    // The server must create the pipes
-    if (mkfifo(FIFO1, 0666) == -1)
-    { // Create first FIFO
-        if (errno != EEXIST)
-        { // Ignore error if FIFO already exists
-            perror("mkfifo FIFO1");
-            exit(EXIT_FAILURE);
+static void drop_client(int idx, const char *why);
+
+// Write as much queued output as the client takes. Ask for EPOLLOUT while
+// some is left; a shared-memory client rings instead when it makes room.
+// Returns -1 if the client was dropped.
+static int flush_client(int idx)
+{
+    struct client *c = &clients[idx];
+    while (c->outoff < c->outlen)
+    {
+        struct iovec iov = {c->out + c->outoff, c->outlen - c->outoff};
+        ssize_t n = chan_writev(&c->ch, &iov, 1);
+        if (n < 0 && errno == EAGAIN && c->shm != NULL)
+            mark_ready(idx); // The doorbell it emptied may have been for input
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n < 0)
+        {
+            drop_client(idx, "gone");
+            return -1;
         }
+        c->outoff += n;
+    }
+    if (c->outoff == c->outlen)
+        c->outoff = c->outlen = 0;
+    if (c->shm == NULL && c->want_out != (c->outoff < c->outlen))
+    {
+        c->want_out = !c->want_out;
+        watch(EPOLL_CTL_MOD, c->ch.wfd, c->want_out ? EPOLLOUT : 0, client_tag(idx, 1));
+    }
+    if ((c->backed_since != 0) != (c->outlen - c->outoff > HIGH_WATER))
+    {
+        c->backed_since = c->backed_since ? 0 : time(NULL);
+        nbacked += c->backed_since ? 1 : -1;
     }
-    if (mkfifo(FIFO2, 0666) == -1)
-    { // Create second FIFO
-        if (errno != EEXIST)
-        { // Ignore error if FIFO already exists
-            perror("mkfifo FIFO2");
-            exit(EXIT_FAILURE);
+    return 0;
+}
+
+// Queue one frame for a client: head, then body. It is written with the
+// rest of the client's queue by flush_pending().
+static void queue_frame(int idx, uint32_t type, const char *head, size_t hlen, const char *body, size_t blen)
+{
+    struct client *c = &clients[idx];
+    size_t len = sizeof(struct frame_hdr) + hlen + blen;
+    if (!c->used) // Dropped while this round was sending to it
+        return;
+    if (c->outlen - c->outoff + len > OUT_LIMIT)
+    {
+        drop_client(idx, "too slow");
+        return;
+    }
+    if (c->outlen + len > c->outcap)
+    {
+        memmove(c->out, c->out + c->outoff, c->outlen - c->outoff);
+        c->outlen -= c->outoff;
+        c->outoff = 0;
+        if (c->outlen + len > c->outcap)
+        {
+            c->outcap = (c->outlen + len) * 2;
+            c->out = realloc(c->out, c->outcap);
         }
     }
+    struct frame_hdr hdr = {(uint32_t)(hlen + blen), type};
+    memcpy(c->out + c->outlen, &hdr, sizeof(hdr));
+    if (hlen > 0)
+        memcpy(c->out + c->outlen + sizeof(hdr), head, hlen);
+    if (blen > 0)
+        memcpy(c->out + c->outlen + sizeof(hdr) + hlen, body, blen);
+    c->outlen += len;
+    mark_dirty(idx);
+}
 
-    printf("Server listening... (Waiting for client to connect)\n");
+// Write out what each client was sent this round
+static void flush_pending(void)
+{
+    int todo[MAX_CLIENTS];
+    // Dropping a client queues notices for others, so repeat until no
+    // client is left on the list
+    while (ndirty > 0)
+    {
+        int n = ndirty;
+        memcpy(todo, dirty, n * sizeof(todo[0]));
+        ndirty = 0;
+        for (int k = 0; k < n; k++)
+        {
+            struct client *c = &clients[todo[k]];
+            c->dirty = 0;
+            if (c->used)
+                flush_client(todo[k]);
+        }
+    }
+}
 
-    // Open FIFOs - Order is critical for deadlock avoidance
-    // Server writes to FIFO1 and reads from FIFO2
+// Queue one line for a client: the formatted head, then body as it is
+static void send_line(int idx, const char *body, size_t blen, const char *fmt, ...)
+{
+    char head[LINE_MAX_LEN];
+    va_list ap;
+    va_start(ap, fmt);
+    int hlen = vsnprintf(head, sizeof(head), fmt, ap);
+    va_end(ap);
+    if (hlen > (int)sizeof(head) - 1)
+        hlen = sizeof(head) - 1;
+    queue_frame(idx, FRAME_TEXT, head, hlen, body, blen);
+}
 
-    // 1. Open FIFO1 for writing
-    // This call blocks until the Client opens FIFO1 for reading
-    fd1 = open(FIFO1, O_WRONLY);
-    if (fd1 == -1)
+// One line to everyone but `from` (-1: everyone)
+static void broadcast(int from, const char *body, size_t blen, const char *fmt, ...)
+{
+    char head[LINE_MAX_LEN];
+    va_list ap;
+    va_start(ap, fmt);
+    int hlen = vsnprintf(head, sizeof(head), fmt, ap);
+    va_end(ap);
+    if (hlen > (int)sizeof(head) - 1)
+        hlen = sizeof(head) - 1;
+    for (int k = 0; k < MAX_CLIENTS; k++)
     {
-        perror("open FIFO1");
-        exit(EXIT_FAILURE);
+        if (clients[k].used && k != from)
+            queue_frame(k, FRAME_TEXT, head, hlen, body, blen);
     }
+}
 
-    // 2. Open FIFO2 for reading
-    // Client should open FIFO2 for writing around the same time
-    fd2 = open(FIFO2, O_RDONLY);
-    if (fd2 == -1)
+static void drop_client(int idx, const char *why)
+{
+    struct client *c = &clients[idx];
+    if (!c->used)
+        return;
+    watch(EPOLL_CTL_DEL, c->ch.rfd, 0, 0);
+    watch(EPOLL_CTL_DEL, c->ch.wfd, 0, 0);
+    close(c->ch.rfd);
+    close(c->ch.wfd);
+    if (c->shm != NULL)
+        munmap(c->shm, sizeof(struct shm_chan));
+    free(c->out);
+    free(c->in.data);
+    if (c->backed_since)
+        nbacked--;
+    c->used = 0;
+    nclients--;
+    printf("%s left (%s), %d connected.\n", c->name, why, nclients);
+    fflush(stdout);
+    broadcast(-1, NULL, 0, "* %s left", c->name);
+}
+
+static int find_client(const char *name)
+{
+    for (int k = 0; k < MAX_CLIENTS; k++)
     {
-        perror("open FIFO2");
-        exit(EXIT_FAILURE);
+        if (clients[k].used && strcmp(clients[k].name, name) == 0)
+            return k;
     }
+    return -1;
+}
 
-    printf("Client connected. Start typing. (Send '.' to exit)\n");
+// A JOIN frame from the request FIFO: "<pid> <name> [shm]"
+static void handle_request(const char *payload, size_t len)
+{
+    char req[64], s2c[64], c2s[64], name[NAME_LEN], mode[4] = "", full[64];
+    int pid, idx = -1;
+    struct shm_chan *shm = NULL;
+    snprintf(req, sizeof(req), "%.*s", (int)len, payload);
+    if (sscanf(req, "%d %31s %3s", &pid, name, mode) < 2)
+    {
+        fprintf(stderr, "Bad request: %s\n", req);
+        return;
+    }
+    snprintf(s2c, sizeof(s2c), CLIENT_FIFO_FMT, pid, "s2c");
+    snprintf(c2s, sizeof(c2s), CLIENT_FIFO_FMT, pid, "c2s");
 
-    pid = fork();
-    if (pid < 0)
+    // Map the rings before opening the FIFOs: the client unlinks the
+    // segment once its FIFO opens complete
+    if (strcmp(mode, "shm") == 0 && (shm = shm_chan_map(pid, 0)) == NULL)
     {
-        perror("fork");
-        exit(EXIT_FAILURE);
+        perror("shm_open");
+        return;
     }
 
-    if (pid > 0)
+    // The client already has s2c open for reading, so this cannot block;
+    // its open of c2s for writing waits for ours
+    int wfd = open(s2c, O_WRONLY | O_NONBLOCK);
+    int rfd = open(c2s, O_RDONLY | O_NONBLOCK);
+    if (wfd == -1 || rfd == -1)
     {
-        // Parent process: Monitors stdin and writes to the outgoing FIFO (FIFO1)
-        while (1)
-        {
-            // Read from stdin
-            if (fgets(buf, BUFSIZ, stdin) == NULL)
-            {
-                break;
-            }
+        perror(wfd == -1 ? s2c : c2s);
+        if (wfd != -1)
+            close(wfd);
+        if (rfd != -1)
+            close(rfd);
+        if (shm != NULL)
+            munmap(shm, sizeof(*shm));
+        return;
+    }
+    for (int k = 0; k < MAX_CLIENTS && idx < 0; k++)
+    {
+        if (!clients[k].used)
+            idx = k;
+    }
+    if (idx < 0)
+    {
+        // Said over the FIFO even to a shared-memory client: it is
+        // about to read it as a doorbell and find it closed
+        write(wfd, full, put_frame(full, FRAME_TEXT, "Server full.", 12));
+        close(wfd);
+        close(rfd);
+        if (shm != NULL)
+            munmap(shm, sizeof(*shm));
+        return;
+    }
+
+    struct client *c = &clients[idx];
+    int was_dirty = c->dirty, was_ready = c->ready; // The slot may still be on a list
+    unsigned int gen = c->gen;
+    memset(c, 0, sizeof(*c));
+    c->dirty = was_dirty;
+    c->ready = was_ready;
+    c->gen = gen + 1;
+    c->used = 1;
+    c->pid = pid;
+    c->ch.rfd = rfd;
+    c->ch.wfd = wfd;
+    c->shm = shm;
+    if (shm != NULL)
+    {
+        c->ch.in = &shm->up;
+        c->ch.out = &shm->down;
+    }
+    c->in.data = malloc(FRAME_BUF);
+    if (find_client(name) >= 0)
+        snprintf(c->name, sizeof(c->name), "%.20s-%d", name, pid);
+    else
+        snprintf(c->name, sizeof(c->name), "%s", name);
+    nclients++;
+    // The write end is only watched for EPOLLOUT while output is queued;
+    // EPOLLERR (the client closed its end) comes regardless
+    watch(EPOLL_CTL_ADD, rfd, paused && shm == NULL ? 0 : EPOLLIN, client_tag(idx, 0));
+    watch(EPOLL_CTL_ADD, wfd, 0, client_tag(idx, 1));
 
-            // Write to FIFO1
-            write(fd1, buf, strlen(buf) + 1);
+    printf("%s joined, %d connected.\n", c->name, nclients);
+    broadcast(idx, NULL, 0, "* %s joined", c->name);
+    send_line(idx, NULL, 0, "Welcome %s. /who lists everyone, /to NAME sends privately, . leaves.", c->name);
+}
 
-            // Check for exit condition
-            if (strcmp(buf, ".\n") == 0)
-            {
-                break;
-            }
+static void handle_line(int idx, const char *line, size_t len)
+{
+    struct client *c = &clients[idx];
+    if (len == 4 && memcmp(line, "/who", 4) == 0)
+    {
+        for (int k = 0; k < MAX_CLIENTS; k++)
+        {
+            if (clients[k].used)
+                send_line(idx, NULL, 0, "* %s%s", clients[k].name, k == idx ? " (you)" : "");
         }
+    }
+    else if (len > 4 && memcmp(line, "/to ", 4) == 0)
+    {
+        const char *text = memchr(line + 4, ' ', len - 4);
+        int nlen = (text ? text : line + len) - (line + 4);
+        char name[NAME_LEN];
+        snprintf(name, sizeof(name), "%.*s", nlen, line + 4);
+        int to = find_client(name);
+        if (to < 0 || text == NULL)
+            send_line(idx, NULL, 0, "* No such user: %s", name);
+        else
+            send_line(to, text + 1, line + len - text - 1, "%s (private): ", c->name);
+    }
+    else
+    {
+        printf("%s: ", c->name);
+        fwrite(line, 1, len, stdout);
+        putchar('\n');
+        broadcast(idx, line, len, "%s: ", c->name);
+    }
+}
 
-        // Cleanup when parent exits
-        close(fd1);
-        close(fd2);
+// Read what one client has sent and act on every whole frame in it;
+// a closed writer means the client is gone
+static void read_client(int idx)
+{
+    struct client *c = &clients[idx];
+    struct frame_hdr hdr;
+    char *payload;
+    int got;
+    ssize_t n;
+    if (paused && c->shm != NULL)
+    {
+        // Only empty the doorbell, which may mean there is room for output
+        // again. Input stays in the ring until reading resumes.
+        char junk[64];
+        while ((n = read(c->ch.rfd, junk, sizeof(junk))) > 0)
+            ;
+        if (n != 0)
+        {
+            mark_ready(idx);
+            if (c->outoff < c->outlen)
+                mark_dirty(idx);
+            return;
+        }
+    }
+    n = fill_frame_buf(&c->ch, &c->in);
+    while (c->used && (got = take_frame(&c->in, &hdr, &payload)) != 0)
+    {
+        if (got < 0 || hdr.type == FRAME_JOIN)
+            drop_client(idx, "bad frame");
+        else if (hdr.type == FRAME_BYE)
+            drop_client(idx, "said bye");
+        else
+            handle_line(idx, payload, hdr.len);
+    }
+    if (c->used && (n == 0 || (n < 0 && errno != EAGAIN)))
+        drop_client(idx, "disconnected");
+    if (!c->used || c->shm == NULL)
+        return;
+    // A ring does not stay readable the way a FIFO does, and only a read
+    // that finds it empty asks for a doorbell: come back next round until
+    // one does. The doorbell may also have meant there is room for output.
+    if (n > 0)
+        mark_ready(idx);
+    if (c->outoff < c->outlen)
+        mark_dirty(idx);
+}
 
-        // Terminate child process if it's still running
-        kill(pid, SIGTERM);
-        wait(NULL);
+// Read once more from each shared-memory client that had input left
+static void read_ready(void)
+{
+    int todo[MAX_CLIENTS], n = nready;
+    memcpy(todo, ready, n * sizeof(todo[0]));
+    nready = 0;
+    for (int k = 0; k < n; k++)
+    {
+        clients[todo[k]].ready = 0;
+        if (clients[todo[k]].used)
+            read_client(todo[k]);
+    }
+}
 
-        // Remove pipes
-        unlink(FIFO1);
-        unlink(FIFO2);
-        printf("Server exited.\n");
-        exit(0);
+// Stop or resume reading client input, depending on whether anyone is
+// backed up. Drop clients that have been backed up too long.
+static void pace_clients(void)
+{
+    time_t now = time(NULL);
+    for (int k = 0; k < MAX_CLIENTS && nbacked > 0; k++)
+    {
+        if (clients[k].used && clients[k].backed_since && now - clients[k].backed_since > STUCK_SECS)
+            drop_client(k, "stuck");
     }
-    else
+    flush_pending();
+    if (paused == (nbacked > 0))
+        return;
+    paused = nbacked > 0;
+    // A shared-memory client's FIFO is only a doorbell; it stays watched
+    for (int k = 0; k < MAX_CLIENTS; k++)
+    {
+        if (clients[k].used && clients[k].shm == NULL)
+            watch(EPOLL_CTL_MOD, clients[k].ch.rfd, paused ? 0 : EPOLLIN, client_tag(k, 0));
+    }
+}
+
+int main()
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct line_buf console = {.len = 0};
+    struct frame_buf requests = {.data = malloc(FRAME_BUF)};
+    struct chan reqch = {.in = NULL, .out = NULL};
+    struct frame_hdr hdr;
+    char line[LINE_MAX_LEN + 1], *payload;
+
+    // Handle termination signals to clean up the request FIFO
+    signal(SIGTERM, cleanup_and_exit);
+    signal(SIGINT, cleanup_and_exit);
+    // A client that vanishes shows up as EPIPE on its FIFO
+    signal(SIGPIPE, SIG_IGN);
+
+    if (mkfifo(REQUEST_FIFO, 0666) == -1 && errno != EEXIST)
     {
-        // Child process: Blocks on the incoming FIFO (FIFO2) and renders received data
-        while (1)
+        perror("mkfifo " REQUEST_FIFO);
+        exit(EXIT_FAILURE);
+    }
+    // Keep a writer of our own so the request FIFO never reads as EOF
+    // between clients
+    int reqfd = open(REQUEST_FIFO, O_RDONLY | O_NONBLOCK);
+    int reqkeep = open(REQUEST_FIFO, O_WRONLY);
+    reqch.rfd = reqfd;
+    epfd = epoll_create1(0);
+    if (reqfd == -1 || reqkeep == -1 || epfd == -1)
+    {
+        perror("setup");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    watch(EPOLL_CTL_ADD, reqfd, EPOLLIN, TAG_REQUEST);
+    watch(EPOLL_CTL_ADD, STDIN_FILENO, EPOLLIN, TAG_STDIN);
+
+    printf("Server listening on %s... (Send '.' to end the chat)\n", REQUEST_FIFO);
+    fflush(stdout);
+
+    for (;;)
+    {
+        // While paused, wake up now and then to check for stuck clients;
+        // with ring input left over, just poll
+        int n = epoll_wait(epfd, events, MAX_EVENTS, paused ? 1000 : nready > 0 ? 0 : -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
         {
-            ssize_t n = read(fd2, buf, BUFSIZ);
-            if (n <= 0)
+            perror("epoll_wait");
+            break;
+        }
+        if (nready > 0 && !paused)
+            read_ready();
+        for (int e = 0; e < n; e++)
+        {
+            unsigned int tag = (unsigned int)events[e].data.u64;
+            if (tag == TAG_REQUEST)
             {
-                break; // EOF or error
+                int got;
+                fill_frame_buf(&reqch, &requests);
+                while ((got = take_frame(&requests, &hdr, &payload)) != 0)
+                {
+                    if (got < 0)
+                    {
+                        // Each JOIN is one atomic write, so this is junk
+                        fprintf(stderr, "Bad data on %s\n", REQUEST_FIFO);
+                        requests.off = requests.len = 0;
+                        break;
+                    }
+                    if (hdr.type == FRAME_JOIN)
+                        handle_request(payload, hdr.len);
+                }
             }
-
-            // Check for exit condition from Client
-            if (strcmp(buf, ".\n") == 0)
+            else if (tag == TAG_STDIN)
             {
-                printf("Client disconnected.\n");
-                kill(getppid(), SIGTERM); // Notify parent to exit
-                break;
+                ssize_t got = fill_line_buf(STDIN_FILENO, &console);
+                while (take_line(&console, line))
+                {
+                    if (strcmp(line, ".") == 0)
+                        got = 0;
+                    else
+                        broadcast(-1, line, strlen(line), "server: ");
+                }
+                if (got == 0)
+                {
+                    // End of the chat: tell everyone, the way a client leaves
+                    for (int k = 0; k < MAX_CLIENTS; k++)
+                    {
+                        if (clients[k].used)
+                            queue_frame(k, FRAME_BYE, NULL, 0, NULL, 0);
+                    }
+                    flush_pending();
+                    for (int k = 0; k < MAX_CLIENTS; k++)
+                        drop_client(k, "server exit");
+                    unlink(REQUEST_FIFO);
+                    printf("Server exited.\n");
+                    exit(0);
+                }
+            }
+            else if (clients[tag / 2].used && clients[tag / 2].gen == events[e].data.u64 >> 32)
+            {
+                if (tag % 2 == 0)
+                    read_client(tag / 2);
+                else if (events[e].events & EPOLLERR)
+                    drop_client(tag / 2, "gone");
+                else
+                    flush_client(tag / 2);
             }
-
-            // Print received message
-            printf("Client: %s", buf);
-            fflush(stdout);
         }
-
-        close(fd1);
-        close(fd2);
-        exit(0);
+        // Everything queued this round goes out now, one write per client
+        flush_pending();
+        if (paused || nbacked > 0)
+            pace_clients();
+        fflush(stdout);
     }
 
+    unlink(REQUEST_FIFO);
     return 0;
 }
@@ -0,0 +1,276 @@
+/*
+* File: monte_affinity.h
+* Purpose: CPU placement for the Monte Carlo workers (--pin). Reads the
+*          core, socket and NUMA node of every CPU the master may run on
+*          from sysfs and maps worker i to one CPU: compact fills both
+*          hyperthreads of a core before the next core, scatter spreads
+*          over sockets and cores before using any sibling thread,
+*          physical-only uses one thread per core, and a list names the
+*          CPUs. Needs _GNU_SOURCE for the affinity calls.
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_AFFINITY_H
+#define MONTE_AFFINITY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+
+// Placement policies (selected with --pin=)
+enum pin_kind
+{
+    PIN_NONE = 0, // Leave placement to the scheduler
+    PIN_COMPACT,  // Socket by socket, core by core, sibling threads together
+    PIN_SCATTER,  // Round-robin over sockets, then cores, then sibling threads
+    PIN_PHYSICAL, // First hardware thread of each core only
+    PIN_LIST      // Explicit CPU list, e.g. --pin=0,2,4-7
+};
+
+static const char *pin_names[] = {"none", "compact", "scatter", "physical-only", "list"};
+
+// One CPU the process may run on
+struct cpu_info
+{
+    int cpu;
+    int package; // Socket
+    int core;    // core_id, unique within a socket
+    int node;    // NUMA node, 0 when the kernel has no node directories
+    int smt;     // 0 for the first hardware thread of its core, 1 for the next...
+    int rank;    // Index of the core among the cores of its socket
+};
+
+// Policy name, or a CPU list with or without a "list:" prefix. Returns -1
+// if the argument is neither; *list points at the CPU list for PIN_LIST.
+static inline int pin_parse(const char *arg, const char **list)
+{
+    for (int i = 0; i < PIN_LIST; i++)
+    {
+        if (strcmp(arg, pin_names[i]) == 0)
+            return i;
+    }
+    if (strncmp(arg, "list:", 5) == 0)
+        arg += 5;
+    if (arg[0] < '0' || arg[0] > '9' || arg[strspn(arg, "0123456789,-")] != '\0')
+        return -1;
+    *list = arg;
+    return PIN_LIST;
+}
+
+static inline int pin_read_int(int cpu, const char *file)
+{
+    char path[128];
+    int value = 0;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, file);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return 0;
+    if (fscanf(f, "%d", &value) != 1)
+        value = 0;
+    fclose(f);
+    return value;
+}
+
+// NUMA node of a CPU: the nodeN link in its sysfs directory
+static inline int pin_read_node(int cpu)
+{
+    char path[64];
+    int node = 0;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return 0;
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL)
+    {
+        if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9')
+        {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// Fill cpus[] with the CPUs in this process's affinity mask, in CPU order.
+// Returns how many there are.
+static inline int pin_topology(struct cpu_info *cpus)
+{
+    cpu_set_t allowed;
+    int count = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return 0;
+    for (int c = 0; c < CPU_SETSIZE; c++)
+    {
+        if (!CPU_ISSET(c, &allowed))
+            continue;
+        struct cpu_info *p = &cpus[count++];
+        p->cpu = c;
+        p->package = pin_read_int(c, "physical_package_id");
+        p->core = pin_read_int(c, "core_id");
+        p->node = pin_read_node(c);
+        p->smt = 0;
+        p->rank = 0;
+        for (int k = 0; k < count - 1; k++)
+        {
+            if (cpus[k].package == p->package && cpus[k].core == p->core)
+                p->smt++;
+        }
+    }
+    // rank: the cores of each socket numbered in core_id order
+    for (int i = 0; i < count; i++)
+    {
+        for (int k = 0; k < count; k++)
+        {
+            if (cpus[k].package == cpus[i].package && cpus[k].smt == 0 && cpus[k].core < cpus[i].core)
+                cpus[i].rank++;
+        }
+    }
+    return count;
+}
+
+static inline int pin_cmp_compact(const void *a, const void *b)
+{
+    const struct cpu_info *x = a, *y = b;
+    if (x->node != y->node)
+        return x->node - y->node;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->core != y->core)
+        return x->core - y->core;
+    return x->smt - y->smt;
+}
+
+static inline int pin_cmp_scatter(const void *a, const void *b)
+{
+    const struct cpu_info *x = a, *y = b;
+    if (x->smt != y->smt)
+        return x->smt - y->smt;
+    if (x->rank != y->rank)
+        return x->rank - y->rank;
+    if (x->package != y->package)
+        return x->package - y->package;
+    return x->cpu - y->cpu;
+}
+
+// CPUs of a list like "0,2,4-7", in the order given. Returns how many, or
+// -1 if the list names a CPU outside 0..CPU_SETSIZE-1.
+static inline int pin_parse_list(const char *list, int *out)
+{
+    int count = 0;
+    const char *p = list;
+    while (*p != '\0')
+    {
+        char *end;
+        long first = strtol(p, &end, 10), last = first;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        if (end == p || first < 0 || last < first || last >= CPU_SETSIZE)
+            return -1;
+        for (long c = first; c <= last && count < CPU_SETSIZE; c++)
+            out[count++] = (int)c;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+// CPUs in the order the policy hands them out. Returns how many, or -1
+// with a message on stderr.
+static inline int pin_order(int kind, const char *list, int *order)
+{
+    if (kind == PIN_LIST)
+    {
+        cpu_set_t allowed;
+        int count = pin_parse_list(list, order);
+        if (count <= 0)
+        {
+            fprintf(stderr, "--pin: bad CPU list %s\n", list);
+            return -1;
+        }
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return count;
+        for (int i = 0; i < count; i++)
+        {
+            if (!CPU_ISSET(order[i], &allowed))
+            {
+                fprintf(stderr, "--pin: CPU %d is not available to this process\n", order[i]);
+                return -1;
+            }
+        }
+        return count;
+    }
+
+    struct cpu_info *cpus = malloc(CPU_SETSIZE * sizeof(*cpus));
+    int count = 0;
+    if (cpus == NULL)
+    {
+        perror("malloc");
+        return -1;
+    }
+    int n = pin_topology(cpus);
+    qsort(cpus, n, sizeof(*cpus), kind == PIN_SCATTER ? pin_cmp_scatter : pin_cmp_compact);
+    for (int i = 0; i < n; i++)
+    {
+        if (kind != PIN_PHYSICAL || cpus[i].smt == 0)
+            order[count++] = cpus[i].cpu;
+    }
+    free(cpus);
+    if (count == 0)
+        fprintf(stderr, "--pin: no CPUs available\n");
+    return count > 0 ? count : -1;
+}
+
+// The CPU of worker w for w in [0, workers). Workers past the end of the
+// order wrap around to its start. Returns 0, or -1 with a message on stderr.
+static inline int pin_plan(int kind, const char *list, int workers, int *map)
+{
+    int order[CPU_SETSIZE];
+    int count = pin_order(kind, list, order);
+    if (count < 0)
+        return -1;
+    if (workers > count)
+        fprintf(stderr, "--pin=%s: %d workers share %d CPUs\n", kind == PIN_LIST ? list : pin_names[kind], workers,
+                count);
+    for (int w = 0; w < workers; w++)
+        map[w] = order[w % count];
+    return 0;
+}
+
+// Number of NUMA nodes among the CPUs of a plan
+static inline int pin_nodes(const int *map, int workers)
+{
+    int nodes = 0;
+    for (int w = 0; w < workers; w++)
+    {
+        int node = pin_read_node(map[w]), seen = 0;
+        for (int k = 0; k < w && !seen; k++)
+            seen = pin_read_node(map[k]) == node;
+        nodes += !seen;
+    }
+    return nodes;
+}
+
+static inline void pin_set(cpu_set_t *set, int cpu)
+{
+    CPU_ZERO(set);
+    CPU_SET(cpu, set);
+}
+
+// One line per run so a scaling result can be reproduced on the same box
+static inline void pin_print(FILE *out, int kind, const char *list, const int *map, int workers)
+{
+    fprintf(out, "CPU map (%s):", kind == PIN_LIST ? list : pin_names[kind]);
+    for (int w = 0; w < workers; w++)
+    {
+        fprintf(out, " %d->cpu%d(node %d, core %d)", w, map[w], pin_read_node(map[w]),
+                pin_read_int(map[w], "core_id"));
+    }
+    int nodes = pin_nodes(map, workers);
+    fprintf(out, " on %d NUMA node%s\n", nodes, nodes == 1 ? "" : "s");
+}
+
+#endif
@@ -0,0 +1,264 @@
+/*
+* File: monte_bench.c
+* Purpose: Benchmark and scaling harness for the Monte Carlo Pi programs.
+*          Sweeps worker counts, chunk sizes and N over monte_serial, the
+*          process master/worker mode and the threaded mode, repeats each
+*          point and writes CSV with median/p95 wall time, speedup, parallel
+*          efficiency and the Karp-Flatt serial fraction.
+* Build: gcc -O2 monte_bench.c -o monte_bench   (run next to monte_serial,
+*        monte_master and monte_worker, which all link with -lm)
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "monte_timer.h"
+
+#define MAX_LIST 32
+#define MAX_REPEATS 100
+
+// One parsed list of comma-separated numbers (-M, -C, -N)
+struct num_list
+{
+    int count;
+    long long v[MAX_LIST];
+};
+
+void parse_list(const char *arg, struct num_list *out)
+{
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", arg);
+    out->count = 0;
+    for (char *tok = strtok(buf, ","); tok != NULL && out->count < MAX_LIST; tok = strtok(NULL, ","))
+    {
+        out->v[out->count++] = atoll(tok);
+    }
+}
+
+int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted sample
+double percentile(const double *sorted, int n, double p)
+{
+    int rank = (int)(p * n + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    if (rank > n)
+        rank = n;
+    return sorted[rank - 1];
+}
+
+// Run argv once with stdout captured. Returns end-to-end wall seconds
+// (including process startup), or -1 if the run failed.
+double run_once(char *const argv[])
+{
+    int fd[2];
+    if (pipe(fd) == -1)
+    {
+        perror("pipe");
+        exit(1);
+    }
+
+    long long t0 = timer_ns();
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0)
+    {
+        dup2(fd[1], STDOUT_FILENO);
+        close(fd[0]);
+        close(fd[1]);
+        execv(argv[0], argv);
+        perror("execv");
+        exit(127);
+    }
+
+    // Drain the output so the child never blocks; the last line starting
+    // with '{' is its JSON summary
+    close(fd[1]);
+    char buf[4096];
+    int found_json = 0;
+    FILE *in = fdopen(fd[0], "r");
+    while (fgets(buf, sizeof(buf), in) != NULL)
+    {
+        if (buf[0] == '{' && strstr(buf, "\"pi\":") != NULL)
+            found_json = 1;
+    }
+    fclose(in);
+
+    int status;
+    waitpid(pid, &status, 0);
+    double wall = (timer_ns() - t0) * 1e-9;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !found_json)
+    {
+        fprintf(stderr, "bench: run of %s failed\n", argv[0]);
+        return -1;
+    }
+    return wall;
+}
+
+// Repeat one configuration; fills median and p95 wall time
+int measure(char *const argv[], int repeats, double *median, double *p95)
+{
+    double samples[MAX_REPEATS];
+    for (int r = 0; r < repeats; r++)
+    {
+        samples[r] = run_once(argv);
+        if (samples[r] < 0)
+            return -1;
+    }
+    qsort(samples, repeats, sizeof(double), cmp_double);
+    *median = percentile(samples, repeats, 0.5);
+    *p95 = percentile(samples, repeats, 0.95);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct num_list workers, chunks, sizes;
+    int repeats = 5;
+    int weak = 0;                           // Weak scaling: N is per worker
+    const char *modes = "process,threads";  // Parallel modes to sweep
+    const char *engine = "xoshiro";
+    const char *kernel = "auto";
+    const char *arith = "double";
+    const char *dispatch = "queue";
+    const char *seed = "1";
+
+    parse_list("1,2,4", &workers);
+    parse_list("100000", &chunks);
+    parse_list("10000000", &sizes);
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '-')
+            continue;
+        if (argv[i][1] == 'w')
+        {
+            weak = 1;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Missing arg for %s\n", argv[i]);
+            exit(1);
+        }
+        switch (argv[i][1])
+        {
+        case 'M':
+            parse_list(argv[++i], &workers);
+            break;
+        case 'C':
+            parse_list(argv[++i], &chunks);
+            break;
+        case 'N':
+            parse_list(argv[++i], &sizes);
+            break;
+        case 'r':
+            repeats = atoi(argv[++i]);
+            break;
+        case 'm':
+            modes = argv[++i];
+            break;
+        case 'R':
+            engine = argv[++i];
+            break;
+        case 'K':
+            kernel = argv[++i];
+            break;
+        case 'F':
+            arith = argv[++i];
+            break;
+        case 'D':
+            dispatch = argv[++i];
+            break;
+        case 'S':
+            seed = argv[++i];
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-M list] [-C list] [-N list] [-r repeats] [-w]\n"
+                            "       [-m process,threads] [-R engine] [-K kernel] [-F arith] [-D dispatch]\n"
+                            "       [-S seed]\n",
+                    argv[0]);
+            exit(1);
+        }
+    }
+    if (repeats < 1 || repeats > MAX_REPEATS)
+    {
+        fprintf(stderr, "-r must be between 1 and %d\n", MAX_REPEATS);
+        exit(1);
+    }
+
+    printf("mode,scaling,workers,N,C,repeats,median_s,p95_s,speedup,efficiency,karp_flatt\n");
+
+    for (int n = 0; n < sizes.count; n++)
+    {
+        for (int c = 0; c < chunks.count; c++)
+        {
+            char n_str[32], c_str[32], p_str[32];
+            double base_median, base_p95;
+
+            // Serial baseline: the whole N (strong) or one worker's share (weak)
+            snprintf(n_str, sizeof(n_str), "%lld", sizes.v[n]);
+            snprintf(c_str, sizeof(c_str), "%lld", chunks.v[c]);
+            char *serial_argv[] = {"./monte_serial", n_str, "-C", c_str, "-S", (char *)seed,
+                                   "-R", (char *)engine, "-K", (char *)kernel, "-F", (char *)arith, NULL};
+            if (measure(serial_argv, repeats, &base_median, &base_p95) != 0)
+                exit(1);
+            printf("serial,%s,1,%lld,%lld,%d,%.6f,%.6f,1.000,1.000,\n", weak ? "weak" : "strong",
+                   sizes.v[n], chunks.v[c], repeats, base_median, base_p95);
+            fflush(stdout);
+
+            for (int w = 0; w < workers.count; w++)
+            {
+                int p = (int)workers.v[w];
+                long long N = weak ? sizes.v[n] * p : sizes.v[n];
+                snprintf(n_str, sizeof(n_str), "%lld", N);
+                snprintf(p_str, sizeof(p_str), "%d", p);
+
+                for (int m = 0; m < 2; m++)
+                {
+                    const char *mode = m == 0 ? "process" : "threads";
+                    if (strstr(modes, mode) == NULL)
+                        continue;
+
+                    char *master_argv[] = {"./monte_master", m == 0 ? "-M" : "-T", p_str, "-N", n_str,
+                                           "-C", c_str, "-S", (char *)seed, "-R", (char *)engine,
+                                           "-K", (char *)kernel, "-F", (char *)arith, "-D", (char *)dispatch,
+                                           "--progress", "0", NULL};
+                    double median, p95;
+                    if (measure(master_argv, repeats, &median, &p95) != 0)
+                        exit(1);
+
+                    // Weak scaling compares against p times the serial work
+                    double speedup = (weak ? base_median * p : base_median) / median;
+                    double efficiency = speedup / p;
+                    printf("%s,%s,%d,%lld,%lld,%d,%.6f,%.6f,%.3f,%.3f,", mode, weak ? "weak" : "strong",
+                           p, N, chunks.v[c], repeats, median, p95, speedup, efficiency);
+                    // Karp-Flatt experimentally determined serial fraction
+                    // (defined for fixed-size, i.e. strong, scaling only)
+                    if (p > 1 && !weak)
+                        printf("%.4f\n", (1.0 / speedup - 1.0 / p) / (1.0 - 1.0 / p));
+                    else
+                        printf("\n");
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+* File: monte_ckpt.h
+* Purpose: Checkpoint file for long Monte Carlo Pi runs. Every chunk draws
+*          from the RNG stream keyed by (seed, task), so the position of the
+*          whole run is the set of finished tasks: the file holds the run
+*          parameters, the running totals and one bit per task. It is
+*          written to a temporary name and renamed, so a crash mid-write
+*          leaves the previous checkpoint intact.
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_CKPT_H
+#define MONTE_CKPT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "monte_sched.h"
+
+#define CKPT_MAGIC "MONTECK3" // 2: (sum, sumsq) totals and the integrand; 3: -F
+
+struct ckpt_header
+{
+    char magic[8];
+    int engine;   // Run parameters: a resume must use the same task list
+    int chunking; // and the same streams
+    int workers;  // Only matters for guided chunking
+    int integrand;
+    int dim;
+    int variance; // -V sampling mode
+    int arith;    // -F toss arithmetic
+    int pad;
+    long long N, C, seed;
+    long long num_tasks;
+    long long dispatched; // Tosses handed to workers (finished or in flight)
+    long long completed;  // Tosses of finished tasks
+    long long tasks_done;
+    double sum;           // Sums of the samples of finished tasks
+    double sumsq;
+};
+
+static inline size_t ckpt_bitmap_size(long long num_tasks)
+{
+    return (size_t)((num_tasks + 7) / 8);
+}
+
+// Fill the totals and the finished-task bitmap from the scheduling region.
+// Safe while workers run: a task counts only once its cell is marked done.
+static inline void ckpt_capture(struct ckpt_header *hdr, unsigned char *done, struct sched_shared *sh)
+{
+    long long *tosses = sched_tosses(sh);
+    struct sched_cell *cells = sched_cells(sh);
+
+    memcpy(hdr->magic, CKPT_MAGIC, sizeof(hdr->magic));
+    hdr->num_tasks = sh->num_tasks;
+    hdr->completed = sh->base_tosses;
+    hdr->sum = sh->base_sum;
+    hdr->sumsq = sh->base_sumsq;
+    hdr->dispatched = sh->base_tosses;
+    hdr->tasks_done = 0;
+    memset(done, 0, ckpt_bitmap_size(sh->num_tasks));
+    for (long long t = 0; t < sh->num_tasks; t++)
+    {
+        long long state = __atomic_load_n(&cells[t].state, __ATOMIC_ACQUIRE);
+        if (state == SCHED_TODO)
+            continue;
+        done[t >> 3] |= (unsigned char)(1 << (t & 7));
+        hdr->tasks_done++;
+        if (state == SCHED_DONE)
+        {
+            hdr->completed += tosses[t];
+            hdr->sum += cells[t].sum;
+            hdr->sumsq += cells[t].sumsq;
+        }
+    }
+    for (int w = 0; w < sh->workers; w++)
+        hdr->dispatched += __atomic_load_n(&sched_slot(sh, w)->claimed, __ATOMIC_RELAXED);
+}
+
+// Write header + bitmap to path.tmp, flush it to disk and rename over path
+static inline int ckpt_save(const char *path, const struct ckpt_header *hdr, const unsigned char *done)
+{
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL)
+        return -1;
+    size_t bytes = ckpt_bitmap_size(hdr->num_tasks);
+    int ok = fwrite(hdr, sizeof(*hdr), 1, f) == 1 && fwrite(done, 1, bytes, f) == bytes && fflush(f) == 0 &&
+             fsync(fileno(f)) == 0;
+    if (fclose(f) != 0)
+        ok = 0;
+    if (!ok || rename(tmp, path) != 0)
+    {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Read a checkpoint. Returns the malloc'd bitmap, or NULL with a message
+// on stderr if the file is missing, truncated or not a checkpoint.
+static inline unsigned char *ckpt_load(const char *path, struct ckpt_header *hdr)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    unsigned char *done = NULL;
+    if (fread(hdr, sizeof(*hdr), 1, f) == 1 && memcmp(hdr->magic, CKPT_MAGIC, sizeof(hdr->magic)) == 0 &&
+        hdr->num_tasks >= 0)
+    {
+        size_t bytes = ckpt_bitmap_size(hdr->num_tasks);
+        done = malloc(bytes ? bytes : 1);
+        if (done != NULL && fread(done, 1, bytes, f) != bytes)
+        {
+            free(done);
+            done = NULL;
+        }
+    }
+    fclose(f);
+    if (done == NULL)
+        fprintf(stderr, "%s: not a valid checkpoint\n", path);
+    return done;
+}
+
+#endif
@@ -0,0 +1,271 @@
+/*
+* File: monte_integrand.h
+* Purpose: Integrands for the Monte Carlo programs. A chunk of n samples
+*          of an integrand over the d-dimensional cube returns the sum and
+*          sum of squares of the samples, so the same scheduling, reduction
+*          and RNG streams serve any integral and every run reports a
+*          standard error. Pi keeps the SIMD hit-counting kernels; the
+*          other integrands draw coordinates from the chunk's rng_t stream.
+*          Dimensions 1-8 get their own copy of each integrand with the
+*          coordinate loops unrolled at compile time.
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_INTEGRAND_H
+#define MONTE_INTEGRAND_H
+
+#include <math.h>
+#include <string.h>
+#include "monte_kernel.h"
+#include "monte_stats.h"
+
+// Integrands (selected with -I, dimension with -d)
+enum integrand_kind
+{
+    INTEGRAND_PI = 0, // 4 * [x^2 + y^2 <= 1] on [-1, 1)^2
+    INTEGRAND_SPHERE, // Volume of the unit d-ball: 2^d * [|x|^2 <= 1] on [-1, 1)^d
+    INTEGRAND_GAUSS,  // Integral of exp(-|x|^2) over [-1, 1]^d
+    INTEGRAND_CALL,   // Discounted European call payoff under Black-Scholes
+    INTEGRAND_ASIAN,  // Discounted arithmetic-average Asian call, d fixing dates
+    INTEGRAND_COUNT
+};
+
+#define INTEGRAND_MAX_DIM 64
+
+static const char *integrand_names[INTEGRAND_COUNT] = {"pi", "sphere", "gauss", "call", "asian"};
+static const int integrand_default_dim[INTEGRAND_COUNT] = {2, 3, 3, 1, 12};
+
+// Contract of the option integrands: spot, strike, rate, volatility, years
+struct option_params
+{
+    double S0, K, r, sigma, T;
+};
+
+static const struct option_params integrand_option = {100.0, 100.0, 0.05, 0.2, 1.0};
+
+// Result of one chunk
+struct integrand_sum
+{
+    double sum;   // Sum of the samples
+    double sumsq; // Sum of their squares
+};
+
+static inline int integrand_parse(const char *name)
+{
+    for (int i = 0; i < INTEGRAND_COUNT; i++)
+    {
+        if (strcmp(name, integrand_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Dimensions an integrand accepts; pi and the European call are fixed
+static inline int integrand_check_dim(int kind, int dim)
+{
+    if (kind == INTEGRAND_PI)
+        return dim == 2;
+    if (kind == INTEGRAND_CALL)
+        return dim == 1;
+    return dim >= 1 && dim <= INTEGRAND_MAX_DIM;
+}
+
+// Closed-form value of the integral, NAN when there is none
+static inline double integrand_exact(int kind, int dim)
+{
+    const struct option_params *o = &integrand_option;
+    switch (kind)
+    {
+    case INTEGRAND_PI:
+        return M_PI;
+    case INTEGRAND_SPHERE:
+        return pow(M_PI, dim / 2.0) / tgamma(dim / 2.0 + 1.0);
+    case INTEGRAND_GAUSS:
+        return pow(sqrt(M_PI) * erf(1.0), dim);
+    case INTEGRAND_CALL:
+    {
+        double vol = o->sigma * sqrt(o->T);
+        double d1 = (log(o->S0 / o->K) + (o->r + 0.5 * o->sigma * o->sigma) * o->T) / vol;
+        return o->S0 * stats_norm_cdf(d1) - o->K * exp(-o->r * o->T) * stats_norm_cdf(d1 - vol);
+    }
+    default:
+        return NAN;
+    }
+}
+
+// Uniform in the open interval (0, 1), safe to feed the normal quantile
+static inline double integrand_u01_open(rng_t *r)
+{
+    return ((double)(rng_next(r) >> 11) + 0.5) * 0x1.0p-53;
+}
+
+// The chunk bodies below take dim as an argument but are always inlined
+// through INTEGRAND_BY_DIM, where it is a constant for d <= 8.
+
+static inline __attribute__((always_inline)) struct integrand_sum sphere_chunk(int dim, rng_t *r, long long n)
+{
+    long long hits = 0;
+    for (long long i = 0; i < n; i++)
+    {
+        double r2 = 0.0;
+#pragma GCC unroll 8
+        for (int k = 0; k < dim; k++)
+        {
+            double c = kernel_coord(rng_next(r));
+            r2 += c * c;
+        }
+        hits += r2 <= 1.0;
+    }
+    // Samples are 2^d or 0, so both sums are exact
+    double scale = ldexp(1.0, dim);
+    struct integrand_sum s = {hits * scale, hits * scale * scale};
+    return s;
+}
+
+static inline __attribute__((always_inline)) struct integrand_sum gauss_chunk(int dim, rng_t *r, long long n)
+{
+    double scale = ldexp(1.0, dim); // Volume of [-1, 1]^d
+    struct integrand_sum s = {0.0, 0.0};
+    for (long long i = 0; i < n; i++)
+    {
+        double r2 = 0.0;
+#pragma GCC unroll 8
+        for (int k = 0; k < dim; k++)
+        {
+            double c = kernel_coord(rng_next(r));
+            r2 += c * c;
+        }
+        double f = scale * exp(-r2);
+        s.sum += f;
+        s.sumsq += f * f;
+    }
+    return s;
+}
+
+// Geometric Brownian motion over dim equal steps; dim = 1 is the European
+// call (the average of one fixing is the terminal price)
+static inline __attribute__((always_inline)) struct integrand_sum asian_chunk(int dim, rng_t *r, long long n)
+{
+    const struct option_params *o = &integrand_option;
+    double dt = o->T / dim;
+    double drift = (o->r - 0.5 * o->sigma * o->sigma) * dt;
+    double vol = o->sigma * sqrt(dt);
+    double discount = exp(-o->r * o->T);
+    struct integrand_sum s = {0.0, 0.0};
+    for (long long i = 0; i < n; i++)
+    {
+        double log_s = log(o->S0), total = 0.0;
+#pragma GCC unroll 8
+        for (int k = 0; k < dim; k++)
+        {
+            log_s += drift + vol * stats_norm_quantile(integrand_u01_open(r));
+            total += exp(log_s);
+        }
+        double payoff = total / dim - o->K;
+        double f = payoff > 0 ? discount * payoff : 0.0;
+        s.sum += f;
+        s.sumsq += f * f;
+    }
+    return s;
+}
+
+// Value of the integrand at a point u of the open unit cube. The
+// variance-reduction drivers (monte_variance.h) place the points themselves.
+static inline __attribute__((always_inline)) double integrand_eval(int kind, int dim, const double *u)
+{
+    if (kind == INTEGRAND_CALL || kind == INTEGRAND_ASIAN)
+    {
+        const struct option_params *o = &integrand_option;
+        double dt = o->T / dim;
+        double drift = (o->r - 0.5 * o->sigma * o->sigma) * dt;
+        double vol = o->sigma * sqrt(dt);
+        double log_s = log(o->S0), total = 0.0;
+#pragma GCC unroll 8
+        for (int k = 0; k < dim; k++)
+        {
+            log_s += drift + vol * stats_norm_quantile(u[k]);
+            total += exp(log_s);
+        }
+        double payoff = total / dim - o->K;
+        return payoff > 0 ? exp(-o->r * o->T) * payoff : 0.0;
+    }
+
+    double r2 = 0.0;
+#pragma GCC unroll 8
+    for (int k = 0; k < dim; k++)
+    {
+        double c = 2.0 * u[k] - 1.0;
+        r2 += c * c;
+    }
+    if (kind == INTEGRAND_GAUSS)
+        return ldexp(1.0, dim) * exp(-r2);
+    return r2 <= 1.0 ? ldexp(1.0, dim) : 0.0; // Pi is the d = 2 sphere
+}
+
+// Pick the copy specialized for dim, or the generic loop above 8
+#define INTEGRAND_BY_DIM(chunk, dim, ...)                                                                      \
+    switch (dim)                                                                                               \
+    {                                                                                                          \
+    case 1:                                                                                                    \
+        return chunk(1, __VA_ARGS__);                                                                          \
+    case 2:                                                                                                    \
+        return chunk(2, __VA_ARGS__);                                                                          \
+    case 3:                                                                                                    \
+        return chunk(3, __VA_ARGS__);                                                                          \
+    case 4:                                                                                                    \
+        return chunk(4, __VA_ARGS__);                                                                          \
+    case 5:                                                                                                    \
+        return chunk(5, __VA_ARGS__);                                                                          \
+    case 6:                                                                                                    \
+        return chunk(6, __VA_ARGS__);                                                                          \
+    case 7:                                                                                                    \
+        return chunk(7, __VA_ARGS__);                                                                          \
+    case 8:                                                                                                    \
+        return chunk(8, __VA_ARGS__);                                                                          \
+    default:                                                                                                   \
+        return chunk(dim, __VA_ARGS__);                                                                        \
+    }
+
+static inline struct integrand_sum integrand_sphere(int dim, rng_t *r, long long n)
+{
+    INTEGRAND_BY_DIM(sphere_chunk, dim, r, n)
+}
+
+static inline struct integrand_sum integrand_gauss(int dim, rng_t *r, long long n)
+{
+    INTEGRAND_BY_DIM(gauss_chunk, dim, r, n)
+}
+
+static inline struct integrand_sum integrand_asian(int dim, rng_t *r, long long n)
+{
+    INTEGRAND_BY_DIM(asian_chunk, dim, r, n)
+}
+
+// One chunk: n samples of integrand `kind` from the stream (engine, seed, task).
+// `arith` only applies to Pi.
+static inline struct integrand_sum integrand_run(int kind, int dim, int engine, int kernel, int arith, uint64_t seed,
+                                                 uint64_t task, long long n)
+{
+    if (kind == INTEGRAND_PI)
+    {
+        // Samples are 4 or 0; the SIMD kernels count the 4s
+        long long hits = monte_toss(engine, kernel, arith, seed, task, n);
+        struct integrand_sum s = {4.0 * hits, 16.0 * hits};
+        return s;
+    }
+
+    rng_t r;
+    rng_seed(&r, engine, seed, task);
+    switch (kind)
+    {
+    case INTEGRAND_SPHERE:
+        return integrand_sphere(dim, &r, n);
+    case INTEGRAND_GAUSS:
+        return integrand_gauss(dim, &r, n);
+    default:
+        return integrand_asian(dim, &r, n); // INTEGRAND_CALL is the 1-date case
+    }
+}
+
+#endif
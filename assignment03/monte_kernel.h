@@ -0,0 +1,707 @@
+/*
+* File: monte_kernel.h
+* Purpose: Toss kernels for the Monte Carlo Pi programs. A scalar, an AVX2
+*          and an AVX-512 kernel generate several (x, y) pairs per iteration,
+*          test them with packed compares and count hits with popcount on
+*          the compare mask. The kernel is picked at runtime from CPUID.
+*          All kernels visit the same tosses for a given (engine, seed, task),
+*          so the hit count does not depend on the node a chunk runs on.
+*          The fixed-point kernels (-F fixed) test the same tosses in 64-bit
+*          integer arithmetic on 32-bit coordinates.
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_KERNEL_H
+#define MONTE_KERNEL_H
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+#include "monte_rng.h"
+
+// Kernel identifiers (selected with -K on the command line)
+enum kernel_kind
+{
+    KERNEL_SCALAR = 0,
+    KERNEL_AVX2 = 1,
+    KERNEL_AVX512 = 2
+};
+
+#define KERNEL_AUTO (-1)
+
+// Independent xoshiro256** lanes per chunk. Fixed for every kernel so the
+// toss sequence is the same whichever kernel runs it.
+#define KERNEL_LANES 16
+
+static const char *kernel_names[] = {"scalar", "avx2", "avx512"};
+
+// Arithmetic of the inside-circle test (selected with -F)
+enum toss_arith
+{
+    ARITH_DOUBLE = 0, // 52-bit coordinates in [-1, 1), x^2 + y^2 <= 1.0
+    ARITH_FIXED = 1   // 32-bit integer coordinates, x^2 + y^2 <= 2^62
+};
+
+static const char *arith_names[] = {"double", "fixed"};
+
+// Map a kernel name to its identifier, KERNEL_AUTO for "auto", -2 if unknown
+static inline int kernel_parse(const char *name)
+{
+    if (strcmp(name, "auto") == 0)
+        return KERNEL_AUTO;
+    for (int i = 0; i < (int)(sizeof(kernel_names) / sizeof(kernel_names[0])); i++)
+    {
+        if (strcmp(name, kernel_names[i]) == 0)
+            return i;
+    }
+    return -2;
+}
+
+static inline const char *kernel_name(int kind)
+{
+    return kind == KERNEL_AUTO ? "auto" : kernel_names[kind];
+}
+
+static inline int arith_parse(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(arith_names) / sizeof(arith_names[0])); i++)
+    {
+        if (strcmp(name, arith_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Best kernel this CPU supports
+static inline int kernel_detect(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return KERNEL_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return KERNEL_AVX2;
+    return KERNEL_SCALAR;
+}
+
+// Resolve a requested kernel, never returning one the CPU cannot run
+static inline int kernel_resolve(int requested)
+{
+    int best = kernel_detect();
+    if (requested == KERNEL_AUTO || requested > best)
+        return best;
+    return requested;
+}
+
+// Keep x*x + y*y as a rounded multiply then a rounded add in every kernel;
+// a fused multiply-add in only some of them would change the hit count
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+
+// Map 64 random bits to a coordinate in [-1, 1): the top 52 bits become the
+// mantissa of m in [1, 2), then x = 2m - 3 (both steps are exact)
+static inline double kernel_coord(uint64_t bits)
+{
+    union
+    {
+        uint64_t u;
+        double d;
+    } m;
+    m.u = (bits >> 12) | 0x3FF0000000000000ULL;
+    return m.d * 2.0 - 3.0;
+}
+
+/* ---------- xoshiro256**: KERNEL_LANES streams stored lane-major ---------- */
+
+typedef struct
+{
+    uint64_t s[4][KERNEL_LANES];
+} __attribute__((aligned(64))) xo_lanes_t;
+
+// Lane 0 is the scalar rng_seed() stream; later lanes continue the same
+// splitmix64 sequence
+static inline void xo_lanes_seed(xo_lanes_t *L, uint64_t seed, uint64_t task)
+{
+    uint64_t x = rng_xoshiro_mix(seed, task);
+    for (int j = 0; j < KERNEL_LANES; j++)
+        for (int w = 0; w < 4; w++)
+            L->s[w][j] = rng_splitmix64(&x);
+}
+
+static inline __attribute__((always_inline)) uint64_t xo_lane_next(xo_lanes_t *L, int j)
+{
+    uint64_t s0 = L->s[0][j], s1 = L->s[1][j], s2 = L->s[2][j], s3 = L->s[3][j];
+    uint64_t result = rng_rotl(s1 * 5, 7) * 9;
+    uint64_t t = s1 << 17;
+
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = rng_rotl(s3, 45);
+    L->s[0][j] = s0;
+    L->s[1][j] = s1;
+    L->s[2][j] = s2;
+    L->s[3][j] = s3;
+    return result;
+}
+
+// `blocks` full rounds over all lanes, then one toss on lanes [0, tail)
+static long long xo_toss_scalar(xo_lanes_t *L, long long blocks, int tail)
+{
+    long long hits = 0;
+    for (long long b = 0; b < blocks; b++)
+    {
+        for (int j = 0; j < KERNEL_LANES; j++)
+        {
+            double x = kernel_coord(xo_lane_next(L, j));
+            double y = kernel_coord(xo_lane_next(L, j));
+            hits += (x * x + y * y <= 1.0);
+        }
+    }
+    for (int j = 0; j < tail; j++)
+    {
+        double x = kernel_coord(xo_lane_next(L, j));
+        double y = kernel_coord(xo_lane_next(L, j));
+        hits += (x * x + y * y <= 1.0);
+    }
+    return hits;
+}
+
+// Shift counts must be immediates, so these helpers are macros
+#define XO256_ROTL(x, k) _mm256_or_si256(_mm256_slli_epi64((x), (k)), _mm256_srli_epi64((x), 64 - (k)))
+
+#define XO256_NEXT(s0, s1, s2, s3, out)                                           \
+    {                                                                             \
+        __m256i r5 = _mm256_add_epi64((s1), _mm256_slli_epi64((s1), 2));          \
+        __m256i r7 = XO256_ROTL(r5, 7);                                           \
+        (out) = _mm256_add_epi64(r7, _mm256_slli_epi64(r7, 3));                   \
+        __m256i t = _mm256_slli_epi64((s1), 17);                                  \
+        (s2) = _mm256_xor_si256((s2), (s0));                                      \
+        (s3) = _mm256_xor_si256((s3), (s1));                                      \
+        (s1) = _mm256_xor_si256((s1), (s2));                                      \
+        (s0) = _mm256_xor_si256((s0), (s3));                                      \
+        (s2) = _mm256_xor_si256((s2), t);                                         \
+        (s3) = XO256_ROTL((s3), 45);                                              \
+    }
+
+// Same bit trick as kernel_coord on four 64-bit lanes
+#define COORD256(bits) \
+    _mm256_sub_pd(_mm256_mul_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64((bits), 12), expo)), two), three)
+
+__attribute__((target("avx2"))) static long long xo_toss_avx2(xo_lanes_t *L, long long blocks)
+{
+    const __m256i expo = _mm256_set1_epi64x(0x3FF0000000000000LL);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d three = _mm256_set1_pd(3.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    long long hits = 0;
+
+    // Four groups of four lanes
+    for (int g = 0; g < KERNEL_LANES; g += 4)
+    {
+        __m256i s0 = _mm256_load_si256((const __m256i *)&L->s[0][g]);
+        __m256i s1 = _mm256_load_si256((const __m256i *)&L->s[1][g]);
+        __m256i s2 = _mm256_load_si256((const __m256i *)&L->s[2][g]);
+        __m256i s3 = _mm256_load_si256((const __m256i *)&L->s[3][g]);
+        for (long long b = 0; b < blocks; b++)
+        {
+            __m256i bx, by;
+            XO256_NEXT(s0, s1, s2, s3, bx);
+            XO256_NEXT(s0, s1, s2, s3, by);
+            __m256d x = COORD256(bx);
+            __m256d y = COORD256(by);
+            __m256d d = _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y));
+            hits += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(d, one, _CMP_LE_OQ)));
+        }
+        _mm256_store_si256((__m256i *)&L->s[0][g], s0);
+        _mm256_store_si256((__m256i *)&L->s[1][g], s1);
+        _mm256_store_si256((__m256i *)&L->s[2][g], s2);
+        _mm256_store_si256((__m256i *)&L->s[3][g], s3);
+    }
+    return hits;
+}
+
+#define XO512_NEXT(s0, s1, s2, s3, out)                                           \
+    {                                                                             \
+        __m512i r5 = _mm512_add_epi64((s1), _mm512_slli_epi64((s1), 2));          \
+        __m512i r7 = _mm512_rol_epi64(r5, 7);                                     \
+        (out) = _mm512_add_epi64(r7, _mm512_slli_epi64(r7, 3));                   \
+        __m512i t = _mm512_slli_epi64((s1), 17);                                  \
+        (s2) = _mm512_xor_si512((s2), (s0));                                      \
+        (s3) = _mm512_xor_si512((s3), (s1));                                      \
+        (s1) = _mm512_xor_si512((s1), (s2));                                      \
+        (s0) = _mm512_xor_si512((s0), (s3));                                      \
+        (s2) = _mm512_xor_si512((s2), t);                                         \
+        (s3) = _mm512_rol_epi64((s3), 45);                                        \
+    }
+
+#define COORD512(bits) \
+    _mm512_sub_pd(_mm512_mul_pd(_mm512_castsi512_pd(_mm512_or_si512(_mm512_srli_epi64((bits), 12), expo)), two), three)
+
+__attribute__((target("avx512f"))) static long long xo_toss_avx512(xo_lanes_t *L, long long blocks)
+{
+    const __m512i expo = _mm512_set1_epi64(0x3FF0000000000000LL);
+    const __m512d two = _mm512_set1_pd(2.0);
+    const __m512d three = _mm512_set1_pd(3.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    long long hits = 0;
+
+    // Two groups of eight lanes
+    for (int g = 0; g < KERNEL_LANES; g += 8)
+    {
+        __m512i s0 = _mm512_load_si512(&L->s[0][g]);
+        __m512i s1 = _mm512_load_si512(&L->s[1][g]);
+        __m512i s2 = _mm512_load_si512(&L->s[2][g]);
+        __m512i s3 = _mm512_load_si512(&L->s[3][g]);
+        for (long long b = 0; b < blocks; b++)
+        {
+            __m512i bx, by;
+            XO512_NEXT(s0, s1, s2, s3, bx);
+            XO512_NEXT(s0, s1, s2, s3, by);
+            __m512d x = COORD512(bx);
+            __m512d y = COORD512(by);
+            __m512d d = _mm512_add_pd(_mm512_mul_pd(x, x), _mm512_mul_pd(y, y));
+            hits += __builtin_popcount(_mm512_cmp_pd_mask(d, one, _CMP_LE_OQ));
+        }
+        _mm512_store_si512(&L->s[0][g], s0);
+        _mm512_store_si512(&L->s[1][g], s1);
+        _mm512_store_si512(&L->s[2][g], s2);
+        _mm512_store_si512(&L->s[3][g], s3);
+    }
+    return hits;
+}
+
+/* ---------- Philox4x32-10: toss i is counter block i of the task ---------- */
+
+// Tosses [first, first + n) of the task's Philox stream, one block at a time
+static long long ph_toss_scalar(rng_t *r, uint64_t first, long long n)
+{
+    long long hits = 0;
+    r->u.ph.ctr[0] = (uint32_t)first;
+    r->u.ph.ctr[1] = (uint32_t)(first >> 32);
+    r->u.ph.idx = 2;
+    for (long long i = 0; i < n; i++)
+    {
+        double x = kernel_coord(rng_philox_next(r));
+        double y = kernel_coord(rng_philox_next(r));
+        hits += (x * x + y * y <= 1.0);
+    }
+    return hits;
+}
+
+// 32x32->64 multiply of all eight 32-bit lanes, split into hi and lo words
+#define PH256_MUL(c, m, hi, lo)                                                   \
+    {                                                                             \
+        __m256i pe = _mm256_mul_epu32((c), (m));                                  \
+        __m256i po = _mm256_mul_epu32(_mm256_srli_epi64((c), 32), (m));           \
+        (lo) = _mm256_blend_epi32(pe, _mm256_slli_epi64(po, 32), 0xAA);           \
+        (hi) = _mm256_blend_epi32(_mm256_srli_epi64(pe, 32), po, 0xAA);           \
+    }
+
+// Philox blocks i .. i + 7 of the task, word k of block i + j in lane j of xk.
+// Needs m0, m1, lane, c2 and c3 from the enclosing kernel.
+#define PH256_BLOCKS(r, i, x0, x1, x2, x3)                                        \
+    {                                                                             \
+        (x0) = _mm256_add_epi32(_mm256_set1_epi32((int)(uint32_t)(i)), lane);     \
+        (x1) = _mm256_set1_epi32((int)(uint32_t)((uint64_t)(i) >> 32));           \
+        (x2) = c2;                                                                \
+        (x3) = c3;                                                                \
+        uint32_t k0 = (r)->u.ph.key[0], k1 = (r)->u.ph.key[1];                    \
+        for (int round = 0; round < 10; round++)                                  \
+        {                                                                         \
+            __m256i hi0, lo0, hi1, lo1;                                           \
+            PH256_MUL((x0), m0, hi0, lo0);                                        \
+            PH256_MUL((x2), m1, hi1, lo1);                                        \
+            (x0) = _mm256_xor_si256(_mm256_xor_si256(hi1, (x1)), _mm256_set1_epi32((int)k0)); \
+            (x1) = lo1;                                                           \
+            (x2) = _mm256_xor_si256(_mm256_xor_si256(hi0, (x3)), _mm256_set1_epi32((int)k1)); \
+            (x3) = lo0;                                                           \
+            k0 += 0x9E3779B9u;                                                    \
+            k1 += 0xBB67AE85u;                                                    \
+        }                                                                         \
+    }
+
+// Eight Philox blocks (= eight tosses) per iteration
+__attribute__((target("avx2"))) static long long ph_toss_avx2(rng_t *r, long long n)
+{
+    const __m256i m0 = _mm256_set1_epi32((int)0xD2511F53u);
+    const __m256i m1 = _mm256_set1_epi32((int)0xCD9E8D57u);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i expo = _mm256_set1_epi64x(0x3FF0000000000000LL);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d three = _mm256_set1_pd(3.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256i c2 = _mm256_set1_epi32((int)r->u.ph.ctr[2]);
+    const __m256i c3 = _mm256_set1_epi32((int)r->u.ph.ctr[3]);
+    long long hits = 0;
+    long long i = 0;
+
+    // The low counter word must not wrap inside a group of eight
+    while (i + 8 <= n && (uint32_t)i <= 0xFFFFFFFFu - 7)
+    {
+        __m256i x0, x1, x2, x3;
+        PH256_BLOCKS(r, i, x0, x1, x2, x3);
+        // Pair (out0:out1) and (out2:out3) into 64-bit words; the lane order
+        // is permuted but x and y stay matched, and hit counts ignore order
+        __m256i bx_lo = _mm256_unpacklo_epi32(x1, x0), bx_hi = _mm256_unpackhi_epi32(x1, x0);
+        __m256i by_lo = _mm256_unpacklo_epi32(x3, x2), by_hi = _mm256_unpackhi_epi32(x3, x2);
+        __m256d xa = COORD256(bx_lo), ya = COORD256(by_lo);
+        __m256d xb = COORD256(bx_hi), yb = COORD256(by_hi);
+        __m256d da = _mm256_add_pd(_mm256_mul_pd(xa, xa), _mm256_mul_pd(ya, ya));
+        __m256d db = _mm256_add_pd(_mm256_mul_pd(xb, xb), _mm256_mul_pd(yb, yb));
+        hits += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(da, one, _CMP_LE_OQ)));
+        hits += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(db, one, _CMP_LE_OQ)));
+        i += 8;
+    }
+    return hits + ph_toss_scalar(r, (uint64_t)i, n - i);
+}
+
+#define PH512_MUL(c, m, hi, lo)                                                   \
+    {                                                                             \
+        __m512i pe = _mm512_mul_epu32((c), (m));                                  \
+        __m512i po = _mm512_mul_epu32(_mm512_srli_epi64((c), 32), (m));           \
+        (lo) = _mm512_mask_blend_epi32(0xAAAA, pe, _mm512_slli_epi64(po, 32));    \
+        (hi) = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(pe, 32), po);    \
+    }
+
+#define PH512_BLOCKS(r, i, x0, x1, x2, x3)                                        \
+    {                                                                             \
+        (x0) = _mm512_add_epi32(_mm512_set1_epi32((int)(uint32_t)(i)), lane);     \
+        (x1) = _mm512_set1_epi32((int)(uint32_t)((uint64_t)(i) >> 32));           \
+        (x2) = c2;                                                                \
+        (x3) = c3;                                                                \
+        uint32_t k0 = (r)->u.ph.key[0], k1 = (r)->u.ph.key[1];                    \
+        for (int round = 0; round < 10; round++)                                  \
+        {                                                                         \
+            __m512i hi0, lo0, hi1, lo1;                                           \
+            PH512_MUL((x0), m0, hi0, lo0);                                        \
+            PH512_MUL((x2), m1, hi1, lo1);                                        \
+            (x0) = _mm512_xor_si512(_mm512_xor_si512(hi1, (x1)), _mm512_set1_epi32((int)k0)); \
+            (x1) = lo1;                                                           \
+            (x2) = _mm512_xor_si512(_mm512_xor_si512(hi0, (x3)), _mm512_set1_epi32((int)k1)); \
+            (x3) = lo0;                                                           \
+            k0 += 0x9E3779B9u;                                                    \
+            k1 += 0xBB67AE85u;                                                    \
+        }                                                                         \
+    }
+
+// Sixteen Philox blocks (= sixteen tosses) per iteration
+__attribute__((target("avx512f"))) static long long ph_toss_avx512(rng_t *r, long long n)
+{
+    const __m512i m0 = _mm512_set1_epi32((int)0xD2511F53u);
+    const __m512i m1 = _mm512_set1_epi32((int)0xCD9E8D57u);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i expo = _mm512_set1_epi64(0x3FF0000000000000LL);
+    const __m512d two = _mm512_set1_pd(2.0);
+    const __m512d three = _mm512_set1_pd(3.0);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512i c2 = _mm512_set1_epi32((int)r->u.ph.ctr[2]);
+    const __m512i c3 = _mm512_set1_epi32((int)r->u.ph.ctr[3]);
+    long long hits = 0;
+    long long i = 0;
+
+    while (i + 16 <= n && (uint32_t)i <= 0xFFFFFFFFu - 15)
+    {
+        __m512i x0, x1, x2, x3;
+        PH512_BLOCKS(r, i, x0, x1, x2, x3);
+        __m512i bx_lo = _mm512_unpacklo_epi32(x1, x0), bx_hi = _mm512_unpackhi_epi32(x1, x0);
+        __m512i by_lo = _mm512_unpacklo_epi32(x3, x2), by_hi = _mm512_unpackhi_epi32(x3, x2);
+        __m512d xa = COORD512(bx_lo), ya = COORD512(by_lo);
+        __m512d xb = COORD512(bx_hi), yb = COORD512(by_hi);
+        __m512d da = _mm512_add_pd(_mm512_mul_pd(xa, xa), _mm512_mul_pd(ya, ya));
+        __m512d db = _mm512_add_pd(_mm512_mul_pd(xb, xb), _mm512_mul_pd(yb, yb));
+        hits += __builtin_popcount(_mm512_cmp_pd_mask(da, one, _CMP_LE_OQ));
+        hits += __builtin_popcount(_mm512_cmp_pd_mask(db, one, _CMP_LE_OQ));
+        i += 16;
+    }
+    return hits + ph_toss_scalar(r, (uint64_t)i, n - i);
+}
+
+/* ---------- PCG64: 128-bit LCG, scalar only ---------- */
+
+static long long pcg_toss_scalar(rng_t *r, long long n)
+{
+    long long hits = 0;
+    for (long long i = 0; i < n; i++)
+    {
+        double x = kernel_coord(rng_pcg64_next(r));
+        double y = kernel_coord(rng_pcg64_next(r));
+        hits += (x * x + y * y <= 1.0);
+    }
+    return hits;
+}
+
+#pragma GCC pop_options
+
+/* ---------- Fixed-point tosses (-F fixed) ---------- */
+
+// The top 32 bits of a draw, minus 2^31, are a coordinate in units of
+// 2^-31: the double path's coordinate truncated to 32 bits. The point is a
+// hit when x^2 + y^2 <= 2^62, which is exact in 64-bit integers, so the
+// count differs from the double path only for tosses within 2^-31 of the
+// circle. No conversion, division or rounding is involved.
+// |x| and |y| fit in 32 unsigned bits, so each square is one 32x32->64
+// unsigned multiply.
+static inline int kernel_hit_fixed(uint64_t bx, uint64_t by)
+{
+    uint32_t x = (uint32_t)(bx >> 32), y = (uint32_t)(by >> 32);
+    uint32_t ax = x >= 0x80000000u ? x - 0x80000000u : 0x80000000u - x;
+    uint32_t ay = y >= 0x80000000u ? y - 0x80000000u : 0x80000000u - y;
+    return (uint64_t)ax * ax + (uint64_t)ay * ay <= (1ULL << 62);
+}
+
+static long long xo_toss_fixed_scalar(xo_lanes_t *L, long long blocks, int tail)
+{
+    long long hits = 0;
+    for (long long b = 0; b < blocks; b++)
+    {
+        for (int j = 0; j < KERNEL_LANES; j++)
+        {
+            uint64_t bx = xo_lane_next(L, j);
+            hits += kernel_hit_fixed(bx, xo_lane_next(L, j));
+        }
+    }
+    for (int j = 0; j < tail; j++)
+    {
+        uint64_t bx = xo_lane_next(L, j);
+        hits += kernel_hit_fixed(bx, xo_lane_next(L, j));
+    }
+    return hits;
+}
+
+static long long ph_toss_fixed_scalar(rng_t *r, uint64_t first, long long n)
+{
+    long long hits = 0;
+    r->u.ph.ctr[0] = (uint32_t)first;
+    r->u.ph.ctr[1] = (uint32_t)(first >> 32);
+    r->u.ph.idx = 2;
+    for (long long i = 0; i < n; i++)
+    {
+        uint64_t bx = rng_philox_next(r);
+        hits += kernel_hit_fixed(bx, rng_philox_next(r));
+    }
+    return hits;
+}
+
+static long long pcg_toss_fixed_scalar(rng_t *r, long long n)
+{
+    long long hits = 0;
+    for (long long i = 0; i < n; i++)
+    {
+        uint64_t bx = rng_pcg64_next(r);
+        hits += kernel_hit_fixed(bx, rng_pcg64_next(r));
+    }
+    return hits;
+}
+
+// x^2 + y^2 - (2^62 + 1) per 64-bit lane, from signed 32-bit coordinates in
+// the low half of each lane; negative exactly when the toss is a hit.
+// vpmuldq squares the low halves into full 64-bit lanes. Needs `limit`.
+#define FIXED256_DIST(fx, fy) \
+    _mm256_add_epi64(_mm256_mul_epi32((fx), (fx)), _mm256_sub_epi64(_mm256_mul_epi32((fy), (fy)), limit))
+
+// Hits among four lanes: the sign bits of FIXED256_DIST
+#define FIXED256_HITS(d) __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(d)))
+
+__attribute__((target("avx2"))) static long long xo_toss_fixed_avx2(xo_lanes_t *L, long long blocks)
+{
+    const __m256i flip = _mm256_set1_epi64x(0x80000000LL);
+    const __m256i limit = _mm256_set1_epi64x((1LL << 62) + 1);
+    long long hits = 0;
+
+    for (int g = 0; g < KERNEL_LANES; g += 4)
+    {
+        __m256i s0 = _mm256_load_si256((const __m256i *)&L->s[0][g]);
+        __m256i s1 = _mm256_load_si256((const __m256i *)&L->s[1][g]);
+        __m256i s2 = _mm256_load_si256((const __m256i *)&L->s[2][g]);
+        __m256i s3 = _mm256_load_si256((const __m256i *)&L->s[3][g]);
+        for (long long b = 0; b < blocks; b++)
+        {
+            __m256i bx, by;
+            XO256_NEXT(s0, s1, s2, s3, bx);
+            XO256_NEXT(s0, s1, s2, s3, by);
+            __m256i fx = _mm256_xor_si256(_mm256_srli_epi64(bx, 32), flip);
+            __m256i fy = _mm256_xor_si256(_mm256_srli_epi64(by, 32), flip);
+            hits += FIXED256_HITS(FIXED256_DIST(fx, fy));
+        }
+        _mm256_store_si256((__m256i *)&L->s[0][g], s0);
+        _mm256_store_si256((__m256i *)&L->s[1][g], s1);
+        _mm256_store_si256((__m256i *)&L->s[2][g], s2);
+        _mm256_store_si256((__m256i *)&L->s[3][g], s3);
+    }
+    return hits;
+}
+
+// Philox already yields 32-bit words: word 0 of a block is the top half of
+// the x draw and word 2 the top half of y, eight blocks per vector
+__attribute__((target("avx2"))) static long long ph_toss_fixed_avx2(rng_t *r, long long n)
+{
+    const __m256i m0 = _mm256_set1_epi32((int)0xD2511F53u);
+    const __m256i m1 = _mm256_set1_epi32((int)0xCD9E8D57u);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i flip = _mm256_set1_epi32((int)0x80000000u);
+    const __m256i limit = _mm256_set1_epi64x((1LL << 62) + 1);
+    const __m256i c2 = _mm256_set1_epi32((int)r->u.ph.ctr[2]);
+    const __m256i c3 = _mm256_set1_epi32((int)r->u.ph.ctr[3]);
+    long long hits = 0;
+    long long i = 0;
+
+    while (i + 8 <= n && (uint32_t)i <= 0xFFFFFFFFu - 7)
+    {
+        __m256i x0, x1, x2, x3;
+        PH256_BLOCKS(r, i, x0, x1, x2, x3);
+        __m256i fx = _mm256_xor_si256(x0, flip), fy = _mm256_xor_si256(x2, flip);
+        hits += FIXED256_HITS(FIXED256_DIST(fx, fy)); // Even blocks
+        fx = _mm256_srli_epi64(fx, 32);
+        fy = _mm256_srli_epi64(fy, 32);
+        hits += FIXED256_HITS(FIXED256_DIST(fx, fy)); // Odd blocks
+        i += 8;
+    }
+    return hits + ph_toss_fixed_scalar(r, (uint64_t)i, n - i);
+}
+
+#define FIXED512_DIST(fx, fy) \
+    _mm512_add_epi64(_mm512_mul_epi32((fx), (fx)), _mm512_sub_epi64(_mm512_mul_epi32((fy), (fy)), limit))
+
+#define FIXED512_HITS(d) __builtin_popcount(_mm512_cmplt_epi64_mask((d), _mm512_setzero_si512()))
+
+__attribute__((target("avx512f"))) static long long xo_toss_fixed_avx512(xo_lanes_t *L, long long blocks)
+{
+    const __m512i flip = _mm512_set1_epi64(0x80000000LL);
+    const __m512i limit = _mm512_set1_epi64((1LL << 62) + 1);
+    long long hits = 0;
+
+    for (int g = 0; g < KERNEL_LANES; g += 8)
+    {
+        __m512i s0 = _mm512_load_si512(&L->s[0][g]);
+        __m512i s1 = _mm512_load_si512(&L->s[1][g]);
+        __m512i s2 = _mm512_load_si512(&L->s[2][g]);
+        __m512i s3 = _mm512_load_si512(&L->s[3][g]);
+        for (long long b = 0; b < blocks; b++)
+        {
+            __m512i bx, by;
+            XO512_NEXT(s0, s1, s2, s3, bx);
+            XO512_NEXT(s0, s1, s2, s3, by);
+            __m512i fx = _mm512_xor_si512(_mm512_srli_epi64(bx, 32), flip);
+            __m512i fy = _mm512_xor_si512(_mm512_srli_epi64(by, 32), flip);
+            hits += FIXED512_HITS(FIXED512_DIST(fx, fy));
+        }
+        _mm512_store_si512(&L->s[0][g], s0);
+        _mm512_store_si512(&L->s[1][g], s1);
+        _mm512_store_si512(&L->s[2][g], s2);
+        _mm512_store_si512(&L->s[3][g], s3);
+    }
+    return hits;
+}
+
+__attribute__((target("avx512f"))) static long long ph_toss_fixed_avx512(rng_t *r, long long n)
+{
+    const __m512i m0 = _mm512_set1_epi32((int)0xD2511F53u);
+    const __m512i m1 = _mm512_set1_epi32((int)0xCD9E8D57u);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i flip = _mm512_set1_epi32((int)0x80000000u);
+    const __m512i limit = _mm512_set1_epi64((1LL << 62) + 1);
+    const __m512i c2 = _mm512_set1_epi32((int)r->u.ph.ctr[2]);
+    const __m512i c3 = _mm512_set1_epi32((int)r->u.ph.ctr[3]);
+    long long hits = 0;
+    long long i = 0;
+
+    while (i + 16 <= n && (uint32_t)i <= 0xFFFFFFFFu - 15)
+    {
+        __m512i x0, x1, x2, x3;
+        PH512_BLOCKS(r, i, x0, x1, x2, x3);
+        __m512i fx = _mm512_xor_si512(x0, flip), fy = _mm512_xor_si512(x2, flip);
+        hits += FIXED512_HITS(FIXED512_DIST(fx, fy));
+        fx = _mm512_srli_epi64(fx, 32);
+        fy = _mm512_srli_epi64(fy, 32);
+        hits += FIXED512_HITS(FIXED512_DIST(fx, fy));
+        i += 16;
+    }
+    return hits + ph_toss_fixed_scalar(r, (uint64_t)i, n - i);
+}
+
+// -F fixed counterpart of monte_toss below
+static inline long long monte_toss_fixed(int engine, int kernel, uint64_t seed, uint64_t task, long long n)
+{
+    switch (engine)
+    {
+    case RNG_PHILOX:
+    {
+        rng_t r;
+        rng_seed(&r, RNG_PHILOX, seed, task);
+        if (kernel == KERNEL_AVX512)
+            return ph_toss_fixed_avx512(&r, n);
+        if (kernel == KERNEL_AVX2)
+            return ph_toss_fixed_avx2(&r, n);
+        return ph_toss_fixed_scalar(&r, 0, n);
+    }
+    case RNG_PCG64:
+    {
+        rng_t r;
+        rng_seed(&r, RNG_PCG64, seed, task);
+        return pcg_toss_fixed_scalar(&r, n);
+    }
+    default:
+    {
+        xo_lanes_t L;
+        long long blocks = n / KERNEL_LANES;
+        int tail = (int)(n % KERNEL_LANES);
+        long long hits = 0;
+        xo_lanes_seed(&L, seed, task);
+        if (kernel == KERNEL_AVX512)
+            hits = xo_toss_fixed_avx512(&L, blocks);
+        else if (kernel == KERNEL_AVX2)
+            hits = xo_toss_fixed_avx2(&L, blocks);
+        else
+            return xo_toss_fixed_scalar(&L, blocks, tail);
+        return hits + xo_toss_fixed_scalar(&L, 0, tail);
+    }
+    }
+}
+
+// Toss n darts for task `task` and count how many land in the unit circle.
+// `kernel` must already be resolved with kernel_resolve().
+static inline long long monte_toss(int engine, int kernel, int arith, uint64_t seed, uint64_t task, long long n)
+{
+    if (arith == ARITH_FIXED)
+        return monte_toss_fixed(engine, kernel, seed, task, n);
+    switch (engine)
+    {
+    case RNG_PHILOX:
+    {
+        rng_t r;
+        rng_seed(&r, RNG_PHILOX, seed, task);
+        if (kernel == KERNEL_AVX512)
+            return ph_toss_avx512(&r, n);
+        if (kernel == KERNEL_AVX2)
+            return ph_toss_avx2(&r, n);
+        return ph_toss_scalar(&r, 0, n);
+    }
+    case RNG_PCG64:
+    {
+        // A 128-bit multiply per draw has no packed equivalent
+        rng_t r;
+        rng_seed(&r, RNG_PCG64, seed, task);
+        return pcg_toss_scalar(&r, n);
+    }
+    default:
+    {
+        xo_lanes_t L;
+        long long blocks = n / KERNEL_LANES;
+        int tail = (int)(n % KERNEL_LANES);
+        long long hits = 0;
+        xo_lanes_seed(&L, seed, task);
+        if (kernel == KERNEL_AVX512)
+            hits = xo_toss_avx512(&L, blocks);
+        else if (kernel == KERNEL_AVX2)
+            hits = xo_toss_avx2(&L, blocks);
+        else
+            return xo_toss_scalar(&L, blocks, tail);
+        return hits + xo_toss_scalar(&L, 0, tail);
+    }
+    }
+}
+
+#endif
@@ -2,42 +2,131 @@
 * File: monte_master.c
 * Purpose: Master process for Monte Carlo Pi estimation using System V IPC
 *          Spawns worker processes, distributes tasks, and aggregates results.
+*          With -T the same chunked workload runs on a pthread pool instead.
+*          -D steal replaces the single queue with per-worker deques and
+*          randomized stealing; -A guided shrinks chunks toward the end.
+*          Each run ends with a CLOCK_MONOTONIC per-phase report, a
+*          per-worker table and one machine-readable JSON line.
+*          -E epsilon [-P confidence] stops handing out work once the
+*          confidence interval on Pi is narrower than +/- epsilon.
+*          --checkpoint FILE saves the finished tasks every
+*          --checkpoint-every seconds and on SIGINT; --resume continues
+*          from that file. --progress SECONDS prints throughput and ETA.
+*          -I integrand [-d dim] estimates another integral (sphere, gauss,
+*          call, asian) on the same machinery; the default is Pi.
+*          -V antithetic|stratified|sobol|halton samples with variance
+*          reduction instead of i.i.d. points.
+*          -F fixed tests Pi tosses in 64-bit integer arithmetic.
+*          --pin=compact|scatter|physical-only|CPU list binds worker i to
+*          one CPU; each worker's result slot then gets its own page,
+*          first touched by the worker so it lives on the worker's node.
+* Build: gcc -O2 -pthread monte_master.c -o monte_master -lm
 * Author: Sean Balbale
 * Date: 2/13/2026
 */
 
 
+#define _GNU_SOURCE // ppoll, CPU affinity
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include <sys/shm.h>
-#include <sys/sem.h>
 #include <signal.h>
 #include <time.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "monte_variance.h"
+#include "monte_sched.h"
+#include "monte_timer.h"
+#include "monte_stats.h"
+#include "monte_ckpt.h"
+#include "monte_affinity.h"
 
 #define SHM_KEY_PATH "monte_master.c"
 #define SHM_KEY_ID 65
-#define SEM_KEY_ID 66
 #define MSG_KEY_ID 67
+#define CKPT_DEFAULT_PATH "monte_master.ckpt"
 
 // Message structure for message queue
 struct msg_buf
 {
     long mtype;       // Message type (must be > 0)
     long long tosses; // Payload: number of tosses for this task
+    long long task;   // Task index, selects the RNG stream for this chunk
+};
+
+// Run parameters, echoed in the report
+struct run_info
+{
+    const char *mode; // "process" or "threads"
+    int workers;      // M or T
+    long long N, C;
+    int S, R, K, D, A;
+    int I, dim;        // Integrand and its dimension
+    int V;             // Sampling mode (monte_variance.h)
+    int F;             // Toss arithmetic (monte_kernel.h)
+    double epsilon;    // Target CI half-width, 0 = always run all N tosses
+    double confidence; // Confidence level of the interval (-P)
+    const char *ckpt_path; // Checkpoint file, NULL = no checkpoints
+    double ckpt_every;     // Seconds between checkpoints
+    double progress_every; // Seconds between progress lines, 0 = none
+    int resume;            // Continue from ckpt_path
+    int pin;               // CPU placement (monte_affinity.h)
+    const char *pin_list;  // CPUs of --pin=LIST
+    int *cpu_map;          // CPU of each worker, NULL when not pinned
+};
+
+// Progress line, checkpoints and -E checks while the workers run
+struct monitor
+{
+    const struct run_info *run;
+    struct sched_shared *sh;
+    double z;                 // Normal quantile for -P
+    long long start_ns;       // Start of the compute, for throughput and ETA
+    long long start_tosses;   // Tosses already done then (resumed runs)
+    long long next_progress_ns;
+    long long next_ckpt_ns;
+    int progress_shown;
+    unsigned char *done; // Bitmap buffer for checkpoints
+};
+
+struct thread_pool;
+
+// Per-thread arguments; results go to the thread's slot in the scheduling region
+struct thread_slot
+{
+    struct thread_pool *pool;
+    int index;
+};
+
+// Workload shared by all threads in -T mode
+struct thread_pool
+{
+    struct sched_shared *sched; // Task list, deques and per-thread stats
+    long long next_task;        // Ticket counter for -D queue (atomic fetch-add)
+    int finished;               // Threads that have exited their loop (atomic)
+    int threads;
+    pthread_t main_thread;      // Woken with SIGCHLD when the last thread exits
+    int paused;                 // Copy of the SIGUSR1/SIGUSR2 state, under lock
+    pthread_mutex_t lock;
+    pthread_cond_t resume;
+    int S, R, K, I, dim, V, F;
 };
 
 // Global variables for signal handling and cleanup
 int m_pid_arr[100]; // Array to keep track of worker PIDs
 int num_workers_spawned = 0;
-int shmid = -1, semid = -1, msgid = -1; // IPC Identifiers
+int shmid = -1, msgid = -1;             // IPC Identifiers
 volatile sig_atomic_t paused = 0;       // Flag to pause operations
 volatile sig_atomic_t terminate = 0;    // Flag to terminate operations
+sigset_t watch_set;                     // Signals the master waits for
 
 // Cleanup function to remove IPC resources and terminate workers
 void cleanup()
@@ -55,22 +144,327 @@ void cleanup()
     // Mark Shared Memory for destruction
     if (shmid != -1)
         shmctl(shmid, IPC_RMID, NULL);
-    // Remove Semaphore set
-    if (semid != -1)
-        semctl(semid, 0, IPC_RMID);
     // Remove Message Queue
     if (msgid != -1)
         msgctl(msgid, IPC_RMID, NULL);
 }
 
+// Per-worker balance and compute report
+void print_sched_stats(struct sched_shared *sh)
+{
+    printf("Worker  Chunks  Steals  Compute(s)  Chunk min/avg/max (ms)    Mtosses/s\n");
+    for (int i = 0; i < sh->workers; i++)
+    {
+        struct sched_stats *st = sched_slot(sh, i);
+        double compute = st->compute_ns * 1e-9;
+        double avg_ms = st->chunks ? st->compute_ns * 1e-6 / st->chunks : 0.0;
+        printf("%6d  %6lld  %6lld  %10.6f  %7.3f/%7.3f/%7.3f  %11.2f\n", i, st->chunks, st->steals,
+               compute, st->chunk_min_ns * 1e-6, avg_ms, st->chunk_max_ns * 1e-6,
+               compute > 0 ? st->tosses / compute * 1e-6 : 0.0);
+    }
+}
+
+// Map workers to CPUs for --pin and show the map under the run header
+void plan_cpus(struct run_info *run)
+{
+    if (run->pin == PIN_NONE)
+        return;
+    run->cpu_map = malloc(run->workers * sizeof(int));
+    if (run->cpu_map == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    if (pin_plan(run->pin, run->pin_list, run->workers, run->cpu_map) != 0)
+        exit(1);
+    pin_print(stdout, run->pin, run->pin_list, run->cpu_map, run->workers);
+}
+
+// With local slots, give the workers up to two seconds to touch theirs
+// before the master reads any of them; a read fault on a shared page
+// would place it on the master's node instead.
+void wait_for_slots(struct sched_shared *sh, int workers)
+{
+    long long deadline = timer_ns() + 2000000000LL;
+    struct timespec ts = {0, 1000000};
+    if (sh->slot_bytes < SCHED_PAGE)
+        return;
+    while (__atomic_load_n(&sh->slots_ready, __ATOMIC_ACQUIRE) < workers && !terminate)
+    {
+        if (timer_ns() >= deadline)
+        {
+            fprintf(stderr, "--pin: %d of %d workers placed their result slots\n",
+                    __atomic_load_n(&sh->slots_ready, __ATOMIC_ACQUIRE), workers);
+            return;
+        }
+        nanosleep(&ts, NULL);
+    }
+}
+
+// Independent samples behind the error estimate: every toss, or every
+// chunk when the points of a chunk are correlated (-V stratified/sobol/halton)
+long long run_batches(const struct run_info *run, long long done, long long chunks)
+{
+    return variance_batched(run->V) ? chunks : done;
+}
+
+// Early termination check: stop the workers once enough tosses are in and
+// the CI half-width is below epsilon. Returns 1 if the run was stopped.
+int check_converged(const struct run_info *run, struct sched_shared *sh, double z)
+{
+    if (run->epsilon <= 0 || sched_stopped(sh))
+        return sched_stopped(sh);
+
+    long long done, chunks;
+    double sumsq, sum = sched_total(sh, &sumsq, &done, &chunks);
+    long long batches = run_batches(run, done, chunks);
+    if (done < 1000 || batches < 10 || stats_halfwidth(sum, sumsq, done, batches, z) >= run->epsilon)
+        return 0;
+    sched_stop(sh);
+    return 1;
+}
+
+// Block until SIGUSR2 (or SIGINT) ends a pause. The flag is tested with
+// the signals blocked and sigsuspend unblocks them atomically, so a resume
+// can never slip in between the test and the wait.
+void wait_while_paused(void)
+{
+    sigset_t orig;
+    sigprocmask(SIG_BLOCK, &watch_set, &orig);
+    while (paused && !terminate)
+        sigsuspend(&orig);
+    sigprocmask(SIG_SETMASK, &orig, NULL);
+}
+
+// Check the run parameters of a loaded checkpoint against this run
+int ckpt_matches(const struct ckpt_header *hdr, const struct run_info *run, long long num_tasks)
+{
+    if (hdr->N != run->N || hdr->C != run->C || hdr->seed != run->S || hdr->engine != run->R ||
+        hdr->chunking != run->A || hdr->integrand != run->I || hdr->dim != run->dim || hdr->variance != run->V ||
+        hdr->arith != run->F || hdr->num_tasks != num_tasks ||
+        (hdr->chunking == CHUNK_GUIDED && hdr->workers != run->workers))
+    {
+        // Guided task sizes follow the worker count even when the task count agrees
+        fprintf(stderr, "%s: checkpoint is for -N %lld -C %lld -S %lld -R %s -A %s -I %s -d %d -V %s -F %s",
+                run->ckpt_path, hdr->N, hdr->C, hdr->seed, rng_name(hdr->engine), chunk_names[hdr->chunking],
+                integrand_names[hdr->integrand], hdr->dim, variance_names[hdr->variance], arith_names[hdr->arith]);
+        if (hdr->chunking == CHUNK_GUIDED)
+            fprintf(stderr, " with %d workers", hdr->workers);
+        fprintf(stderr, "\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Build the task list; with --resume skip the tasks the checkpoint has
+void init_region(struct sched_shared *sh, const struct run_info *run)
+{
+    unsigned char *done = NULL;
+    struct ckpt_header hdr;
+    long long num_tasks = sched_count_tasks(run->N, run->C, run->A, run->workers);
+
+    if (run->resume)
+    {
+        done = ckpt_load(run->ckpt_path, &hdr);
+        if (done == NULL || !ckpt_matches(&hdr, run, num_tasks))
+        {
+            cleanup();
+            exit(1);
+        }
+    }
+    sched_init(sh, run->D, run->workers, sched_slot_bytes(run->pin != PIN_NONE), run->N, run->C, run->A, done);
+    if (done != NULL)
+    {
+        sh->base_sum = hdr.sum;
+        sh->base_sumsq = hdr.sumsq;
+        sh->base_tosses = hdr.completed;
+        sh->base_chunks = hdr.tasks_done;
+        printf("Resuming from %s: %lld of %lld tasks, %lld tosses done\n", run->ckpt_path, hdr.tasks_done,
+               num_tasks, hdr.completed);
+        free(done);
+    }
+}
+
+void monitor_start(struct monitor *mon, const struct run_info *run, struct sched_shared *sh)
+{
+    mon->run = run;
+    mon->sh = sh;
+    mon->z = stats_z_score(run->confidence);
+    mon->start_ns = timer_ns();
+    mon->start_tosses = sh->base_tosses;
+    mon->next_progress_ns = mon->start_ns + (long long)(run->progress_every * 1e9);
+    mon->next_ckpt_ns = mon->start_ns + (long long)(run->ckpt_every * 1e9);
+    mon->progress_shown = 0;
+    mon->done = NULL;
+    if (run->ckpt_path != NULL)
+    {
+        mon->done = malloc(ckpt_bitmap_size(sh->num_tasks) + 1);
+        if (mon->done == NULL)
+        {
+            perror("malloc");
+            cleanup();
+            exit(1);
+        }
+    }
+}
+
+void write_checkpoint(struct monitor *mon)
+{
+    const struct run_info *run = mon->run;
+    struct ckpt_header hdr;
+    if (run->ckpt_path == NULL)
+        return;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.engine = run->R;
+    hdr.chunking = run->A;
+    hdr.workers = run->workers;
+    hdr.N = run->N;
+    hdr.C = run->C;
+    hdr.seed = run->S;
+    hdr.integrand = run->I;
+    hdr.dim = run->dim;
+    hdr.variance = run->V;
+    hdr.arith = run->F;
+    ckpt_capture(&hdr, mon->done, mon->sh);
+    if (ckpt_save(run->ckpt_path, &hdr, mon->done) != 0)
+        perror(run->ckpt_path);
+}
+
+// One progress line on stderr: redrawn in place on a terminal
+void print_progress(struct monitor *mon)
+{
+    long long done;
+    double sum = sched_total(mon->sh, NULL, &done, NULL);
+    double elapsed = (timer_ns() - mon->start_ns) * 1e-9;
+    double rate = elapsed > 0 ? (done - mon->start_tosses) / elapsed : 0.0;
+    long long eta = rate > 0 ? (long long)((mon->run->N - done) / rate) : 0;
+
+    fprintf(stderr, "%s%5.1f%%  %lld/%lld tosses  %.1f Mtosses/s  estimate=%.6f  ETA %lld:%02lld:%02lld%s",
+            isatty(STDERR_FILENO) ? "\r" : "", mon->run->N ? 100.0 * done / mon->run->N : 100.0, done,
+            mon->run->N, rate * 1e-6, done ? sum / done : 0.0, eta / 3600, eta / 60 % 60, eta % 60,
+            isatty(STDERR_FILENO) ? "  " : "\n");
+    mon->progress_shown = 1;
+}
+
+// Do whatever is due: the -E check, a progress line, a checkpoint
+void monitor_tick(struct monitor *mon)
+{
+    const struct run_info *run = mon->run;
+    long long now = timer_ns();
+
+    check_converged(run, mon->sh, mon->z);
+    if (run->progress_every > 0 && now >= mon->next_progress_ns)
+    {
+        print_progress(mon);
+        mon->next_progress_ns = now + (long long)(run->progress_every * 1e9);
+    }
+    if (run->ckpt_path != NULL && now >= mon->next_ckpt_ns)
+    {
+        write_checkpoint(mon);
+        mon->next_ckpt_ns = now + (long long)(run->ckpt_every * 1e9);
+    }
+}
+
+// Sleep until a signal arrives (SIGCHLD included) or the next tick is due.
+// Call with watch_set blocked; `orig` is the mask to wait under.
+void monitor_wait(struct monitor *mon, const sigset_t *orig)
+{
+    const struct run_info *run = mon->run;
+    long long now = timer_ns();
+    long long wake = now + 1000000000LL;
+
+    if (run->epsilon > 0 && !sched_stopped(mon->sh))
+        wake = now + 1000000; // -E checks every millisecond
+    if (run->progress_every > 0 && mon->next_progress_ns < wake)
+        wake = mon->next_progress_ns;
+    if (run->ckpt_path != NULL && mon->next_ckpt_ns < wake)
+        wake = mon->next_ckpt_ns;
+    if (wake <= now)
+        return;
+
+    struct timespec ts = {(wake - now) / 1000000000LL, (wake - now) % 1000000000LL};
+    ppoll(NULL, 0, &ts, orig);
+}
+
+// The workers are done: close the progress line, save the final state
+void monitor_finish(struct monitor *mon)
+{
+    if (mon->progress_shown)
+    {
+        print_progress(mon);
+        if (isatty(STDERR_FILENO))
+            fprintf(stderr, "\n");
+    }
+    write_checkpoint(mon);
+    free(mon->done);
+}
+
+// Human-readable summary followed by one JSON line for regression tracking
+void print_report(const struct run_info *run, const struct timer_phases *tp, struct sched_shared *sh,
+                  double sum, double sumsq, long long done, long long chunks)
+{
+    double estimate = done ? sum / done : 0.0;
+    double exact = integrand_exact(run->I, run->dim);
+    long long fresh = done - sh->base_tosses; // Tossed by this run
+    long long batches = run_batches(run, done, chunks);
+    double std_err = stats_stderr_batches(sum, sumsq, done, batches);
+    double halfwidth = stats_halfwidth(sum, sumsq, done, batches, stats_z_score(run->confidence));
+    double total = timer_total(tp);
+    long long compute_ns = 0;
+    for (int i = 0; i < sh->workers; i++)
+        compute_ns += sched_slot(sh, i)->compute_ns;
+
+    if (run->I == INTEGRAND_PI)
+        printf("Pi estimate: %f\n", estimate);
+    else
+        printf("Estimate (%s, d=%d): %.9f\n", integrand_names[run->I], run->dim, estimate);
+    if (!isnan(exact))
+        printf("Exact = %.9f, error = %+.3g\n", exact, estimate - exact);
+    if (variance_batched(run->V))
+        printf("Standard error = %.3g (%s, over %lld chunk means)", std_err, variance_names[run->V], batches);
+    else if (run->V != VARIANCE_NONE)
+        printf("Standard error = %.3g (%s)", std_err, variance_names[run->V]);
+    else
+        printf("Standard error = %.3g", std_err);
+    printf(", CI half-width = %.3g (P=%g) after %lld of %lld tosses%s\n", halfwidth, run->confidence, done, run->N,
+           sched_stopped(sh) ? ", stopped early" : "");
+    printf("Elapsed time = %.6f seconds\n", total);
+    timer_print_table(tp);
+    print_sched_stats(sh);
+
+    printf("{\"program\":\"monte_master\",\"mode\":\"%s\",\"workers\":%d,\"N\":%lld,\"C\":%lld,"
+           "\"seed\":%d,\"engine\":\"%s\",\"kernel\":\"%s\",\"dispatch\":\"%s\",\"chunking\":\"%s\","
+           "\"tasks\":%lld,\"tosses\":%lld,\"integrand\":\"%s\",\"dim\":%d,\"variance\":\"%s\","
+           "\"arith\":\"%s\",\"estimate\":%.12f,\"stderr\":%.9g,",
+           run->mode, run->workers, run->N, run->C, run->S, rng_name(run->R), kernel_name(run->K),
+           sched_names[run->D], chunk_names[run->A], sh->num_tasks, done, integrand_names[run->I], run->dim,
+           variance_names[run->V], arith_names[run->F], estimate, std_err);
+    if (run->I == INTEGRAND_PI)
+        printf("\"pi\":%.12f,", estimate);
+    if (!isnan(exact))
+        printf("\"exact\":%.12f,", exact);
+    if (run->pin != PIN_NONE)
+    {
+        printf("\"pin\":\"%s\",\"cpus\":[", pin_names[run->pin]);
+        for (int i = 0; i < run->workers; i++)
+            printf("%s%d", i ? "," : "", run->cpu_map[i]);
+        printf("],\"numa_nodes\":%d,", pin_nodes(run->cpu_map, run->workers));
+    }
+    printf("\"epsilon\":%g,\"confidence\":%g,\"halfwidth\":%.9g,\"stopped_early\":%s,\"resumed_tosses\":%lld,",
+           run->epsilon, run->confidence, halfwidth, sched_stopped(sh) ? "true" : "false", sh->base_tosses);
+    timer_print_json(stdout, tp);
+    printf(",\"worker_compute\":%.9f,\"tosses_per_sec\":%.1f}\n", compute_ns * 1e-9,
+           total > 0 ? fresh / total : 0.0);
+    fflush(stdout);
+}
+
 void sig_handler(int signo)
 {
     if (signo == SIGINT)
     {
-        printf("\nMaster received SIGINT. cleaning up...\n");
+        // main stops the workers, saves a checkpoint and cleans up
         terminate = 1;
-        cleanup();
-        exit(0);
     }
     else if (signo == SIGUSR1)
     {
@@ -82,6 +476,177 @@ void sig_handler(int signo)
         printf("Master received SIGUSR2. Resuming...\n");
         paused = 0;
     }
+    // SIGCHLD only has to interrupt monitor_wait
+}
+
+// Thread body: claim tasks until none are left, tally locally
+void *thread_worker(void *arg)
+{
+    struct thread_slot *slot = arg;
+    struct thread_pool *pool = slot->pool;
+    struct sched_shared *sh = pool->sched;
+    long long *tosses = sched_tosses(sh), *starts = sched_starts(sh);
+    unsigned long long rand_state = 0x9E3779B97F4A7C15ULL * (slot->index + 1);
+
+    sched_touch_slot(sh, slot->index); // Already on its CPU under --pin
+    while (!terminate)
+    {
+        // Handle PAUSE signal (SIGUSR1): the main thread owns the signals
+        // and broadcasts on resume
+        if (__atomic_load_n(&pool->paused, __ATOMIC_RELAXED))
+        {
+            pthread_mutex_lock(&pool->lock);
+            while (pool->paused && !sched_stopped(sh))
+                pthread_cond_wait(&pool->resume, &pool->lock);
+            pthread_mutex_unlock(&pool->lock);
+        }
+
+        long long task;
+        if (sched_stopped(sh))
+            break;
+        if (sh->kind == SCHED_STEAL)
+            task = sched_next(sh, slot->index, &rand_state);
+        else
+        {
+            // Tickets for tasks finished before a --resume are skipped
+            do
+                task = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED);
+            while (task < sh->num_tasks && sched_resumed(sh, task));
+            if (task >= sh->num_tasks)
+                task = -1;
+        }
+        if (task < 0)
+            break;
+
+        sched_claim(sh, slot->index, tosses[task]);
+        long long t0 = timer_ns();
+        struct integrand_sum res = monte_sample(pool->V, pool->I, pool->dim, pool->R, pool->K, pool->F,
+                                                (uint64_t)pool->S, (uint64_t)task, starts[task], tosses[task]);
+        sched_record(sh, slot->index, task, res.sum, res.sumsq, tosses[task], timer_ns() - t0);
+    }
+    if (__atomic_add_fetch(&pool->finished, 1, __ATOMIC_ACQ_REL) == pool->threads)
+        pthread_kill(pool->main_thread, SIGCHLD);
+    return NULL;
+}
+
+// -T mode: run the chunked workload on T threads and reduce once at the end
+int run_threads(const struct run_info *run)
+{
+    struct thread_pool pool;
+    struct timer_phases tp;
+    int T = run->workers;
+
+    timer_start(&tp);
+    long long num_tasks = sched_count_tasks(run->N, run->C, run->A, T);
+    size_t sched_bytes = sched_size(T, sched_slot_bytes(run->pin != PIN_NONE), num_tasks);
+    pthread_t *tids = malloc(T * sizeof(pthread_t));
+    struct thread_slot *slots = malloc(T * sizeof(struct thread_slot));
+    // Fresh pages from the kernel, so local slots are untouched until their thread runs
+    struct sched_shared *sh = mmap(NULL, sched_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (tids == NULL || slots == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    if (sh == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+
+    init_region(sh, run);
+    pool.sched = sh;
+    pool.next_task = 0;
+    pool.finished = 0;
+    pool.threads = T;
+    pool.main_thread = pthread_self();
+    pool.paused = paused;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.resume, NULL);
+    pool.S = run->S;
+    pool.R = run->R;
+    pool.K = kernel_resolve(run->K); // CPUID once, not per thread
+    pool.I = run->I;
+    pool.dim = run->dim;
+    pool.V = run->V;
+    pool.F = run->F;
+    timer_phase(&tp, PHASE_SETUP);
+
+    // Threads inherit the blocked mask, so only the main thread sees signals
+    sigset_t orig;
+    sigprocmask(SIG_BLOCK, &watch_set, &orig);
+    int started = 0;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    for (int i = 0; i < T; i++)
+    {
+        slots[i].index = i;
+        slots[i].pool = &pool;
+        if (run->pin != PIN_NONE)
+        {
+            // Bound before it starts, so the thread never runs elsewhere
+            cpu_set_t set;
+            pin_set(&set, run->cpu_map[i]);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        if (pthread_create(&tids[i], &attr, thread_worker, &slots[i]) != 0)
+        {
+            perror("pthread_create");
+            break;
+        }
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+    wait_for_slots(sh, started);
+    timer_phase(&tp, PHASE_SPAWN);
+
+    // Threads claim their own tasks, so there is no dispatch phase. The
+    // main thread handles signals, progress, checkpoints and -E meanwhile.
+    struct monitor mon;
+    monitor_start(&mon, run, sh);
+    while (__atomic_load_n(&pool.finished, __ATOMIC_ACQUIRE) < started)
+    {
+        if (terminate)
+            sched_stop(sh);
+        if (paused != pool.paused || terminate)
+        {
+            pthread_mutex_lock(&pool.lock);
+            __atomic_store_n(&pool.paused, paused && !terminate, __ATOMIC_RELAXED);
+            pthread_cond_broadcast(&pool.resume);
+            pthread_mutex_unlock(&pool.lock);
+        }
+        if (terminate)
+            break;
+        monitor_tick(&mon);
+        monitor_wait(&mon, &orig);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+    sigprocmask(SIG_SETMASK, &orig, NULL);
+    if (terminate)
+    {
+        printf("\nMaster received SIGINT. cleaning up...\n");
+        write_checkpoint(&mon);
+        exit(0);
+    }
+    monitor_finish(&mon);
+    timer_phase(&tp, PHASE_COMPUTE);
+
+    long long done, chunks;
+    double sumsq, sum = sched_reduce(sh, &sumsq, &done, &chunks);
+    timer_phase(&tp, PHASE_REDUCE);
+
+    free(tids);
+    free(slots);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.resume);
+    timer_phase(&tp, PHASE_TEARDOWN);
+
+    print_report(run, &tp, sh, sum, sumsq, done, chunks);
+    munmap(sh, sched_bytes);
+    return started == T ? 0 : 1;
 }
 
 int main(int argc, char *argv[])
@@ -90,6 +655,23 @@ int main(int argc, char *argv[])
     long long N = 1000000;
     long long C = 100000;
     int S = 1;
+    int R = RNG_DEFAULT;
+    int K = KERNEL_AUTO;
+    int T = 0; // Threads; 0 keeps the fork+exec process mode
+    int D = SCHED_QUEUE;
+    int A = CHUNK_FIXED;
+    int I = INTEGRAND_PI;
+    int dim = 0; // 0 = the integrand's default
+    int V = VARIANCE_NONE;
+    int F = ARITH_DOUBLE;
+    double E = 0.0;  // Target CI half-width (0 = off)
+    double P = 0.95; // Confidence level for -E
+    const char *ckpt_path = NULL;
+    double ckpt_every = 60.0;
+    double progress_every = isatty(STDERR_FILENO) ? 1.0 : 0.0;
+    int resume = 0;
+    int pin = PIN_NONE;
+    const char *pin_list = NULL;
 
     // Parse arguments
     for (int i = 1; i < argc; i++)
@@ -98,6 +680,32 @@ int main(int argc, char *argv[])
         {
             switch (argv[i][1])
             {
+            case '-':
+                // Long options: --checkpoint FILE, --checkpoint-every SECONDS,
+                // --resume, --progress SECONDS (0 = off), --pin=POLICY
+                if (strcmp(argv[i], "--resume") == 0)
+                    resume = 1;
+                else if (strncmp(argv[i], "--pin=", 6) == 0)
+                    pin = pin_parse(argv[i] + 6, &pin_list);
+                else if (i + 1 >= argc)
+                {
+                    fprintf(stderr, "Missing arg for %s\n", argv[i]);
+                    exit(1);
+                }
+                else if (strcmp(argv[i], "--checkpoint") == 0)
+                    ckpt_path = argv[++i];
+                else if (strcmp(argv[i], "--checkpoint-every") == 0)
+                    ckpt_every = atof(argv[++i]);
+                else if (strcmp(argv[i], "--progress") == 0)
+                    progress_every = atof(argv[++i]);
+                else if (strcmp(argv[i], "--pin") == 0)
+                    pin = pin_parse(argv[++i], &pin_list);
+                else
+                {
+                    fprintf(stderr, "Unknown option %s\n", argv[i]);
+                    exit(1);
+                }
+                break;
             case 'M':
                 if (i + 1 < argc)
                     M = atoi(argv[++i]);
@@ -134,52 +742,269 @@ int main(int argc, char *argv[])
                     exit(1);
                 }
                 break;
+            case 'R':
+                if (i + 1 < argc)
+                    R = rng_parse(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -R\n");
+                    exit(1);
+                }
+                if (R < 0)
+                {
+                    fprintf(stderr, "Unknown engine %s (xoshiro, philox, pcg64)\n", argv[i]);
+                    exit(1);
+                }
+                break;
+            case 'K':
+                if (i + 1 < argc)
+                    K = kernel_parse(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -K\n");
+                    exit(1);
+                }
+                if (K < KERNEL_AUTO)
+                {
+                    fprintf(stderr, "Unknown kernel %s (auto, scalar, avx2, avx512)\n", argv[i]);
+                    exit(1);
+                }
+                break;
+            case 'T':
+                if (i + 1 < argc)
+                    T = atoi(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -T\n");
+                    exit(1);
+                }
+                break;
+            case 'I':
+                if (i + 1 < argc)
+                    I = integrand_parse(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -I\n");
+                    exit(1);
+                }
+                if (I < 0)
+                {
+                    fprintf(stderr, "Unknown integrand %s (pi, sphere, gauss, call, asian)\n", argv[i]);
+                    exit(1);
+                }
+                break;
+            case 'd':
+                if (i + 1 < argc)
+                    dim = atoi(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -d\n");
+                    exit(1);
+                }
+                break;
+            case 'V':
+                if (i + 1 < argc)
+                    V = variance_parse(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -V\n");
+                    exit(1);
+                }
+                if (V < 0)
+                {
+                    fprintf(stderr, "Unknown sampling mode %s (none, antithetic, stratified, sobol, halton)\n",
+                            argv[i]);
+                    exit(1);
+                }
+                break;
+            case 'F':
+                if (i + 1 < argc)
+                    F = arith_parse(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -F\n");
+                    exit(1);
+                }
+                if (F < 0)
+                {
+                    fprintf(stderr, "Unknown toss arithmetic %s (double, fixed)\n", argv[i]);
+                    exit(1);
+                }
+                break;
+            case 'E':
+                if (i + 1 < argc)
+                    E = atof(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -E\n");
+                    exit(1);
+                }
+                break;
+            case 'P':
+                if (i + 1 < argc)
+                    P = atof(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -P\n");
+                    exit(1);
+                }
+                if (P <= 0.0 || P >= 1.0)
+                {
+                    fprintf(stderr, "-P must be between 0 and 1\n");
+                    exit(1);
+                }
+                break;
+            case 'D':
+                if (i + 1 < argc)
+                    D = sched_parse(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -D\n");
+                    exit(1);
+                }
+                if (D < 0)
+                {
+                    fprintf(stderr, "Unknown dispatch mode %s (queue, steal)\n", argv[i]);
+                    exit(1);
+                }
+                break;
+            case 'A':
+                if (i + 1 < argc)
+                    A = chunk_parse(argv[++i]);
+                else
+                {
+                    fprintf(stderr, "Missing arg for -A\n");
+                    exit(1);
+                }
+                if (A < 0)
+                {
+                    fprintf(stderr, "Unknown chunk sizing %s (fixed, guided)\n", argv[i]);
+                    exit(1);
+                }
+                break;
             }
         }
     }
 
-    printf("M=%d, N=%lld, C=%lld, S=%d\n", M, N, C, S);
+    if (C <= 0)
+    {
+        fprintf(stderr, "-C must be positive\n");
+        exit(1);
+    }
+    if (T <= 0 && (M < 1 || M > 100))
+    {
+        fprintf(stderr, "-M must be between 1 and 100\n");
+        exit(1);
+    }
+
+    if (ckpt_every <= 0)
+    {
+        fprintf(stderr, "--checkpoint-every must be positive\n");
+        exit(1);
+    }
+    if (dim == 0)
+        dim = integrand_default_dim[I];
+    if (!integrand_check_dim(I, dim))
+    {
+        fprintf(stderr, "-d %d is not a valid dimension for -I %s\n", dim, integrand_names[I]);
+        exit(1);
+    }
+    if (!variance_check_dim(V, dim))
+    {
+        fprintf(stderr, "-V %s supports at most %d dimensions\n", variance_names[V], VARIANCE_QMC_MAX_DIM);
+        exit(1);
+    }
+    if (!variance_check_arith(V, I, F))
+    {
+        fprintf(stderr, "-F %s only changes the Pi toss kernels; it needs -I pi -V none\n", arith_names[F]);
+        exit(1);
+    }
+    if (!variance_check_integrand(V, I))
+    {
+        fprintf(stderr, "-V antithetic gains nothing on -I %s, which is symmetric about the cube centre\n",
+                integrand_names[I]);
+        exit(1);
+    }
+    if (resume && ckpt_path == NULL)
+        ckpt_path = CKPT_DEFAULT_PATH;
+    if (pin < 0)
+    {
+        fprintf(stderr, "Unknown --pin policy (compact, scatter, physical-only, or a CPU list like 0,2,4-7)\n");
+        exit(1);
+    }
 
     // Set up signal handlers
     signal(SIGINT, sig_handler);
     signal(SIGUSR1, sig_handler);
     signal(SIGUSR2, sig_handler);
+    signal(SIGCHLD, sig_handler);
+    sigemptyset(&watch_set);
+    sigaddset(&watch_set, SIGINT);
+    sigaddset(&watch_set, SIGUSR1);
+    sigaddset(&watch_set, SIGUSR2);
+    sigaddset(&watch_set, SIGCHLD);
 
-    // Setup Shared Memory
-    key_t key = ftok(SHM_KEY_PATH, SHM_KEY_ID);
-    shmid = shmget(key, sizeof(long long), IPC_CREAT | 0666);
-    if (shmid < 0)
+    struct run_info run = {T > 0 ? "threads" : "process", T > 0 ? T : M, N, C, S, R, K, D, A, I, dim, V, F, E, P,
+                           ckpt_path, ckpt_every, progress_every, resume, pin, pin_list, NULL};
+    if (T > 0)
     {
-        perror("shmget");
-        exit(1);
+        printf("T=%d, N=%lld, C=%lld, S=%d, R=%s, K=%s, F=%s, D=%s, A=%s, I=%s, d=%d, V=%s\n", T, N, C, S,
+               rng_name(R), kernel_name(K), arith_names[F], sched_names[D], chunk_names[A], integrand_names[I], dim,
+               variance_names[V]);
+        plan_cpus(&run);
+        return run_threads(&run);
     }
 
-    // Initialize Shared Memory (Global Count) to 0
-    long long *global_count = (long long *)shmat(shmid, NULL, 0);
-    *global_count = 0;
-    shmdt(global_count); // Detach for now, will re-attach at end
+    printf("M=%d, N=%lld, C=%lld, S=%d, R=%s, K=%s, F=%s, D=%s, A=%s, I=%s, d=%d, V=%s\n", M, N, C, S,
+           rng_name(R), kernel_name(K), arith_names[F], sched_names[D], chunk_names[A], integrand_names[I], dim,
+           variance_names[V]);
+    plan_cpus(&run);
 
-    // Setup Semaphore
-    key_t sem_key = ftok(SHM_KEY_PATH, SEM_KEY_ID);
-    semid = semget(sem_key, 1, IPC_CREAT | 0666);
-    if (semid < 0)
+    struct timer_phases tp;
+    timer_start(&tp);
+
+    // Setup Message Queue (queue mode only)
+    if (D == SCHED_QUEUE)
+    {
+        key_t msg_key = ftok(SHM_KEY_PATH, MSG_KEY_ID);
+        msgid = msgget(msg_key, IPC_CREAT | 0666);
+        if (msgid < 0)
+        {
+            perror("msgget");
+            cleanup();
+            exit(1);
+        }
+    }
+
+    // Setup Shared Memory: task list, one result slot per worker and, in
+    // steal mode, the deques. Filled before any worker starts.
+    long long num_tasks = sched_count_tasks(N, C, A, M);
+    size_t slot_bytes = sched_slot_bytes(pin != PIN_NONE);
+    int excl = pin != PIN_NONE ? IPC_EXCL : 0; // Local slots need untouched pages
+    key_t key = ftok(SHM_KEY_PATH, SHM_KEY_ID);
+    shmid = shmget(key, sched_size(M, slot_bytes, num_tasks), IPC_CREAT | excl | 0666);
+    if (shmid < 0 && (errno == EINVAL || errno == EEXIST))
+    {
+        // A stale segment from an earlier run is too small, or pinned workers
+        // need one nobody has touched; replace it
+        shmctl(shmget(key, 0, 0666), IPC_RMID, NULL);
+        shmid = shmget(key, sched_size(M, slot_bytes, num_tasks), IPC_CREAT | excl | 0666);
+    }
+    if (shmid < 0)
     {
-        perror("semget");
+        perror("shmget");
         cleanup();
         exit(1);
     }
-    // Init semaphore value to 1 (Mutex)
-    semctl(semid, 0, SETVAL, 1);
-
-    // Setup Message Queue
-    key_t msg_key = ftok(SHM_KEY_PATH, MSG_KEY_ID);
-    msgid = msgget(msg_key, IPC_CREAT | 0666);
-    if (msgid < 0)
+    struct sched_shared *sh = (struct sched_shared *)shmat(shmid, NULL, 0);
+    if (sh == (void *)-1)
     {
-        perror("msgget");
+        perror("shmat");
         cleanup();
         exit(1);
     }
+    init_region(sh, &run);
+    timer_phase(&tp, PHASE_SETUP);
 
     for (int i = 0; i < M; i++)
     {
@@ -187,10 +1012,25 @@ int main(int argc, char *argv[])
         if (pid == 0)
         {
             // CHILD PROCESS (Worker)
-            char s_str[20];
-            sprintf(s_str, "%d", S + i); // Calculate unique seed for worker
+            // Every worker shares the seed; the task index in each message
+            // picks the RNG stream, so results do not depend on scheduling.
+            // "-K auto" lets each worker pick the best kernel for its CPU.
+            char s_str[20], i_str[20], d_str[20];
+            if (pin != PIN_NONE)
+            {
+                // Inherited across exec, so the worker starts on its CPU
+                cpu_set_t set;
+                pin_set(&set, run.cpu_map[i]);
+                if (sched_setaffinity(0, sizeof(set), &set) != 0)
+                    perror("sched_setaffinity");
+            }
+            sprintf(s_str, "%d", S);
+            sprintf(i_str, "%d", i);
+            sprintf(d_str, "%d", dim);
             // Execute worker program
-            execl("./monte_worker", "./monte_worker", s_str, NULL);
+            execl("./monte_worker", "./monte_worker", "-i", i_str, "-S", s_str, "-R", rng_name(R),
+                  "-K", kernel_name(K), "-F", arith_names[F], "-D", sched_names[D], "-I", integrand_names[I], "-d", d_str, "-V",
+                  variance_names[V], NULL);
             perror("execl failed");
             exit(1);
         }
@@ -205,29 +1045,36 @@ int main(int argc, char *argv[])
         }
     }
 
-    time_t start = time(NULL);
+    wait_for_slots(sh, num_workers_spawned);
+    timer_phase(&tp, PHASE_SPAWN);
 
     struct msg_buf msg;
     msg.mtype = 1;
 
-    long long remaining = N;
+    long long *tosses = sched_tosses(sh);
+    long long task = 0;
+    struct monitor mon;
+    monitor_start(&mon, &run, sh);
 
-    while (remaining > 0 && !terminate)
+    // In steal mode the deques already hold every task
+    while (D == SCHED_QUEUE && task < num_tasks && !terminate)
     {
         // Handle PAUSE signal (SIGUSR1)
-        while (paused && !terminate)
-        {
-            sleep(1); // Wait until resumed
-        }
+        wait_while_paused();
         if (terminate)
             break;
+        if (sched_resumed(sh, task))
+        {
+            task++; // Finished before the checkpoint
+            continue;
+        }
 
-        // Calculate chunk size (C or whatever is left)
-        long long current_chunk = (remaining > C) ? C : remaining;
-        msg.tosses = current_chunk;
+        // Chunk size comes from the task list (fixed or guided)
+        msg.tosses = tosses[task];
+        msg.task = task;
 
         // Send task to Message Queue
-        if (msgsnd(msgid, &msg, sizeof(long long), 0) == -1)
+        if (msgsnd(msgid, &msg, sizeof(msg) - sizeof(long), 0) == -1)
         {
             if (errno == EINTR)
             {
@@ -238,30 +1085,56 @@ int main(int argc, char *argv[])
             break;
         }
 
-        remaining -= current_chunk;
+        task++;
+        monitor_tick(&mon);
+        if (sched_stopped(sh))
+            break;
     }
 
     // Send Empty Messages (size 0) to signal workers to exit
-    for (int i = 0; i < M; i++)
+    for (int i = 0; i < M && D == SCHED_QUEUE && !terminate; i++)
     {
         msg.tosses = 0; // 0 indicates termination to worker
-        msgsnd(msgid, &msg, sizeof(long long), 0);
+        msgsnd(msgid, &msg, sizeof(msg) - sizeof(long), 0);
     }
+    timer_phase(&tp, PHASE_DISPATCH);
 
-    // Wait for all workers to finish
-    while (wait(NULL) > 0)
-        ;
+    // Wait for all workers to finish. Between child exits (SIGCHLD) the
+    // master prints progress, saves checkpoints and runs the -E check.
+    sigset_t orig;
+    sigprocmask(SIG_BLOCK, &watch_set, &orig);
+    while (!terminate)
+    {
+        pid_t pid;
+        while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+            ;
+        if (pid < 0 && errno == ECHILD)
+            break;
+        monitor_tick(&mon);
+        monitor_wait(&mon, &orig);
+    }
+    sigprocmask(SIG_SETMASK, &orig, NULL);
+    if (terminate)
+    {
+        printf("\nMaster received SIGINT. cleaning up...\n");
+        cleanup(); // Stops the workers; the segment stays attached
+        write_checkpoint(&mon);
+        exit(0);
+    }
+    num_workers_spawned = 0;
+    monitor_finish(&mon);
+    timer_phase(&tp, PHASE_COMPUTE);
 
-    time_t end = time(NULL);
+    // Reduce the per-worker result slots once everyone has exited
+    long long done, chunks;
+    double sumsq, sum = sched_reduce(sh, &sumsq, &done, &chunks);
+    timer_phase(&tp, PHASE_REDUCE);
 
-    // Read Final Result from Shared Memory
-    global_count = (long long *)shmat(shmid, NULL, 0);
-    double pi_estimate = 4.0 * (*global_count) / ((double)N);
-    printf("Pi estimate: %f\n", pi_estimate);
-    printf("Elapsed time = %ld seconds\n", end - start);
+    cleanup(); // Final cleanup of IPC (segment stays readable until shmdt)
+    timer_phase(&tp, PHASE_TEARDOWN);
 
-    shmdt(global_count);
-    cleanup(); // Final cleanup of IPC
+    print_report(&run, &tp, sh, sum, sumsq, done, chunks);
+    shmdt(sh);
 
     return 0;
 }
@@ -0,0 +1,268 @@
+/*
+* File: monte_mpi.c
+* Purpose: MPI-distributed Monte Carlo Pi estimation for the Slurm cluster.
+*          The toss budget is cut into the same chunks as monte_master and
+*          dealt round-robin over the ranks; each rank runs its chunks on a
+*          pthread pool with the SIMD toss kernel, and the per-rank counts
+*          are combined with one MPI_Reduce. Chunk streams are keyed by
+*          (seed, task), so every rank draws independent numbers and the
+*          estimate matches monte_serial/monte_master for equal -S/-C/-R.
+*          -I/-d pick the integrand, -V the sampling mode and -F the toss
+*          arithmetic as in monte_master.
+* Build: mpicc -O2 -pthread monte_mpi.c -o monte_mpi -lm
+* Run:   mpirun -n 4 --oversubscribe ./monte_mpi -N 100000000 -T 1   (one host)
+*        srun -N 3 --ntasks-per-node=1 ./monte_mpi -N 10000000000 -T 0
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <mpi.h>
+#include "monte_variance.h"
+#include "monte_sched.h"
+#include "monte_timer.h"
+
+// Per-thread tally, padded so threads never share a cache line
+struct rank_slot
+{
+    double sum, sumsq;
+    long long tosses;
+    long long compute_ns;
+    char pad[SCHED_LINE - 4 * sizeof(long long)];
+} __attribute__((aligned(SCHED_LINE)));
+
+// This rank's share of the workload
+struct rank_work
+{
+    long long N, C;
+    long long num_tasks; // Tasks in the whole run
+    long long next;      // Next local ticket (atomic); task = rank + ticket * ranks
+    int rank, ranks;
+    int S, R, K, I, dim, V, F;
+    struct rank_slot *slots;
+    int thread_count;
+};
+
+struct thread_arg
+{
+    struct rank_work *work;
+    int index;
+};
+
+// Thread body: claim this rank's tasks until none are left
+void *rank_thread(void *p)
+{
+    struct thread_arg *arg = p;
+    struct rank_work *work = arg->work;
+    struct rank_slot *slot = &work->slots[arg->index];
+    double sum = 0.0, sumsq = 0.0;
+    long long tosses = 0, compute_ns = 0;
+
+    for (;;)
+    {
+        long long ticket = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+        long long task = work->rank + ticket * work->ranks;
+        if (task >= work->num_tasks)
+            break;
+
+        long long start = task * work->C;
+        long long n = (work->N - start > work->C) ? work->C : work->N - start;
+        long long t0 = timer_ns();
+        struct integrand_sum res = monte_sample(work->V, work->I, work->dim, work->R, work->K, work->F,
+                                                (uint64_t)work->S, (uint64_t)task, start, n);
+        sum += res.sum;
+        sumsq += res.sumsq;
+        compute_ns += timer_ns() - t0;
+        tosses += n;
+    }
+
+    slot->sum = sum;
+    slot->sumsq = sumsq;
+    slot->tosses = tosses;
+    slot->compute_ns = compute_ns;
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    long long N = 1000000;
+    long long C = 100000;
+    int S = 1;
+    int R = RNG_DEFAULT;
+    int K = KERNEL_AUTO;
+    int T = 1; // Threads per rank; 0 = every online core
+    int I = INTEGRAND_PI;
+    int dim = 0;
+    int V = VARIANCE_NONE;
+    int F = ARITH_DOUBLE;
+    int provided, rank, ranks;
+    struct timer_phases tp;
+
+    timer_start(&tp);
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    // Parse arguments (every rank parses the same command line)
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '-')
+            continue;
+        if (i + 1 >= argc)
+        {
+            if (rank == 0)
+                fprintf(stderr, "Missing arg for %s\n", argv[i]);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        switch (argv[i][1])
+        {
+        case 'N':
+            N = atoll(argv[++i]);
+            break;
+        case 'C':
+            C = atoll(argv[++i]);
+            break;
+        case 'S':
+            S = atoi(argv[++i]);
+            break;
+        case 'T':
+            T = atoi(argv[++i]);
+            break;
+        case 'R':
+            R = rng_parse(argv[++i]);
+            break;
+        case 'K':
+            K = kernel_parse(argv[++i]);
+            break;
+        case 'I':
+            I = integrand_parse(argv[++i]);
+            break;
+        case 'd':
+            dim = atoi(argv[++i]);
+            break;
+        case 'V':
+            V = variance_parse(argv[++i]);
+            break;
+        case 'F':
+            F = arith_parse(argv[++i]);
+            break;
+        }
+    }
+    if (I >= 0 && dim == 0)
+        dim = integrand_default_dim[I];
+    if (C <= 0 || R < 0 || K < KERNEL_AUTO || I < 0 || !integrand_check_dim(I, dim) || V < 0 ||
+        !variance_check_dim(V, dim) || !variance_check_integrand(V, I) || F < 0 ||
+        !variance_check_arith(V, I, F))
+    {
+        if (rank == 0)
+            fprintf(stderr, "Usage: %s [-N tosses] [-C chunk] [-S seed] [-T threads] [-R engine] [-K kernel]\n"
+                            "       [-F arith] [-I integrand] [-d dim] [-V sampling]\n", argv[0]);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (T <= 0)
+        T = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    struct rank_work work;
+    work.N = N;
+    work.C = C;
+    work.num_tasks = sched_count_tasks(N, C, CHUNK_FIXED, 1);
+    work.next = 0;
+    work.rank = rank;
+    work.ranks = ranks;
+    work.S = S;
+    work.R = R;
+    work.K = kernel_resolve(K); // Per rank: nodes may differ
+    work.I = I;
+    work.dim = dim;
+    work.V = V;
+    work.F = F;
+    work.thread_count = T;
+    work.slots = aligned_alloc(SCHED_LINE, T * sizeof(struct rank_slot));
+    pthread_t *tids = malloc(T * sizeof(pthread_t));
+    struct thread_arg *args = malloc(T * sizeof(struct thread_arg));
+    if (work.slots == NULL || tids == NULL || args == NULL)
+    {
+        perror("malloc");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (rank == 0)
+        printf("ranks=%d, T=%d, N=%lld, C=%lld, S=%d, R=%s, K=%s, F=%s, I=%s, d=%d, V=%s\n", ranks, T, N, C, S,
+               rng_name(R), kernel_name(K), arith_names[F], integrand_names[I], dim, variance_names[V]);
+    timer_phase(&tp, PHASE_SETUP);
+
+    int started = 0;
+    for (int i = 0; i < T; i++)
+    {
+        memset(&work.slots[i], 0, sizeof(work.slots[i]));
+        args[i].work = &work;
+        args[i].index = i;
+        if (pthread_create(&tids[i], NULL, rank_thread, &args[i]) != 0)
+        {
+            perror("pthread_create");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        started++;
+    }
+    timer_phase(&tp, PHASE_SPAWN);
+
+    // Reduce the thread slots locally first, then across ranks
+    double local_sum[2] = {0.0, 0.0}; // sum, sumsq
+    long long local[2] = {0, 0};      // tosses, compute_ns
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(tids[i], NULL);
+        local_sum[0] += work.slots[i].sum;
+        local_sum[1] += work.slots[i].sumsq;
+        local[0] += work.slots[i].tosses;
+        local[1] += work.slots[i].compute_ns;
+    }
+    timer_phase(&tp, PHASE_COMPUTE);
+
+    double global_sum[2] = {0.0, 0.0};
+    long long global[2] = {0, 0};
+    double rank_compute = tp.seconds[PHASE_COMPUTE], slowest = 0.0, fastest = 0.0;
+    MPI_Reduce(local_sum, global_sum, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(local, global, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&rank_compute, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&rank_compute, &fastest, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    timer_phase(&tp, PHASE_REDUCE);
+
+    free(tids);
+    free(args);
+    free(work.slots);
+    timer_phase(&tp, PHASE_TEARDOWN);
+
+    if (rank == 0)
+    {
+        double estimate = global_sum[0] / ((double)global[0]);
+        double std_err = stats_stderr_batches(global_sum[0], global_sum[1], global[0],
+                                              variance_batched(V) ? work.num_tasks : global[0]);
+        double total = timer_total(&tp);
+        if (I == INTEGRAND_PI)
+            printf("Pi estimate: %f\n", estimate);
+        else
+            printf("Estimate (%s, d=%d): %.9f\n", integrand_names[I], dim, estimate);
+        printf("Standard error = %.3g\n", std_err);
+        printf("Elapsed time = %.6f seconds\n", total);
+        timer_print_table(&tp);
+        printf("Rank compute min/max = %.6f/%.6f seconds\n", fastest, slowest);
+        printf("{\"program\":\"monte_mpi\",\"mode\":\"mpi\",\"workers\":%d,\"ranks\":%d,\"threads\":%d,"
+               "\"N\":%lld,\"C\":%lld,\"seed\":%d,\"engine\":\"%s\",\"kernel\":\"%s\",\"tosses\":%lld,"
+               "\"integrand\":\"%s\",\"dim\":%d,\"variance\":\"%s\",\"arith\":\"%s\","
+               "\"estimate\":%.12f,\"stderr\":%.9g,",
+               ranks * T, ranks, T, N, C, S, rng_name(R), kernel_name(K), global[0], integrand_names[I], dim,
+               variance_names[V], arith_names[F], estimate, std_err);
+        if (I == INTEGRAND_PI)
+            printf("\"pi\":%.12f,", estimate);
+        timer_print_json(stdout, &tp);
+        printf(",\"worker_compute\":%.9f,\"rank_compute_min\":%.9f,\"rank_compute_max\":%.9f,\"tosses_per_sec\":%.1f}\n",
+               global[1] * 1e-9, fastest, slowest, total > 0 ? global[0] / total : 0.0);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
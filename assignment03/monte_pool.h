@@ -0,0 +1,174 @@
+/*
+* File: monte_pool.h
+* Purpose: Job table of the persistent worker pool (monte_workerd). The
+*          daemon maps it shared before forking its workers, so every job
+*          reuses the same warm processes and the same memory. Each running
+*          job has a slot with its parameters, a ticket counter and one
+*          result cell per task; workers take one chunk at a time from the
+*          running jobs in turn, so concurrent jobs share the pool evenly.
+*          Chunks are keyed by (seed, task) with fixed chunking, so a job
+*          gives the same result as monte_serial/monte_master with equal
+*          -S/-C.
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_POOL_H
+#define MONTE_POOL_H
+
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "monte_variance.h"
+#include "monte_sched.h"
+
+#define POOL_SOCKET_DEFAULT "monte_workerd.sock"
+#define POOL_LINE_MAX 512        // One request or reply line
+#define POOL_MAX_JOBS 32         // Jobs running at once; more wait in the daemon
+#define POOL_MAX_TASKS (1 << 16) // Chunks per job (N / C)
+
+// Ticket of a closed slot: far past any num_tasks, and far enough from
+// 2^32 that stray fetch-adds by late workers cannot carry into the generation
+#define POOL_CLOSED 0x80000000ULL
+
+// One job slot. The daemon closes the claim word, fills the parameters
+// and then reopens the word with the next generation; workers read the
+// parameters only after taking a ticket and check the generation again
+// afterwards, like a sequence lock.
+struct pool_job
+{
+    unsigned long long claim; // Generation << 32 | next ticket (atomic)
+    long long done;           // Tasks finished (atomic); the last one wakes the daemon
+    int cancel;               // The client went away: count the remaining tasks without running them
+    int S, R, K, I, dim, V, F;
+    long long N, C, num_tasks;
+} __attribute__((aligned(SCHED_LINE)));
+
+// Header of the shared region. It is followed by
+// cells[POOL_MAX_JOBS][POOL_MAX_TASKS], which the kernel only backs with
+// memory as jobs write them.
+struct pool_shared
+{
+    int workers;
+    int shutdown;         // Set by the daemon; workers exit
+    int work_gen;         // Bumped on every new job; idle workers sleep on it (futex)
+    unsigned int next_rr; // Round-robin cursor over the job slots (atomic)
+    struct pool_job jobs[POOL_MAX_JOBS];
+};
+
+static inline size_t pool_size(void)
+{
+    return SCHED_ALIGN(sizeof(struct pool_shared)) +
+           (size_t)POOL_MAX_JOBS * POOL_MAX_TASKS * sizeof(struct integrand_sum);
+}
+
+// Result cells of job slot j, indexed by task
+static inline struct integrand_sum *pool_cells(struct pool_shared *ps, int j)
+{
+    return (struct integrand_sum *)((char *)ps + SCHED_ALIGN(sizeof(struct pool_shared))) +
+           (size_t)j * POOL_MAX_TASKS;
+}
+
+// The region is shared between processes, so no FUTEX_PRIVATE_FLAG
+static inline void pool_futex_wait(int *addr, int seen)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT, seen, NULL, NULL, 0);
+}
+
+static inline void pool_futex_wake(int *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Daemon side: start job slot j with the parameters in `params`. The
+// slot's previous job must be done (or the slot never used).
+static inline void pool_publish(struct pool_shared *ps, int j, const struct pool_job *params, unsigned int gen)
+{
+    struct pool_job *job = &ps->jobs[j];
+    __atomic_store_n(&job->claim, (unsigned long long)gen << 32 | POOL_CLOSED, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    job->S = params->S;
+    job->R = params->R;
+    job->K = params->K;
+    job->I = params->I;
+    job->dim = params->dim;
+    job->V = params->V;
+    job->F = params->F;
+    job->N = params->N;
+    job->C = params->C;
+    job->num_tasks = (params->N + params->C - 1) / params->C;
+    __atomic_store_n(&job->cancel, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&job->done, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&job->claim, (unsigned long long)gen << 32, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&ps->work_gen, 1, __ATOMIC_RELEASE);
+    pool_futex_wake(&ps->work_gen);
+}
+
+// Worker side: take one task of job j. Returns the task, or -1 if the job
+// has none left. A slot is only reused once all of its tasks are done, so
+// a ticket below num_tasks pins the job; a ticket past the end may race
+// with a reuse, which the generation check catches.
+static inline long long pool_claim(struct pool_shared *ps, int j, struct pool_job *copy)
+{
+    struct pool_job *job = &ps->jobs[j];
+    unsigned long long c = __atomic_load_n(&job->claim, __ATOMIC_ACQUIRE);
+    if ((long long)(c & 0xFFFFFFFFULL) >= job->num_tasks)
+        return -1; // Closed or exhausted; leave the counter alone
+    c = __atomic_fetch_add(&job->claim, 1, __ATOMIC_ACQ_REL);
+    memcpy(copy, job, sizeof(*copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if ((__atomic_load_n(&job->claim, __ATOMIC_RELAXED) >> 32) != (c >> 32))
+        return -1;
+    long long task = (long long)(c & 0xFFFFFFFFULL);
+    return task < copy->num_tasks ? task : -1;
+}
+
+// Worker side: the next task from any running job, taking the jobs in
+// turn. Returns the slot, or -1 if no job has work left.
+static inline int pool_next(struct pool_shared *ps, struct pool_job *copy, long long *task)
+{
+    unsigned int first = __atomic_fetch_add(&ps->next_rr, 1, __ATOMIC_RELAXED);
+    for (int k = 0; k < POOL_MAX_JOBS; k++)
+    {
+        int j = (int)((first + k) % POOL_MAX_JOBS);
+        *task = pool_claim(ps, j, copy);
+        if (*task >= 0)
+            return j;
+    }
+    return -1;
+}
+
+// Worker side: run task `task` of job slot j. Returns 1 if it was the
+// job's last task.
+static inline int pool_run(struct pool_shared *ps, int j, const struct pool_job *job, long long task)
+{
+    struct integrand_sum *cell = &pool_cells(ps, j)[task];
+    long long start = task * job->C;
+    long long n = (job->N - start > job->C) ? job->C : job->N - start;
+
+    if (__atomic_load_n(&ps->jobs[j].cancel, __ATOMIC_RELAXED))
+        cell->sum = cell->sumsq = 0.0;
+    else
+        *cell = monte_sample(job->V, job->I, job->dim, job->R, job->K, job->F, (uint64_t)job->S, (uint64_t)task,
+                             start, n);
+    return __atomic_add_fetch(&ps->jobs[j].done, 1, __ATOMIC_ACQ_REL) == job->num_tasks;
+}
+
+// Daemon side: sum the cells of a finished job in task order
+static inline double pool_reduce(struct pool_shared *ps, int j, double *sumsq)
+{
+    struct integrand_sum *cells = pool_cells(ps, j);
+    double sum = 0.0, sq = 0.0;
+    for (long long t = 0; t < ps->jobs[j].num_tasks; t++)
+    {
+        sum += cells[t].sum;
+        sq += cells[t].sumsq;
+    }
+    *sumsq = sq;
+    return sum;
+}
+
+#endif
@@ -0,0 +1,218 @@
+/*
+* File: monte_rng.h
+* Purpose: Pluggable random number engines for the Monte Carlo Pi programs.
+*          Provides xoshiro256**, Philox4x32-10 and PCG64. Every stream is
+*          derived from (seed, task index), so the tosses of a chunk are the
+*          same no matter which worker ends up running it.
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_RNG_H
+#define MONTE_RNG_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Engine identifiers (selected with -R on the command line)
+enum rng_kind
+{
+    RNG_XOSHIRO = 0, // xoshiro256** (hashed per-task seeding)
+    RNG_PHILOX = 1,  // Philox4x32-10 (counter-based, key = seed, counter = task)
+    RNG_PCG64 = 2    // PCG64 XSL-RR (increment selects the task stream)
+};
+
+#define RNG_DEFAULT RNG_XOSHIRO
+
+static const char *rng_names[] = {"xoshiro", "philox", "pcg64"};
+
+// Engine state. Only the member matching kind is used.
+typedef struct
+{
+    int kind;
+    union
+    {
+        struct
+        {
+            uint64_t s[4];
+        } xo;
+        struct
+        {
+            uint32_t ctr[4];
+            uint32_t key[2];
+            uint32_t out[4];
+            int idx; // Next unused 64-bit half of out (0, 1 or 2 = empty)
+        } ph;
+        struct
+        {
+            unsigned __int128 state;
+            unsigned __int128 inc;
+        } pcg;
+    } u;
+} rng_t;
+
+// Map an engine name to its identifier, -1 if unknown
+static inline int rng_parse(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(rng_names) / sizeof(rng_names[0])); i++)
+    {
+        if (strcmp(name, rng_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static inline const char *rng_name(int kind)
+{
+    return rng_names[kind];
+}
+
+static inline uint64_t rng_rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+// splitmix64 step, used to expand seeds into full engine state
+static inline uint64_t rng_splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* ---------- xoshiro256** ---------- */
+
+static inline uint64_t rng_xoshiro_next(rng_t *r)
+{
+    uint64_t *s = r->u.xo.s;
+    uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return result;
+}
+
+// Hash (seed, task) into one splitmix64 seed; the xoshiro state is the
+// splitmix64 sequence that follows it
+static inline uint64_t rng_xoshiro_mix(uint64_t seed, uint64_t task)
+{
+    uint64_t sm = seed;
+    return rng_splitmix64(&sm) ^ (task * 0xD1B54A32D192ED03ULL);
+}
+
+/* ---------- Philox4x32-10 ---------- */
+
+static inline void rng_philox_block(rng_t *r)
+{
+    uint32_t c0 = r->u.ph.ctr[0], c1 = r->u.ph.ctr[1];
+    uint32_t c2 = r->u.ph.ctr[2], c3 = r->u.ph.ctr[3];
+    uint32_t k0 = r->u.ph.key[0], k1 = r->u.ph.key[1];
+
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c0 = n0;
+        c1 = (uint32_t)p1;
+        c2 = n2;
+        c3 = (uint32_t)p0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    r->u.ph.out[0] = c0;
+    r->u.ph.out[1] = c1;
+    r->u.ph.out[2] = c2;
+    r->u.ph.out[3] = c3;
+
+    // Advance the 64-bit block counter held in ctr[0..1]
+    if (++r->u.ph.ctr[0] == 0)
+        r->u.ph.ctr[1]++;
+}
+
+static inline uint64_t rng_philox_next(rng_t *r)
+{
+    if (r->u.ph.idx == 2)
+    {
+        rng_philox_block(r);
+        r->u.ph.idx = 0;
+    }
+    int i = 2 * r->u.ph.idx++;
+    return ((uint64_t)r->u.ph.out[i] << 32) | r->u.ph.out[i + 1];
+}
+
+/* ---------- PCG64 (XSL-RR 128/64) ---------- */
+
+#define RNG_PCG_MULT (((unsigned __int128)0x2360ED051FC65DA4ULL << 64) | 0x4385DF649FCCF645ULL)
+
+static inline uint64_t rng_pcg64_next(rng_t *r)
+{
+    r->u.pcg.state = r->u.pcg.state * RNG_PCG_MULT + r->u.pcg.inc;
+    unsigned __int128 s = r->u.pcg.state;
+    uint64_t xored = (uint64_t)(s >> 64) ^ (uint64_t)s;
+    int rot = (int)(s >> 122);
+    return (xored >> rot) | (xored << ((-rot) & 63));
+}
+
+/* ---------- Generic interface ---------- */
+
+// Position engine `kind` at the start of the stream for (seed, task)
+static inline void rng_seed(rng_t *r, int kind, uint64_t seed, uint64_t task)
+{
+    r->kind = kind;
+    switch (kind)
+    {
+    case RNG_PHILOX:
+        r->u.ph.key[0] = (uint32_t)seed;
+        r->u.ph.key[1] = (uint32_t)(seed >> 32);
+        r->u.ph.ctr[0] = 0;
+        r->u.ph.ctr[1] = 0;
+        r->u.ph.ctr[2] = (uint32_t)task;
+        r->u.ph.ctr[3] = (uint32_t)(task >> 32);
+        r->u.ph.idx = 2;
+        break;
+    case RNG_PCG64:
+        // Standard pcg64 srandom(initstate = seed, initseq = task)
+        r->u.pcg.state = 0;
+        r->u.pcg.inc = ((unsigned __int128)task << 1) | 1u;
+        rng_pcg64_next(r);
+        r->u.pcg.state += seed;
+        rng_pcg64_next(r);
+        break;
+    default:
+    {
+        uint64_t x = rng_xoshiro_mix(seed, task);
+        for (int i = 0; i < 4; i++)
+            r->u.xo.s[i] = rng_splitmix64(&x);
+        break;
+    }
+    }
+}
+
+static inline uint64_t rng_next(rng_t *r)
+{
+    switch (r->kind)
+    {
+    case RNG_PHILOX:
+        return rng_philox_next(r);
+    case RNG_PCG64:
+        return rng_pcg64_next(r);
+    default:
+        return rng_xoshiro_next(r);
+    }
+}
+
+// Uniform double in [0, 1) from the top 53 bits
+static inline double rng_u01(uint64_t x)
+{
+    return (double)(x >> 11) * 0x1.0p-53;
+}
+
+#endif
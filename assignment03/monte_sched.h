@@ -0,0 +1,465 @@
+/*
+* File: monte_sched.h
+* Purpose: Chunk scheduling for the Monte Carlo Pi programs. Builds the task
+*          list (fixed or guided chunk sizes) and provides per-worker
+*          work-stealing deques that live in one flat region, so the same
+*          code serves shared memory between processes and threads. The
+*          region also holds one result slot per worker, which replaces the
+*          semaphore-guarded global counter, and one result cell per task,
+*          which is what a checkpoint records. Results are the sum and sum
+*          of squares of a chunk's samples (see monte_integrand.h).
+*          With pinned workers each slot gets a page of its own, which the
+*          owner touches first so that it lands on the owner's NUMA node.
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_SCHED_H
+#define MONTE_SCHED_H
+
+#include <stddef.h>
+#include <string.h>
+
+#define SCHED_LINE 64
+#define SCHED_PAGE 4096
+#define SCHED_ALIGN(n) (((n) + SCHED_LINE - 1) / SCHED_LINE * SCHED_LINE)
+
+// Dispatch modes (selected with -D)
+enum sched_kind
+{
+    SCHED_QUEUE = 0, // One shared queue (message queue or ticket counter)
+    SCHED_STEAL = 1  // Per-worker deques with randomized stealing
+};
+
+// State of a task's result cell
+#define SCHED_TODO 0LL    // Nobody has finished it yet
+#define SCHED_DONE 1LL    // Finished by this run; the cell holds its sums
+#define SCHED_RESUMED 2LL // Finished by an earlier run (--resume)
+
+// Chunk sizing (selected with -A)
+enum chunk_kind
+{
+    CHUNK_FIXED = 0, // Every chunk is C tosses
+    CHUNK_GUIDED = 1 // remaining / (2 * workers), never below C
+};
+
+static const char *sched_names[] = {"queue", "steal"};
+static const char *chunk_names[] = {"fixed", "guided"};
+
+// Per-worker deque. top is contended by thieves, bottom is owned by the
+// worker, so they sit on separate cache lines.
+struct sched_deque
+{
+    long long top;
+    char pad0[SCHED_LINE - sizeof(long long)];
+    long long bottom;
+    long long base; // Offset of this deque's tasks in the item array
+    char pad1[SCHED_LINE - 2 * sizeof(long long)];
+};
+
+// Per-worker result slot on its own two cache lines. Only the owner writes
+// it, with relaxed atomic stores of its running totals; the master reads
+// them for progress and -E checks while the workers run.
+struct sched_stats
+{
+    double sum;   // Of the samples, over all of this worker's chunks
+    double sumsq; // Of their squares
+    long long tosses;
+    long long claimed; // Tosses of every task taken, including the one in flight
+    long long chunks;
+    long long steals;
+    long long compute_ns;   // Time spent inside the toss kernel
+    long long chunk_min_ns; // Fastest and slowest chunk
+    long long chunk_max_ns;
+    long long touched; // Set by the owner in sched_touch_slot()
+    char pad[2 * SCHED_LINE - 10 * sizeof(long long)];
+};
+
+// Result of one task, written once by whoever ran it
+struct sched_cell
+{
+    double sum;
+    double sumsq;
+    long long state; // SCHED_TODO, SCHED_DONE or SCHED_RESUMED; written last
+};
+
+// Header of the scheduling region. It is followed by the result slots
+// (workers of slot_bytes each), deques[workers], tosses[num_tasks],
+// starts[num_tasks], items[num_tasks] and cells[num_tasks].
+struct sched_shared
+{
+    int workers;
+    int kind;
+    long long slot_bytes; // sizeof(struct sched_stats), or SCHED_PAGE for local slots
+    int slots_ready;      // Owners that have touched their slot (local slots only)
+    long long num_tasks;
+    long long tosses_total;
+    int stop; // Set by the master to stop handing out tasks (early termination)
+    double base_sum; // Totals carried over from a checkpoint
+    double base_sumsq;
+    long long base_tosses;
+    long long base_chunks;
+};
+
+static inline int sched_parse(const char *name)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (strcmp(name, sched_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static inline int chunk_parse(const char *name)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (strcmp(name, chunk_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Size of the next chunk when `remaining` tosses are left
+static inline long long sched_next_chunk(long long remaining, long long C, int chunking, int workers)
+{
+    long long size = C;
+    if (chunking == CHUNK_GUIDED)
+    {
+        size = (remaining + 2LL * workers - 1) / (2LL * workers);
+        if (size < C)
+            size = C;
+    }
+    return (remaining > size) ? size : remaining;
+}
+
+// Number of tasks N tosses split into
+static inline long long sched_count_tasks(long long N, long long C, int chunking, int workers)
+{
+    long long count = 0;
+    for (long long remaining = N; remaining > 0; count++)
+        remaining -= sched_next_chunk(remaining, C, chunking, workers);
+    return count;
+}
+
+// Slot size: packed, or one page per slot so each can live on its own node
+static inline size_t sched_slot_bytes(int local)
+{
+    return local ? SCHED_PAGE : sizeof(struct sched_stats);
+}
+
+// Offset of the first slot; local slots start on a page of their own
+static inline size_t sched_slots_offset(size_t slot_bytes)
+{
+    return slot_bytes >= SCHED_PAGE ? SCHED_PAGE : SCHED_ALIGN(sizeof(struct sched_shared));
+}
+
+static inline size_t sched_size(int workers, size_t slot_bytes, long long num_tasks)
+{
+    return sched_slots_offset(slot_bytes) + (size_t)workers * (slot_bytes + sizeof(struct sched_deque)) +
+           (size_t)num_tasks * (3 * sizeof(long long) + sizeof(struct sched_cell));
+}
+
+// Result slot of worker w
+static inline struct sched_stats *sched_slot(struct sched_shared *sh, int w)
+{
+    return (struct sched_stats *)((char *)sh + sched_slots_offset(sh->slot_bytes) + (size_t)w * sh->slot_bytes);
+}
+
+static inline struct sched_deque *sched_deques(struct sched_shared *sh)
+{
+    return (struct sched_deque *)sched_slot(sh, sh->workers);
+}
+
+// Tosses of each task, indexed by task
+static inline long long *sched_tosses(struct sched_shared *sh)
+{
+    return (long long *)(sched_deques(sh) + sh->workers);
+}
+
+// Index of each task's first toss in the run (quasi-random skip-ahead)
+static inline long long *sched_starts(struct sched_shared *sh)
+{
+    return sched_tosses(sh) + sh->num_tasks;
+}
+
+static inline long long *sched_items(struct sched_shared *sh)
+{
+    return sched_starts(sh) + sh->num_tasks;
+}
+
+static inline struct sched_cell *sched_cells(struct sched_shared *sh)
+{
+    return (struct sched_cell *)(sched_items(sh) + sh->num_tasks);
+}
+
+static inline void sched_store_double(double *p, double v)
+{
+    __atomic_store(p, &v, __ATOMIC_RELAXED);
+}
+
+static inline double sched_load_double(double *p)
+{
+    double v;
+    __atomic_load(p, &v, __ATOMIC_RELAXED);
+    return v;
+}
+
+// Bit t of a task bitmap (checkpoint file format)
+static inline int sched_bit(const unsigned char *bits, long long t)
+{
+    return (bits[t >> 3] >> (t & 7)) & 1;
+}
+
+// Task t was finished before this run was resumed; never hand it out
+static inline int sched_resumed(struct sched_shared *sh, long long t)
+{
+    return __atomic_load_n(&sched_cells(sh)[t].state, __ATOMIC_RELAXED) == SCHED_RESUMED;
+}
+
+// Tell every worker to stop taking new tasks; chunks in progress finish
+static inline void sched_stop(struct sched_shared *sh)
+{
+    __atomic_store_n(&sh->stop, 1, __ATOMIC_RELAXED);
+}
+
+static inline int sched_stopped(struct sched_shared *sh)
+{
+    return __atomic_load_n(&sh->stop, __ATOMIC_RELAXED);
+}
+
+// First touch of worker w's slot, from the worker once it runs on its own
+// CPU and before its first task. sched_init leaves local slots alone (the
+// region must come fresh from the kernel, i.e. zeroed), so this store is
+// what places the page.
+static inline void sched_touch_slot(struct sched_shared *sh, int w)
+{
+    if (sh->slot_bytes < SCHED_PAGE)
+        return;
+    __atomic_store_n(&sched_slot(sh, w)->touched, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sh->slots_ready, 1, __ATOMIC_RELEASE);
+}
+
+// Worker w took a task of `tosses` tosses
+static inline void sched_claim(struct sched_shared *sh, int w, long long tosses)
+{
+    struct sched_stats *my = sched_slot(sh, w);
+    __atomic_store_n(&my->claimed, my->claimed + tosses, __ATOMIC_RELAXED);
+}
+
+// Publish a finished chunk (and how long it took) in worker w's slot and
+// its sums in the task's cell. The cell state is written last, so a reader
+// that sees SCHED_DONE also sees the complete result for that task.
+static inline void sched_record(struct sched_shared *sh, int w, long long task, double sum, double sumsq,
+                                long long tosses, long long ns)
+{
+    struct sched_stats *my = sched_slot(sh, w);
+    struct sched_cell *cell = &sched_cells(sh)[task];
+    sched_store_double(&my->sum, my->sum + sum);
+    sched_store_double(&my->sumsq, my->sumsq + sumsq);
+    __atomic_store_n(&my->tosses, my->tosses + tosses, __ATOMIC_RELAXED);
+    __atomic_store_n(&my->compute_ns, my->compute_ns + ns, __ATOMIC_RELAXED);
+    if (my->chunks == 0 || ns < my->chunk_min_ns)
+        __atomic_store_n(&my->chunk_min_ns, ns, __ATOMIC_RELAXED);
+    if (ns > my->chunk_max_ns)
+        __atomic_store_n(&my->chunk_max_ns, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&my->chunks, my->chunks + 1, __ATOMIC_RELAXED);
+    cell->sum = sum;
+    cell->sumsq = sumsq;
+    __atomic_store_n(&cell->state, SCHED_DONE, __ATOMIC_RELEASE);
+}
+
+// Running totals of all result slots plus anything carried over from a
+// checkpoint; cheap enough to call while the workers run. Returns the sum.
+static inline double sched_total(struct sched_shared *sh, double *sumsq, long long *tosses, long long *chunks)
+{
+    double sum = sh->base_sum, sq = sh->base_sumsq;
+    long long done = sh->base_tosses, count = sh->base_chunks;
+    for (int w = 0; w < sh->workers; w++)
+    {
+        struct sched_stats *st = sched_slot(sh, w);
+        sum += sched_load_double(&st->sum);
+        sq += sched_load_double(&st->sumsq);
+        done += __atomic_load_n(&st->tosses, __ATOMIC_RELAXED);
+        count += __atomic_load_n(&st->chunks, __ATOMIC_RELAXED);
+    }
+    if (sumsq != NULL)
+        *sumsq = sq;
+    if (tosses != NULL)
+        *tosses = done;
+    if (chunks != NULL)
+        *chunks = count;
+    return sum;
+}
+
+// Final reduction over the task cells in task order, so the result does
+// not depend on which worker ran which task. Call once the workers are done.
+static inline double sched_reduce(struct sched_shared *sh, double *sumsq, long long *tosses, long long *chunks)
+{
+    struct sched_cell *cells = sched_cells(sh);
+    long long *task_tosses = sched_tosses(sh);
+    double sum = sh->base_sum, sq = sh->base_sumsq;
+    long long done = sh->base_tosses, count = sh->base_chunks;
+    for (long long t = 0; t < sh->num_tasks; t++)
+    {
+        if (__atomic_load_n(&cells[t].state, __ATOMIC_ACQUIRE) != SCHED_DONE)
+            continue;
+        sum += cells[t].sum;
+        sq += cells[t].sumsq;
+        done += task_tosses[t];
+        count++;
+    }
+    if (sumsq != NULL)
+        *sumsq = sq;
+    if (tosses != NULL)
+        *tosses = done;
+    if (chunks != NULL)
+        *chunks = count;
+    return sum;
+}
+
+// Lay out the task list in a region of sched_size() bytes and deal the
+// tasks round-robin onto the deques. Each owner pops its tasks in index
+// order (biggest guided chunks first); thieves take from the other end.
+// Tasks set in the `done` bitmap (NULL for a fresh run) are skipped.
+static inline void sched_init(struct sched_shared *sh, int kind, int workers, size_t slot_bytes, long long N,
+                              long long C, int chunking, const unsigned char *done)
+{
+    memset(sh, 0, sizeof(*sh));
+    sh->workers = workers;
+    sh->kind = kind;
+    sh->slot_bytes = (long long)slot_bytes;
+    sh->num_tasks = sched_count_tasks(N, C, chunking, workers);
+    sh->tosses_total = N;
+    if (slot_bytes < SCHED_PAGE)
+        memset(sched_slot(sh, 0), 0, workers * slot_bytes);
+
+    long long *tosses = sched_tosses(sh), *starts = sched_starts(sh);
+    long long remaining = N;
+    for (long long t = 0; t < sh->num_tasks; t++)
+    {
+        starts[t] = N - remaining;
+        tosses[t] = sched_next_chunk(remaining, C, chunking, workers);
+        remaining -= tosses[t];
+    }
+
+    struct sched_cell *cells = sched_cells(sh);
+    long long pending = 0;
+    memset(cells, 0, sh->num_tasks * sizeof(struct sched_cell));
+    for (long long t = 0; t < sh->num_tasks; t++)
+    {
+        cells[t].state = (done != NULL && sched_bit(done, t)) ? SCHED_RESUMED : SCHED_TODO;
+        pending += cells[t].state == SCHED_TODO;
+    }
+
+    struct sched_deque *dq = sched_deques(sh);
+    long long *items = sched_items(sh);
+    long long base = 0;
+    for (int w = 0; w < workers; w++)
+    {
+        long long count = (pending - w + workers - 1) / workers;
+        if (count < 0)
+            count = 0;
+        memset(&dq[w], 0, sizeof(dq[w]));
+        dq[w].base = base;
+        dq[w].top = 0;
+        dq[w].bottom = count;
+        base += count;
+    }
+    // The k-th pending task goes to deque k % workers, slot k / workers
+    long long k = 0;
+    for (long long t = 0; t < sh->num_tasks; t++)
+    {
+        if (cells[t].state != SCHED_TODO)
+            continue;
+        struct sched_deque *d = &dq[k % workers];
+        items[d->base + d->bottom - 1 - k / workers] = t;
+        k++;
+    }
+}
+
+// Owner side: take the task at the bottom of deque w, -1 if it is empty
+static inline long long sched_pop(struct sched_shared *sh, int w)
+{
+    struct sched_deque *d = &sched_deques(sh)[w];
+    long long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+    if (t > b)
+    {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    long long task = sched_items(sh)[d->base + b];
+    if (t == b)
+    {
+        // Last task: race the thieves for it
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            task = -1;
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+// Thief side: take the task at the top of deque v.
+// Returns -1 if it is empty, -2 if another thief won the race.
+static inline long long sched_steal(struct sched_shared *sh, int v)
+{
+    struct sched_deque *d = &sched_deques(sh)[v];
+    long long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+
+    if (t >= b)
+        return -1;
+    long long task = sched_items(sh)[d->base + t];
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return -2;
+    return task;
+}
+
+// Own deque first, then random victims. Returns -1 once every deque is
+// empty; nothing is pushed after sched_init, so that means all work is out.
+static inline long long sched_next(struct sched_shared *sh, int w, unsigned long long *rand_state)
+{
+    if (sched_stopped(sh))
+        return -1;
+    long long task = sched_pop(sh, w);
+    if (task >= 0 || sh->workers == 1)
+        return task;
+
+    for (;;)
+    {
+        int lost = 0;
+        // xorshift64 picks where the sweep over victims starts
+        unsigned long long x = *rand_state;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        *rand_state = x;
+        int first = (int)(x % (unsigned long long)sh->workers);
+
+        for (int k = 0; k < sh->workers; k++)
+        {
+            int v = (first + k) % sh->workers;
+            if (v == w)
+                continue;
+            task = sched_steal(sh, v);
+            if (task >= 0)
+            {
+                struct sched_stats *my = sched_slot(sh, w);
+                __atomic_store_n(&my->steals, my->steals + 1, __ATOMIC_RELAXED);
+                return task;
+            }
+            if (task == -2)
+                lost = 1;
+        }
+        if (!lost)
+            return -1;
+    }
+}
+
+#endif
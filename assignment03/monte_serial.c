@@ -1,43 +1,197 @@
+/*
+* File: monte_serial.c
+* Purpose: Serial Monte Carlo estimate in one process: the baseline the
+*          parallel programs are measured against. Takes the same chunked
+*          workload and -R -K -F -S -C -I -d -V options as monte_master, so
+*          equal options give the same result.
+* Build: gcc -O2 monte_serial.c -o monte_serial -lm
+* Author: Sean Balbale
+* Date: 2/13/2026
+*/
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
+#include "monte_variance.h"
+#include "monte_timer.h"
 
 int main(int argc, char *argv[])
 {
-    time_t start, end;
+    struct timer_phases tp;
     long long number_of_tosses = 1000000; // Default
-    long long number_in_circle = 0;
-    long long toss;
-    double x, y, distance_squared, pi_estimate;
+    double sum = 0.0, sumsq = 0.0;
+    long long chunk = 100000; // Same default chunk size as monte_master
+    long long seed = time(NULL);
+    int engine = RNG_DEFAULT;
+    int kernel = KERNEL_AUTO;
+    int integrand = INTEGRAND_PI;
+    int dim = 0;
+    int variance = VARIANCE_NONE;
+    int arith = ARITH_DOUBLE;
+    int check = 0;            // -F check: run both toss paths and compare
+    long long mismatch = 0;   // Sum over chunks of |fixed hits - double hits|
+    long long chunks = 0;
+    double estimate;
 
-    // Parse command-line argument for number of tosses
-    if (argc > 1)
+    // Parse command-line arguments: [tosses] [-R engine] [-K kernel] [-F arith] [-S seed] [-C chunk]
+    // [-I integrand] [-d dim] [-V sampling]
+    for (int i = 1; i < argc; i++)
     {
-        number_of_tosses = atoll(argv[1]);
+        if (argv[i][0] != '-')
+        {
+            number_of_tosses = atoll(argv[i]);
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Missing arg for %s\n", argv[i]);
+            exit(1);
+        }
+        switch (argv[i][1])
+        {
+        case 'R':
+            engine = rng_parse(argv[++i]);
+            if (engine < 0)
+            {
+                fprintf(stderr, "Unknown engine %s (xoshiro, philox, pcg64)\n", argv[i]);
+                exit(1);
+            }
+            break;
+        case 'K':
+            kernel = kernel_parse(argv[++i]);
+            if (kernel < KERNEL_AUTO)
+            {
+                fprintf(stderr, "Unknown kernel %s (auto, scalar, avx2, avx512)\n", argv[i]);
+                exit(1);
+            }
+            break;
+        case 'F':
+            check = strcmp(argv[++i], "check") == 0;
+            arith = check ? ARITH_FIXED : arith_parse(argv[i]);
+            if (arith < 0)
+            {
+                fprintf(stderr, "Unknown toss arithmetic %s (double, fixed, check)\n", argv[i]);
+                exit(1);
+            }
+            break;
+        case 'S':
+            seed = atoll(argv[++i]);
+            break;
+        case 'C':
+            chunk = atoll(argv[++i]);
+            break;
+        case 'I':
+            integrand = integrand_parse(argv[++i]);
+            if (integrand < 0)
+            {
+                fprintf(stderr, "Unknown integrand %s (pi, sphere, gauss, call, asian)\n", argv[i]);
+                exit(1);
+            }
+            break;
+        case 'd':
+            dim = atoi(argv[++i]);
+            break;
+        case 'V':
+            variance = variance_parse(argv[++i]);
+            if (variance < 0)
+            {
+                fprintf(stderr, "Unknown sampling mode %s (none, antithetic, stratified, sobol, halton)\n", argv[i]);
+                exit(1);
+            }
+            break;
+        }
     }
+    if (dim == 0)
+        dim = integrand_default_dim[integrand];
+    if (!integrand_check_dim(integrand, dim))
+    {
+        fprintf(stderr, "-d %d is not a valid dimension for -I %s\n", dim, integrand_names[integrand]);
+        exit(1);
+    }
+    if (!variance_check_dim(variance, dim))
+    {
+        fprintf(stderr, "-V %s supports at most %d dimensions\n", variance_names[variance], VARIANCE_QMC_MAX_DIM);
+        exit(1);
+    }
+    if (!variance_check_integrand(variance, integrand))
+    {
+        fprintf(stderr, "-V antithetic gains nothing on -I %s, which is symmetric about the cube centre\n",
+                integrand_names[integrand]);
+        exit(1);
+    }
+    if (!variance_check_arith(variance, integrand, arith))
+    {
+        fprintf(stderr, "-F %s %s the Pi toss kernels; it needs -I pi -V none\n", check ? "check" : "fixed",
+                check ? "compares" : "only changes");
+        exit(1);
+    }
+    if (chunk <= 0)
+        chunk = number_of_tosses > 0 ? number_of_tosses : 1;
 
-    printf("Tosses: %lld\n", number_of_tosses);
-
-    start = time(NULL);
+    kernel = kernel_resolve(kernel);
+    printf("Tosses: %lld, R=%s, K=%s, F=%s, S=%lld, I=%s, d=%d, V=%s\n", number_of_tosses, rng_name(engine),
+           kernel_name(kernel), check ? "check" : arith_names[arith], seed, integrand_names[integrand], dim,
+           variance_names[variance]);
 
-    srand(time(NULL)); // Seed random number generator
+    timer_start(&tp);
 
-    for (toss = 0; toss < number_of_tosses; toss++)
+    // Walk the same (seed, task) streams the master hands out, so a serial
+    // run with equal -S/-C reproduces the parallel result exactly
+    long long task = 0;
+    for (long long done = 0; done < number_of_tosses; done += chunk, task++)
     {
-        // random double between -1 and 1
-        x = (double)rand() / RAND_MAX * 2.0 - 1.0;
-        y = (double)rand() / RAND_MAX * 2.0 - 1.0;
-        distance_squared = x * x + y * y;
-        if (distance_squared <= 1)
-            number_in_circle++;
+        long long n = (number_of_tosses - done > chunk) ? chunk : number_of_tosses - done;
+        struct integrand_sum res =
+            monte_sample(variance, integrand, dim, engine, kernel, arith, (uint64_t)seed, (uint64_t)task, done, n);
+        sum += res.sum;
+        sumsq += res.sumsq;
+        chunks++;
+        if (check)
+        {
+            long long hits = monte_toss(engine, kernel, ARITH_DOUBLE, (uint64_t)seed, (uint64_t)task, n);
+            mismatch += llabs((long long)(res.sum / 4.0) - hits);
+        }
     }
 
-    end = time(NULL);
+    timer_phase(&tp, PHASE_COMPUTE);
 
-    pi_estimate = 4 * number_in_circle / ((double)number_of_tosses);
-    printf("Pi estimate: %f\n", pi_estimate);
-    printf("Elapsed time = %ld seconds\n", end - start);
+    estimate = sum / ((double)number_of_tosses);
+    timer_phase(&tp, PHASE_REDUCE);
+
+    double total = timer_total(&tp);
+    double std_err = stats_stderr_batches(sum, sumsq, number_of_tosses,
+                                          variance_batched(variance) ? chunks : number_of_tosses);
+    if (integrand == INTEGRAND_PI)
+        printf("Pi estimate: %f\n", estimate);
+    else
+        printf("Estimate (%s, d=%d): %.9f\n", integrand_names[integrand], dim, estimate);
+    printf("Standard error = %.3g\n", std_err);
+    if (check)
+    {
+        // A toss can only change sides if it lies within one 2^-31 grid
+        // cell of the circle: about 2pi * sqrt(2) * 2^-31 / 4 of the square
+        double expected = number_of_tosses * 2.0 * M_PI * sqrt(2.0) * 0x1.0p-31 / 4.0;
+        printf("Fixed-point check: hit counts differ by %lld over %lld chunks (at most ~%.2g expected)\n",
+               mismatch, chunks, expected);
+        if (mismatch > 4.0 * expected + 4.0)
+        {
+            fprintf(stderr, "Fixed-point check failed\n");
+            return 1;
+        }
+    }
+    printf("Elapsed time = %.6f seconds\n", total);
+    timer_print_table(&tp);
+    printf("{\"program\":\"monte_serial\",\"mode\":\"serial\",\"workers\":1,\"N\":%lld,\"C\":%lld,"
+           "\"seed\":%lld,\"engine\":\"%s\",\"kernel\":\"%s\",\"arith\":\"%s\",\"tosses\":%lld,\"integrand\":\"%s\",\"dim\":%d,"
+           "\"variance\":\"%s\",\"estimate\":%.12f,\"stderr\":%.9g,",
+           number_of_tosses, chunk, seed, rng_name(engine), kernel_name(kernel), arith_names[arith], number_of_tosses,
+           integrand_names[integrand], dim, variance_names[variance], estimate, std_err);
+    if (integrand == INTEGRAND_PI)
+        printf("\"pi\":%.12f,", estimate);
+    timer_print_json(stdout, &tp);
+    printf(",\"tosses_per_sec\":%.1f}\n", total > 0 ? number_of_tosses / total : 0.0);
 
     return 0;
 }
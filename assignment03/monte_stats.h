@@ -0,0 +1,96 @@
+/*
+* File: monte_stats.h
+* Purpose: Error estimates for the Monte Carlo programs: the normal CDF and
+*          quantile, and the confidence-interval half-width of a sample
+*          mean kept as (sum, sum of squares).
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_STATS_H
+#define MONTE_STATS_H
+
+#include <math.h>
+
+// Inverse of the standard normal CDF for p in (0, 1).
+// Acklam's rational approximation (|relative error| < 1.2e-9).
+static inline double stats_norm_quantile(double p)
+{
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                               1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                               6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                               -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                               3.754408661907416e+00};
+    double q, r;
+
+    if (p <= 0.0)
+        return -INFINITY;
+    if (p >= 1.0)
+        return INFINITY;
+    if (p < 0.02425)
+    {
+        q = sqrt(-2.0 * log(p));
+        return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0);
+    }
+    if (p > 1.0 - 0.02425)
+    {
+        q = sqrt(-2.0 * log(1.0 - p));
+        return -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0);
+    }
+    q = p - 0.5;
+    r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+           (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1.0);
+}
+
+static inline double stats_norm_cdf(double x)
+{
+    return 0.5 * erfc(-x * 0.70710678118654752440); // x / sqrt(2)
+}
+
+// Two-sided normal quantile z such that P(|Z| <= z) = confidence
+static inline double stats_z_score(double confidence)
+{
+    return stats_norm_quantile(1.0 - (1.0 - confidence) / 2.0);
+}
+
+// Standard error of the mean of n samples with the given sum and sum of
+// squares. For Pi (samples 4 or 0) this is the binomial 4*sqrt(p(1-p)/n).
+static inline double stats_stderr(double sum, double sumsq, long long n)
+{
+    if (n <= 0)
+        return INFINITY;
+    double mean = sum / n;
+    double var = sumsq / n - mean * mean;
+    return var > 0 ? sqrt(var / n) : 0.0;
+}
+
+// Standard error of the mean when the n samples come in `batches` batches
+// that are independent of each other but not inside (stratified or
+// quasi-random chunks). sumsq then holds size * mean^2 of each batch, and
+// the spread of the batch means gives the error. batches = n is the
+// independent case above.
+static inline double stats_stderr_batches(double sum, double sumsq, long long n, long long batches)
+{
+    if (batches == n)
+        return stats_stderr(sum, sumsq, n);
+    if (n <= 0 || batches <= 1)
+        return INFINITY;
+    double mean = sum / n;
+    double var = sumsq / n - mean * mean;
+    return var > 0 ? sqrt(var / (batches - 1)) : 0.0;
+}
+
+// Half-width of the z-level confidence interval on sum / n; batches = n
+// when the samples are independent
+static inline double stats_halfwidth(double sum, double sumsq, long long n, long long batches, double z)
+{
+    return z * stats_stderr_batches(sum, sumsq, n, batches);
+}
+
+#endif
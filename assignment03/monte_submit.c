@@ -0,0 +1,115 @@
+/*
+* File: monte_submit.c
+* Purpose: Client for monte_workerd. Sends one or more jobs (the same
+*          options as monte_master: -N -C -S -R -K -F -I -d -V) over the
+*          daemon's UNIX socket and prints each JSON reply as it arrives.
+*          -n COUNT submits COUNT jobs with seeds S, S+1, ..., keeping up
+*          to -w of them in flight, and reports the job rate at the end.
+* Build: gcc -O2 monte_submit.c -o monte_submit
+* Run:   ./monte_submit [--socket PATH] [-n count] [-w window] -N 1000000 -S 7
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "monte_timer.h"
+
+#define POOL_SOCKET_DEFAULT "monte_workerd.sock" // Must match monte_pool.h
+#define POOL_LINE_MAX 512
+
+int main(int argc, char *argv[])
+{
+    const char *path = POOL_SOCKET_DEFAULT;
+    long long count = 1;
+    long long window = 64; // Jobs in flight; replies must fit the socket buffer meanwhile
+    long long seed = 1;
+    char opts[POOL_LINE_MAX] = "";
+    size_t used = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Missing arg for %s\n", argv[i]);
+            exit(1);
+        }
+        if (strcmp(argv[i], "--socket") == 0)
+            path = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0)
+            count = atoll(argv[++i]);
+        else if (strcmp(argv[i], "-w") == 0)
+            window = atoll(argv[++i]);
+        else if (strcmp(argv[i], "-S") == 0)
+            seed = atoll(argv[++i]);
+        else
+        {
+            // Job option: passed on to the daemon as is
+            used += snprintf(opts + used, sizeof(opts) - used, "%s %s ", argv[i], argv[i + 1]);
+            i++;
+            if (used >= sizeof(opts))
+            {
+                fprintf(stderr, "Too many job options\n");
+                exit(1);
+            }
+        }
+    }
+    if (count < 1 || window < 1)
+    {
+        fprintf(stderr, "-n and -w must be positive\n");
+        exit(1);
+    }
+
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    FILE *replies = fdopen(fd, "r");
+    if (replies == NULL)
+    {
+        perror("fdopen");
+        exit(1);
+    }
+
+    long long start_ns = timer_ns();
+    long long sent = 0, received = 0, failed = 0;
+    char line[POOL_LINE_MAX * 2];
+    while (received < count)
+    {
+        while (sent < count && sent - received < window)
+        {
+            int len = snprintf(line, sizeof(line), "%s-S %lld\n", opts, seed + sent);
+            if (write(fd, line, len) != len)
+            {
+                perror("write");
+                exit(1);
+            }
+            if (++sent == count)
+                shutdown(fd, SHUT_WR); // Nothing more to send; replies still come
+        }
+        if (fgets(line, sizeof(line), replies) == NULL)
+        {
+            fprintf(stderr, "monte_workerd closed the connection after %lld of %lld replies\n", received, count);
+            exit(1);
+        }
+        fputs(line, stdout);
+        failed += strstr(line, "\"error\"") != NULL;
+        received++;
+    }
+    double elapsed = (timer_ns() - start_ns) * 1e-9;
+    if (count > 1)
+        fprintf(stderr, "%lld jobs in %.6f seconds (%.1f jobs/s)\n", count, elapsed,
+                elapsed > 0 ? count / elapsed : 0.0);
+    fclose(replies);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+/*
+* File: monte_timer.h
+* Purpose: CLOCK_MONOTONIC phase timing for the Monte Carlo Pi programs.
+*          A run is split into setup, spawn, dispatch, compute, reduce and
+*          teardown phases, printed as a table and as one JSON line so runs
+*          can be compared between builds.
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_TIMER_H
+#define MONTE_TIMER_H
+
+#include <stdio.h>
+#include <time.h>
+
+enum timer_phase
+{
+    PHASE_SETUP = 0, // IPC objects, task list, allocations
+    PHASE_SPAWN,     // fork+exec or pthread_create
+    PHASE_DISPATCH,  // Handing out tasks (message queue sends)
+    PHASE_COMPUTE,   // Waiting for the workers to finish the tosses
+    PHASE_REDUCE,    // Summing the per-worker results
+    PHASE_TEARDOWN,  // Removing IPC objects, freeing memory
+    PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = {"setup", "spawn", "dispatch", "compute", "reduce", "teardown"};
+
+struct timer_phases
+{
+    double seconds[PHASE_COUNT];
+    long long mark; // ns timestamp where the current phase began
+};
+
+static inline long long timer_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void timer_start(struct timer_phases *tp)
+{
+    for (int i = 0; i < PHASE_COUNT; i++)
+        tp->seconds[i] = 0.0;
+    tp->mark = timer_ns();
+}
+
+// Charge the time since the last mark to `phase` and start the next one
+static inline void timer_phase(struct timer_phases *tp, int phase)
+{
+    long long now = timer_ns();
+    tp->seconds[phase] += (now - tp->mark) * 1e-9;
+    tp->mark = now;
+}
+
+static inline double timer_total(const struct timer_phases *tp)
+{
+    double total = 0.0;
+    for (int i = 0; i < PHASE_COUNT; i++)
+        total += tp->seconds[i];
+    return total;
+}
+
+static inline void timer_print_table(const struct timer_phases *tp)
+{
+    double total = timer_total(tp);
+    printf("Phase        Seconds      %%\n");
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        printf("%-9s  %9.6f  %5.1f\n", phase_names[i], tp->seconds[i],
+               total > 0 ? 100.0 * tp->seconds[i] / total : 0.0);
+    }
+    printf("%-9s  %9.6f\n", "total", total);
+}
+
+// Emit "phases":{...},"total":x for the JSON summary line
+static inline void timer_print_json(FILE *out, const struct timer_phases *tp)
+{
+    fprintf(out, "\"phases\":{");
+    for (int i = 0; i < PHASE_COUNT; i++)
+        fprintf(out, "%s\"%s\":%.9f", i ? "," : "", phase_names[i], tp->seconds[i]);
+    fprintf(out, "},\"total\":%.9f", timer_total(tp));
+}
+
+#endif
@@ -0,0 +1,310 @@
+/*
+* File: monte_variance.h
+* Purpose: Variance-reduction sampling for the Monte Carlo integrands:
+*          antithetic pairs, stratified sampling of the unit cube, and
+*          Sobol or Halton low-discrepancy points. Each chunk skips ahead to
+*          its own range of the global sequence and draws a random shift
+*          from its (seed, task) stream, so chunks are independent and the
+*          standard error comes from the spread of the chunk means.
+*          Antithetic pairs are refused for pi, sphere and gauss: they are
+*          symmetric about the cube centre, so f(1 - u) = f(u) and a pair
+*          would cost two evaluations for one.
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#ifndef MONTE_VARIANCE_H
+#define MONTE_VARIANCE_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "monte_integrand.h"
+
+// Sampling modes (selected with -V)
+enum variance_kind
+{
+    VARIANCE_NONE = 0,   // i.i.d. uniform points
+    VARIANCE_ANTITHETIC, // Pairs u, 1 - u; one toss is the mean of a pair
+    VARIANCE_STRATIFIED, // k^d equal cells of the cube per chunk, jittered
+    VARIANCE_SOBOL,      // Randomly digit-shifted Sobol points
+    VARIANCE_HALTON,     // Randomly rotated Halton points
+    VARIANCE_COUNT
+};
+
+#define VARIANCE_QMC_MAX_DIM 16
+
+static const char *variance_names[VARIANCE_COUNT] = {"none", "antithetic", "stratified", "sobol", "halton"};
+
+static inline int variance_parse(const char *name)
+{
+    for (int i = 0; i < VARIANCE_COUNT; i++)
+    {
+        if (strcmp(name, variance_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Modes whose points are not independent within a chunk. Their sumsq holds
+// n * mean^2 per chunk and the error is taken over chunks (batch means).
+static inline int variance_batched(int kind)
+{
+    return kind == VARIANCE_STRATIFIED || kind == VARIANCE_SOBOL || kind == VARIANCE_HALTON;
+}
+
+static inline int variance_check_dim(int kind, int dim)
+{
+    if (kind == VARIANCE_SOBOL || kind == VARIANCE_HALTON)
+        return dim <= VARIANCE_QMC_MAX_DIM;
+    return 1;
+}
+
+// Antithetic pairs need an integrand that is not symmetric about the cube
+// centre; on pi, sphere and gauss both halves of a pair are the same value
+static inline int variance_check_integrand(int kind, int integrand)
+{
+    return kind != VARIANCE_ANTITHETIC || integrand == INTEGRAND_CALL || integrand == INTEGRAND_ASIAN;
+}
+
+// -F fixed only changes the Pi toss kernels, which -V modes bypass
+static inline int variance_check_arith(int kind, int integrand, int arith)
+{
+    return arith == ARITH_DOUBLE || (kind == VARIANCE_NONE && integrand == INTEGRAND_PI);
+}
+
+// Joe-Kuo direction numbers (new-joe-kuo-6.21201) for dimensions 2-16:
+// degree s and coefficients a of the primitive polynomial, then m_1..m_s
+static const struct
+{
+    int s, a;
+    uint32_t m[6];
+} sobol_table[VARIANCE_QMC_MAX_DIM - 1] = {
+    {1, 0, {1}},              {2, 1, {1, 3}},           {3, 1, {1, 3, 1}},          {3, 2, {1, 1, 1}},
+    {4, 1, {1, 1, 3, 3}},     {4, 4, {1, 3, 5, 13}},    {5, 2, {1, 1, 5, 5, 17}},   {5, 4, {1, 1, 5, 5, 5}},
+    {5, 7, {1, 1, 7, 11, 19}}, {5, 11, {1, 1, 5, 1, 1}}, {5, 13, {1, 1, 1, 3, 11}}, {5, 14, {1, 3, 5, 5, 31}},
+    {6, 1, {1, 3, 3, 9, 7, 49}}, {6, 13, {1, 1, 1, 15, 21, 21}}, {6, 16, {1, 3, 1, 13, 27, 49}}};
+
+static const int halton_primes[VARIANCE_QMC_MAX_DIM] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+
+// 32-bit direction numbers v[j][b] for the first dim coordinates
+static inline void sobol_directions(uint32_t v[][32], int dim)
+{
+    for (int b = 0; b < 32; b++)
+        v[0][b] = 1u << (31 - b);
+    for (int j = 1; j < dim; j++)
+    {
+        int s = sobol_table[j - 1].s, a = sobol_table[j - 1].a;
+        for (int b = 0; b < 32; b++)
+        {
+            if (b < s)
+            {
+                v[j][b] = sobol_table[j - 1].m[b] << (31 - b);
+                continue;
+            }
+            v[j][b] = v[j][b - s] ^ (v[j][b - s] >> s);
+            for (int i = 1; i < s; i++)
+            {
+                if ((a >> (s - 1 - i)) & 1)
+                    v[j][b] ^= v[j][b - i];
+            }
+        }
+    }
+}
+
+static inline double halton_radical_inverse(uint64_t i, int base)
+{
+    double inv = 1.0 / base, f = inv, v = 0.0;
+    while (i > 0)
+    {
+        v += (double)(i % base) * f;
+        i /= base;
+        f *= inv;
+    }
+    return v;
+}
+
+static inline __attribute__((always_inline)) void variance_add(struct integrand_sum *s, double f)
+{
+    s->sum += f;
+    s->sumsq += f * f;
+}
+
+// Close a batched chunk: one batch mean in place of the point values
+static inline struct integrand_sum variance_batch(double sum, long long n)
+{
+    struct integrand_sum s = {sum, n > 0 ? sum * sum / n : 0.0};
+    return s;
+}
+
+// The chunk bodies below are inlined through INTEGRAND_BY_DIM like the
+// plain integrands, so dim is a constant for d <= 8.
+
+static inline __attribute__((always_inline)) struct integrand_sum antithetic_chunk(int dim, int kind, rng_t *r,
+                                                                                   long long n)
+{
+    double u[INTEGRAND_MAX_DIM], w[INTEGRAND_MAX_DIM];
+    struct integrand_sum s = {0.0, 0.0};
+    for (long long i = 0; i < n; i++)
+    {
+#pragma GCC unroll 8
+        for (int k = 0; k < dim; k++)
+        {
+            u[k] = integrand_u01_open(r);
+            w[k] = 1.0 - u[k];
+        }
+        variance_add(&s, 0.5 * (integrand_eval(kind, dim, u) + integrand_eval(kind, dim, w)));
+    }
+    return s;
+}
+
+// The largest k with k^dim <= n cells, q points in each, and the n - q k^dim
+// left over drawn from the whole cube; every cell has the same volume, so
+// the plain mean stays unbiased
+static inline __attribute__((always_inline)) struct integrand_sum stratified_chunk(int dim, int kind, rng_t *r,
+                                                                                   long long n)
+{
+    double u[INTEGRAND_MAX_DIM];
+    long long k = 1, cells = 1;
+    while (pow((double)(k + 1), dim) <= (double)n)
+        k++;
+    for (int a = 0; a < dim; a++)
+        cells *= k;
+    long long q = n / cells;
+    double sum = 0.0;
+
+    for (long long h = 0; h < cells; h++)
+    {
+        for (long long rep = 0; rep < q; rep++)
+        {
+            long long idx = h;
+#pragma GCC unroll 8
+            for (int a = 0; a < dim; a++)
+            {
+                u[a] = ((double)(idx % k) + integrand_u01_open(r)) / k;
+                idx /= k;
+            }
+            sum += integrand_eval(kind, dim, u);
+        }
+    }
+    for (long long i = q * cells; i < n; i++)
+    {
+#pragma GCC unroll 8
+        for (int a = 0; a < dim; a++)
+            u[a] = integrand_u01_open(r);
+        sum += integrand_eval(kind, dim, u);
+    }
+    return variance_batch(sum, n);
+}
+
+// Points start .. start + n - 1 of the Sobol sequence (Gray-code order),
+// XORed with a random digital shift
+static inline __attribute__((always_inline)) struct integrand_sum sobol_chunk(int dim, int kind, rng_t *r,
+                                                                              long long start, long long n)
+{
+    uint32_t v[VARIANCE_QMC_MAX_DIM][32], x[VARIANCE_QMC_MAX_DIM], shift[VARIANCE_QMC_MAX_DIM];
+    double u[VARIANCE_QMC_MAX_DIM];
+    uint64_t i = (uint64_t)start;
+    uint64_t gray = i ^ (i >> 1);
+    double sum = 0.0;
+
+    sobol_directions(v, dim);
+    for (int j = 0; j < dim; j++)
+    {
+        shift[j] = (uint32_t)(rng_next(r) >> 32);
+        x[j] = 0;
+        for (int b = 0; b < 32; b++)
+        {
+            if ((gray >> b) & 1)
+                x[j] ^= v[j][b];
+        }
+    }
+    for (long long t = 0; t < n; t++)
+    {
+#pragma GCC unroll 8
+        for (int j = 0; j < dim; j++)
+            u[j] = ((double)(x[j] ^ shift[j]) + 0.5) * 0x1.0p-32;
+        sum += integrand_eval(kind, dim, u);
+
+        // Gray code: the next point differs in one direction number
+        int c = __builtin_ctzll(++i);
+        if (c < 32)
+        {
+#pragma GCC unroll 8
+            for (int j = 0; j < dim; j++)
+                x[j] ^= v[j][c];
+        }
+    }
+    return variance_batch(sum, n);
+}
+
+// Points start + 1 .. start + n of the Halton sequence, rotated by a random
+// shift modulo 1
+static inline __attribute__((always_inline)) struct integrand_sum halton_chunk(int dim, int kind, rng_t *r,
+                                                                               long long start, long long n)
+{
+    double u[VARIANCE_QMC_MAX_DIM], shift[VARIANCE_QMC_MAX_DIM];
+    double sum = 0.0;
+
+    for (int j = 0; j < dim; j++)
+        shift[j] = integrand_u01_open(r);
+    for (long long t = 0; t < n; t++)
+    {
+#pragma GCC unroll 8
+        for (int j = 0; j < dim; j++)
+        {
+            u[j] = halton_radical_inverse((uint64_t)(start + t + 1), halton_primes[j]) + shift[j];
+            if (u[j] >= 1.0)
+                u[j] -= 1.0;
+            if (u[j] <= 0.0)
+                u[j] = 0x1.0p-53;
+        }
+        sum += integrand_eval(kind, dim, u);
+    }
+    return variance_batch(sum, n);
+}
+
+static inline struct integrand_sum variance_antithetic(int kind, int dim, rng_t *r, long long n)
+{
+    INTEGRAND_BY_DIM(antithetic_chunk, dim, kind, r, n)
+}
+
+static inline struct integrand_sum variance_stratified(int kind, int dim, rng_t *r, long long n)
+{
+    INTEGRAND_BY_DIM(stratified_chunk, dim, kind, r, n)
+}
+
+static inline struct integrand_sum variance_sobol(int kind, int dim, rng_t *r, long long start, long long n)
+{
+    INTEGRAND_BY_DIM(sobol_chunk, dim, kind, r, start, n)
+}
+
+static inline struct integrand_sum variance_halton(int kind, int dim, rng_t *r, long long start, long long n)
+{
+    INTEGRAND_BY_DIM(halton_chunk, dim, kind, r, start, n)
+}
+
+// One chunk of n tosses starting at toss `start` of the run, sampled with
+// mode `variance`. VARIANCE_NONE is integrand_run, SIMD kernels included.
+static inline struct integrand_sum monte_sample(int variance, int kind, int dim, int engine, int kernel, int arith,
+                                                uint64_t seed, uint64_t task, long long start, long long n)
+{
+    if (variance == VARIANCE_NONE)
+        return integrand_run(kind, dim, engine, kernel, arith, seed, task, n);
+
+    rng_t r;
+    rng_seed(&r, engine, seed, task);
+    switch (variance)
+    {
+    case VARIANCE_ANTITHETIC:
+        return variance_antithetic(kind, dim, &r, n);
+    case VARIANCE_STRATIFIED:
+        return variance_stratified(kind, dim, &r, n);
+    case VARIANCE_SOBOL:
+        return variance_sobol(kind, dim, &r, start, n);
+    default:
+        return variance_halton(kind, dim, &r, start, n);
+    }
+}
+
+#endif
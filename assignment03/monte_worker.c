@@ -1,7 +1,15 @@
 /*
 * File: monte_worker.c
 * Purpose: Worker process for Monte Carlo Pi estimation using System V IPC
-*          Receives tasks from master, performs calculations, and updates shared memory.
+*          Receives tasks from master, performs calculations, and records results
+*          in its own slot in shared memory.
+*          In steal mode (-D steal) tasks come from per-worker deques in shared
+*          memory instead of the message queue.
+*          -I/-d select the integrand; each chunk records the sum and sum
+*          of squares of its samples; -V picks the sampling mode.
+*          Under --pin the worker touches its result slot first, so the page
+*          is placed on the NUMA node of the CPU the master pinned it to.
+* Build: gcc -O2 monte_worker.c -o monte_worker -lm
 * Author: Sean Balbale
 * Date: 2/13/2026
 */
@@ -13,15 +21,16 @@
 #include <sys/ipc.h>
 #include <sys/msg.h>
 #include <sys/shm.h>
-#include <sys/sem.h>
 #include <signal.h>
 #include <time.h>
 #include <errno.h>
+#include "monte_variance.h"
+#include "monte_sched.h"
+#include "monte_timer.h"
 
 // IPC Definitions - Must match master
 #define SHM_KEY_PATH "monte_master.c"
 #define SHM_KEY_ID 65
-#define SEM_KEY_ID 66
 #define MSG_KEY_ID 67
 
 // Message Buffer structure
@@ -29,6 +38,7 @@ struct msg_buf
 {
     long mtype;
     long long tosses;
+    long long task; // Task index, selects the RNG stream
 };
 
 // Global flags for signal handling
@@ -54,25 +64,106 @@ void sig_handler(int signo)
 
 int main(int argc, char *argv[])
 {
-    int seed = 1;
-    if (argc > 1)
+    long long seed = 1;
+    int engine = RNG_DEFAULT;
+    int kernel = KERNEL_AUTO;
+    int index = 0;
+    int mode = SCHED_QUEUE;
+    int integrand = INTEGRAND_PI;
+    int dim = 2;
+    int variance = VARIANCE_NONE;
+    int arith = ARITH_DOUBLE;
+
+    // Parse arguments: -i index -S seed -R engine -K kernel -F arith -D mode -I integrand -d dim -V sampling
+    for (int i = 1; i + 1 < argc; i++)
     {
-        seed = atoi(argv[1]);
+        if (argv[i][0] != '-')
+            continue;
+        switch (argv[i][1])
+        {
+        case 'i':
+            index = atoi(argv[++i]);
+            break;
+        case 'D':
+            mode = sched_parse(argv[++i]);
+            if (mode < 0)
+            {
+                fprintf(stderr, "worker: unknown dispatch mode %s\n", argv[i]);
+                exit(1);
+            }
+            break;
+        case 'S':
+            seed = atoll(argv[++i]);
+            break;
+        case 'I':
+            integrand = integrand_parse(argv[++i]);
+            if (integrand < 0)
+            {
+                fprintf(stderr, "worker: unknown integrand %s\n", argv[i]);
+                exit(1);
+            }
+            break;
+        case 'd':
+            dim = atoi(argv[++i]);
+            break;
+        case 'V':
+            variance = variance_parse(argv[++i]);
+            if (variance < 0)
+            {
+                fprintf(stderr, "worker: unknown sampling mode %s\n", argv[i]);
+                exit(1);
+            }
+            break;
+        case 'R':
+            engine = rng_parse(argv[++i]);
+            if (engine < 0)
+            {
+                fprintf(stderr, "worker: unknown engine %s\n", argv[i]);
+                exit(1);
+            }
+            break;
+        case 'K':
+            kernel = kernel_parse(argv[++i]);
+            if (kernel < KERNEL_AUTO)
+            {
+                fprintf(stderr, "worker: unknown kernel %s\n", argv[i]);
+                exit(1);
+            }
+            break;
+        case 'F':
+            arith = arith_parse(argv[++i]);
+            if (arith < 0)
+            {
+                fprintf(stderr, "worker: unknown toss arithmetic %s\n", argv[i]);
+                exit(1);
+            }
+            break;
+        }
+    }
+    kernel = kernel_resolve(kernel);
+    if (!integrand_check_dim(integrand, dim) || !variance_check_dim(variance, dim))
+    {
+        fprintf(stderr, "worker: bad dimension %d for %s\n", dim, integrand_names[integrand]);
+        exit(1);
     }
-    srand(seed);
 
     signal(SIGINT, sig_handler);
     signal(SIGUSR1, sig_handler);
     signal(SIGUSR2, sig_handler);
+    sigset_t pause_set;
+    sigemptyset(&pause_set);
+    sigaddset(&pause_set, SIGINT);
+    sigaddset(&pause_set, SIGUSR1);
+    sigaddset(&pause_set, SIGUSR2);
 
-    // Get Shared Memory
+    // Get Shared Memory (task list, deques, per-worker result slots)
     key_t key = ftok(SHM_KEY_PATH, SHM_KEY_ID);
     if (key == -1)
     {
         perror("worker ftok");
         exit(1);
     }
-    int shmid = shmget(key, sizeof(long long), 0666); // Only get existing, no creation
+    int shmid = shmget(key, 0, 0666); // Only get existing, no creation
     if (shmid < 0)
     {
         if (errno == ENOENT)
@@ -87,53 +178,58 @@ int main(int argc, char *argv[])
     }
 
     // Attach Shared Memory
-    long long *global_count = (long long *)shmat(shmid, NULL, 0);
-
-    // Get Semaphore
-    key_t sem_key = ftok(SHM_KEY_PATH, SEM_KEY_ID); // Must match master
-    if (sem_key == -1)
-    {
-        perror("worker ftok sem");
-        exit(1);
-    }
-    int semid = semget(sem_key, 1, 0666); // Only get existing, no creation
-    if (semid < 0)
+    struct sched_shared *sh = (struct sched_shared *)shmat(shmid, NULL, 0);
+    if (sh == (void *)-1 || index < 0 || index >= sh->workers)
     {
-        perror("worker semget");
+        fprintf(stderr, "worker: bad shared segment or index %d\n", index);
         exit(1);
     }
+    long long *tosses = sched_tosses(sh), *starts = sched_starts(sh);
+    unsigned long long rand_state = 0x9E3779B97F4A7C15ULL * (index + 1);
+    sched_touch_slot(sh, index); // The master pinned us before exec
 
-    // Get Message Queue
-    key_t msg_key = ftok(SHM_KEY_PATH, MSG_KEY_ID); // Must match master
-    if (msg_key == -1)
+    // Get Message Queue (queue mode only)
+    int msgid = -1;
+    if (mode == SCHED_QUEUE)
     {
-        perror("worker ftok msg");
-        exit(1);
-    }
-    int msgid = msgget(msg_key, 0666); // Only get existing, no creation
-    if (msgid < 0)
-    {
-        perror("worker msgget");
-        exit(1);
+        key_t msg_key = ftok(SHM_KEY_PATH, MSG_KEY_ID); // Must match master
+        if (msg_key == -1)
+        {
+            perror("worker ftok msg");
+            exit(1);
+        }
+        msgid = msgget(msg_key, 0666); // Only get existing, no creation
+        if (msgid < 0)
+        {
+            perror("worker msgget");
+            exit(1);
+        }
     }
 
     struct msg_buf msg;
-    // Semaphore Operations
-    struct sembuf p_op = {0, -1, 0}; // Wait / Lock
-    struct sembuf v_op = {0, 1, 0};  // Signal / Unlock
 
     while (!terminate)
     {
-        // Handle Pausing
+        // Handle Pausing: test the flag with the signals blocked and let
+        // sigsuspend unblock them atomically, so SIGUSR2 cannot be missed
+        sigset_t orig;
+        sigprocmask(SIG_BLOCK, &pause_set, &orig);
         while (paused && !terminate)
-        {
-            sleep(1);
-        }
+            sigsuspend(&orig);
+        sigprocmask(SIG_SETMASK, &orig, NULL);
         if (terminate)
             break;
 
+        if (mode == SCHED_STEAL)
+        {
+            // Own deque first, then randomized stealing; -1 means all done
+            msg.task = sched_next(sh, index, &rand_state);
+            if (msg.task < 0)
+                break;
+            msg.tosses = tosses[msg.task];
+        }
         // Receive task from Queue (Blocking)
-        if (msgrcv(msgid, &msg, sizeof(long long), 1, 0) == -1)
+        else if (msgrcv(msgid, &msg, sizeof(msg) - sizeof(long), 1, 0) == -1)
         {
             if (errno == EIDRM || errno == EINVAL)
             {
@@ -157,25 +253,23 @@ int main(int argc, char *argv[])
             break;
         }
 
-        // Perform Calculation
-        long long local_in_circle = 0;
-        double x, y, dist;
-        for (long long i = 0; i < msg.tosses; i++)
-        {
-            x = (double)rand() / RAND_MAX * 2.0 - 1.0;
-            y = (double)rand() / RAND_MAX * 2.0 - 1.0;
-            dist = x * x + y * y;
-            if (dist <= 1.0)
-                local_in_circle++;
-        }
+        // Master reached its target accuracy: drop queued tasks unrun
+        if (sched_stopped(sh))
+            continue;
+        sched_claim(sh, index, msg.tosses);
+
+        // Perform Calculation on the stream owned by this task
+        long long t0 = timer_ns();
+        struct integrand_sum res = monte_sample(variance, integrand, dim, engine, kernel, arith, (uint64_t)seed,
+                                                (uint64_t)msg.task, starts[msg.task], msg.tosses);
+        long long elapsed = timer_ns() - t0;
 
-        // Critical Section: Update Global Count
-        semop(semid, &p_op, 1); // Lock
-        *global_count += local_in_circle;
-        semop(semid, &v_op, 1); // Unlock
+        // Publish in this worker's own slot (with the chunk's compute time):
+        // no lock, no syscall
+        sched_record(sh, index, msg.task, res.sum, res.sumsq, msg.tosses, elapsed);
     }
 
     // Detach shared memory and exit
-    shmdt(global_count);
+    shmdt(sh);
     return 0;
 }
@@ -0,0 +1,554 @@
+/*
+* File: monte_workerd.c
+* Purpose: Persistent worker pool for short Monte Carlo jobs. monte_master
+*          pays for the IPC setup, M fork+exec calls and the teardown on
+*          every run; the daemon does that once. It maps the job table
+*          (monte_pool.h), forks W warm workers that stay attached to it,
+*          and serves jobs over a UNIX stream socket. Each request is one
+*          line of monte_master options (-N -C -S -R -K -F -I -d -V); the
+*          reply is one JSON line with the estimate, tagged with the
+*          request's sequence number on that connection. Up to
+*          POOL_MAX_JOBS jobs run at once, chunk by chunk in turn; the rest
+*          wait, and a freed slot goes to the oldest job of the client with
+*          the fewest running, so one client's burst cannot keep the others
+*          out of the pool. A client may shut down its sending side
+*          and still collect its replies; one that disconnects has its jobs
+*          cancelled.
+* Build: gcc -O2 monte_workerd.c -o monte_workerd -lm
+* Run:   ./monte_workerd [-W workers] [--socket PATH] &
+*        ./monte_submit -N 10000000 -S 7     (or: echo "-N 1000000" | nc -U monte_workerd.sock)
+* Author: Sean Balbale
+* Date: 10/17/2026
+*/
+
+#define _GNU_SOURCE // ppoll
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include "monte_pool.h"
+#include "monte_timer.h"
+
+#define MAX_CLIENTS 64
+#define MAX_PENDING 1024
+
+// A connection and its partial request line
+struct client
+{
+    int fd;        // -1 = unused
+    int eof;       // Sent everything; closed once its jobs are answered
+    int jobs;      // Waiting or running
+    int running;   // Holding a slot
+    long long seq; // Requests read so far; the next one gets seq + 1
+    size_t len;
+    char buf[POOL_LINE_MAX];
+};
+
+// A job that is waiting for a slot or running in one
+struct request
+{
+    int client; // Index in clients[], -1 once the client is gone
+    long long seq;
+    long long submit_ns, start_ns;
+    struct pool_job params;
+};
+
+struct client clients[MAX_CLIENTS];
+struct request pending[MAX_PENDING]; // Ring in arrival order
+int pending_head = 0, pending_count = 0;
+struct request running[POOL_MAX_JOBS];
+int slot_busy[POOL_MAX_JOBS];
+unsigned int slot_gen[POOL_MAX_JOBS];
+volatile sig_atomic_t terminate = 0;
+
+void sig_handler(int signo)
+{
+    (void)signo;
+    terminate = 1;
+}
+
+// Worker body: take chunks until the daemon shuts down, sleeping on the
+// job generation while there is nothing to do
+void worker_loop(struct pool_shared *ps, int done_fd)
+{
+    struct pool_job job;
+    long long task;
+    for (;;)
+    {
+        int gen = __atomic_load_n(&ps->work_gen, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&ps->shutdown, __ATOMIC_RELAXED))
+            break;
+        int j = pool_next(ps, &job, &task);
+        if (j < 0)
+        {
+            pool_futex_wait(&ps->work_gen, gen);
+            continue;
+        }
+        if (pool_run(ps, j, &job, task))
+        {
+            uint64_t one = 1;
+            if (write(done_fd, &one, sizeof(one)) < 0)
+                perror("worker eventfd");
+        }
+    }
+    exit(0);
+}
+
+// Forget a client: cancel its running jobs, drop its waiting ones
+void drop_client(struct pool_shared *ps, int c)
+{
+    close(clients[c].fd);
+    clients[c].fd = -1;
+    for (int j = 0; j < POOL_MAX_JOBS; j++)
+    {
+        if (slot_busy[j] && running[j].client == c)
+        {
+            running[j].client = -1;
+            __atomic_store_n(&ps->jobs[j].cancel, 1, __ATOMIC_RELAXED);
+        }
+    }
+    for (int k = 0; k < pending_count; k++)
+    {
+        struct request *req = &pending[(pending_head + k) % MAX_PENDING];
+        if (req->client == c)
+            req->client = -1;
+    }
+}
+
+// Send one reply line. Client sockets are non-blocking: a client that
+// does not read its replies is dropped rather than stalling the daemon.
+void send_line(struct pool_shared *ps, int c, const char *line)
+{
+    size_t len = strlen(line);
+    if (send(clients[c].fd, line, len, MSG_NOSIGNAL) != (ssize_t)len)
+        drop_client(ps, c);
+}
+
+void send_error(struct pool_shared *ps, int c, long long seq, const char *msg)
+{
+    char line[POOL_LINE_MAX];
+    snprintf(line, sizeof(line), "{\"program\":\"monte_workerd\",\"seq\":%lld,\"error\":\"%s\"}\n", seq, msg);
+    send_line(ps, c, line);
+}
+
+// Parse one request line into job parameters. Returns NULL, or what is wrong.
+const char *parse_request(char *line, struct pool_job *job)
+{
+    char *save = NULL;
+    memset(job, 0, sizeof(*job));
+    job->N = 1000000;
+    job->C = 100000;
+    job->S = 1;
+    job->R = RNG_DEFAULT;
+    job->K = KERNEL_AUTO;
+    job->I = INTEGRAND_PI;
+    job->V = VARIANCE_NONE;
+    job->F = ARITH_DOUBLE;
+
+    for (char *opt = strtok_r(line, " \t\r", &save); opt != NULL; opt = strtok_r(NULL, " \t\r", &save))
+    {
+        char *arg = strtok_r(NULL, " \t\r", &save);
+        if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0')
+            return "unknown option";
+        if (arg == NULL)
+            return "missing argument";
+        switch (opt[1])
+        {
+        case 'N':
+            job->N = atoll(arg);
+            break;
+        case 'C':
+            job->C = atoll(arg);
+            break;
+        case 'S':
+            job->S = atoi(arg);
+            break;
+        case 'R':
+            job->R = rng_parse(arg);
+            break;
+        case 'K':
+            job->K = kernel_parse(arg);
+            break;
+        case 'F':
+            job->F = arith_parse(arg);
+            break;
+        case 'I':
+            job->I = integrand_parse(arg);
+            break;
+        case 'd':
+            job->dim = atoi(arg);
+            break;
+        case 'V':
+            job->V = variance_parse(arg);
+            break;
+        default:
+            return "unknown option";
+        }
+    }
+    if (job->R < 0 || job->K < KERNEL_AUTO || job->F < 0 || job->I < 0 || job->V < 0)
+        return "unknown engine, kernel, arithmetic, integrand or sampling mode";
+    if (job->dim == 0)
+        job->dim = integrand_default_dim[job->I];
+    if (!integrand_check_dim(job->I, job->dim) || !variance_check_dim(job->V, job->dim))
+        return "bad dimension";
+    if (!variance_check_integrand(job->V, job->I))
+        return "-V antithetic gains nothing on a symmetric integrand";
+    if (!variance_check_arith(job->V, job->I, job->F))
+        return "-F fixed needs -I pi -V none";
+    if (job->N <= 0 || job->C <= 0)
+        return "-N and -C must be positive";
+    if ((job->N + job->C - 1) / job->C > POOL_MAX_TASKS)
+        return "too many chunks; raise -C";
+    job->K = kernel_resolve(job->K);
+    return NULL;
+}
+
+// The waiting job to admit next: the oldest one of the client holding
+// the fewest slots, so clients take turns. Jobs of departed clients go
+// first, to be thrown away. Returns its position in the ring.
+int pick_pending(void)
+{
+    int best = 0, fewest = POOL_MAX_JOBS + 1;
+    for (int k = 0; k < pending_count; k++)
+    {
+        int c = pending[(pending_head + k) % MAX_PENDING].client;
+        if (c < 0)
+            return k;
+        if (clients[c].running < fewest)
+        {
+            best = k;
+            fewest = clients[c].running;
+        }
+    }
+    return best;
+}
+
+// Move waiting jobs into free slots, taking the clients in turn
+void admit_pending(struct pool_shared *ps)
+{
+    int j = 0;
+    while (pending_count > 0)
+    {
+        while (j < POOL_MAX_JOBS && slot_busy[j])
+            j++;
+        if (j == POOL_MAX_JOBS)
+            return;
+        int k = pick_pending();
+        struct request req = pending[(pending_head + k) % MAX_PENDING];
+        // Close the gap, keeping the rest in arrival order
+        for (; k > 0; k--)
+            pending[(pending_head + k) % MAX_PENDING] = pending[(pending_head + k - 1) % MAX_PENDING];
+        pending_head = (pending_head + 1) % MAX_PENDING;
+        pending_count--;
+        if (req.client < 0)
+            continue; // Its client left while it waited
+        running[j] = req;
+        running[j].start_ns = timer_ns();
+        slot_busy[j] = 1;
+        clients[req.client].running++;
+        pool_publish(ps, j, &req.params, ++slot_gen[j]);
+    }
+}
+
+// Reduce a finished job in task order and answer its client
+void finish_job(struct pool_shared *ps, int j)
+{
+    struct request *req = &running[j];
+    const struct pool_job *job = &req->params;
+    double sumsq, sum = pool_reduce(ps, j, &sumsq);
+    long long now = timer_ns();
+    long long tasks = ps->jobs[j].num_tasks;
+    double estimate = sum / job->N;
+    double std_err = stats_stderr_batches(sum, sumsq, job->N, variance_batched(job->V) ? tasks : job->N);
+    double run = (now - req->start_ns) * 1e-9;
+    char line[POOL_LINE_MAX * 2];
+
+    slot_busy[j] = 0;
+    if (req->client < 0)
+        return; // Cancelled
+    struct client *cl = &clients[req->client];
+    int len = snprintf(line, sizeof(line),
+                       "{\"program\":\"monte_workerd\",\"seq\":%lld,\"N\":%lld,\"C\":%lld,\"seed\":%d,"
+                       "\"engine\":\"%s\",\"kernel\":\"%s\",\"arith\":\"%s\",\"integrand\":\"%s\",\"dim\":%d,"
+                       "\"variance\":\"%s\",\"tasks\":%lld,\"estimate\":%.12f,\"stderr\":%.9g,",
+                       req->seq, job->N, job->C, job->S, rng_name(job->R), kernel_name(job->K), arith_names[job->F],
+                       integrand_names[job->I], job->dim, variance_names[job->V], tasks, estimate, std_err);
+    if (job->I == INTEGRAND_PI)
+        len += snprintf(line + len, sizeof(line) - len, "\"pi\":%.12f,", estimate);
+    snprintf(line + len, sizeof(line) - len,
+             "\"queue_wait\":%.9f,\"run\":%.9f,\"total\":%.9f,\"tosses_per_sec\":%.1f}\n",
+             (req->start_ns - req->submit_ns) * 1e-9, run, (now - req->submit_ns) * 1e-9,
+             run > 0 ? job->N / run : 0.0);
+    cl->jobs--;
+    cl->running--;
+    send_line(ps, req->client, line);
+    if (cl->fd >= 0 && cl->eof && cl->jobs == 0)
+    {
+        close(cl->fd);
+        cl->fd = -1;
+    }
+}
+
+// A worker finished the last task of some job: find which
+void collect_done(struct pool_shared *ps, int done_fd)
+{
+    uint64_t count;
+    if (read(done_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("eventfd");
+    for (int j = 0; j < POOL_MAX_JOBS; j++)
+    {
+        if (slot_busy[j] &&
+            __atomic_load_n(&ps->jobs[j].done, __ATOMIC_ACQUIRE) == ps->jobs[j].num_tasks)
+            finish_job(ps, j);
+    }
+}
+
+// Read what a client sent and queue every complete line as a job
+void read_client(struct pool_shared *ps, int c)
+{
+    struct client *cl = &clients[c];
+    ssize_t got = read(cl->fd, cl->buf + cl->len, sizeof(cl->buf) - 1 - cl->len);
+    if (got < 0 && errno == EAGAIN)
+        return;
+    if (got < 0)
+    {
+        drop_client(ps, c);
+        return;
+    }
+    if (got == 0)
+    {
+        cl->eof = 1; // Half-closed: answer what is queued, then close
+        if (cl->len > 0)
+            cl->buf[cl->len++] = '\n'; // The last request may lack its newline
+    }
+    cl->len += got;
+
+    char *line = cl->buf, *nl;
+    while (cl->fd >= 0 && (nl = memchr(line, '\n', cl->buf + cl->len - line)) != NULL)
+    {
+        *nl = '\0';
+        long long seq = ++cl->seq;
+        struct pool_job params;
+        const char *err = parse_request(line, &params);
+        line = nl + 1;
+        if (err != NULL)
+            send_error(ps, c, seq, err);
+        else if (pending_count == MAX_PENDING)
+            send_error(ps, c, seq, "queue full");
+        else
+        {
+            struct request *req = &pending[(pending_head + pending_count++) % MAX_PENDING];
+            cl->jobs++;
+            req->client = c;
+            req->seq = seq;
+            req->submit_ns = timer_ns();
+            req->params = params;
+        }
+    }
+    if (cl->fd < 0)
+        return;
+    if (cl->eof && cl->jobs == 0)
+    {
+        close(cl->fd);
+        cl->fd = -1;
+        return;
+    }
+    cl->len -= line - cl->buf;
+    memmove(cl->buf, line, cl->len);
+    if (cl->len == sizeof(cl->buf) - 1)
+    {
+        send_error(ps, c, cl->seq + 1, "request line too long");
+        if (cl->fd >= 0)
+            drop_client(ps, c);
+    }
+}
+
+void accept_client(int listen_fd)
+{
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+    for (int c = 0; c < MAX_CLIENTS; c++)
+    {
+        if (clients[c].fd < 0)
+        {
+            clients[c].fd = fd;
+            clients[c].eof = 0;
+            clients[c].jobs = 0;
+            clients[c].running = 0;
+            clients[c].seq = 0;
+            clients[c].len = 0;
+            return;
+        }
+    }
+    close(fd); // Full
+}
+
+int listen_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path); // Stale socket from an earlier daemon
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Stop the workers and wait for them
+void stop_workers(struct pool_shared *ps)
+{
+    __atomic_store_n(&ps->shutdown, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&ps->work_gen, 1, __ATOMIC_RELEASE);
+    pool_futex_wake(&ps->work_gen);
+    while (wait(NULL) > 0)
+        ;
+}
+
+int main(int argc, char *argv[])
+{
+    int W = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *path = POOL_SOCKET_DEFAULT;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Missing arg for %s\n", argv[i]);
+            exit(1);
+        }
+        if (strcmp(argv[i], "-W") == 0)
+            W = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--socket") == 0)
+            path = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [-W workers] [--socket PATH]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (W < 1 || W > 256)
+    {
+        fprintf(stderr, "-W must be between 1 and 256\n");
+        exit(1);
+    }
+
+    // The job table and every result cell, mapped once and inherited by
+    // the workers; untouched cells cost no memory
+    struct pool_shared *ps = mmap(NULL, pool_size(), PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    int done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ps == MAP_FAILED || done_fd < 0)
+    {
+        perror("monte_workerd setup");
+        exit(1);
+    }
+    ps->workers = W;
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+    for (int i = 0; i < W; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            prctl(PR_SET_PDEATHSIG, SIGTERM); // Never outlive the daemon
+            signal(SIGINT, SIG_IGN);          // ^C is for the daemon; it stops us
+            signal(SIGTERM, SIG_DFL);
+            worker_loop(ps, done_fd);
+        }
+        if (pid < 0)
+        {
+            perror("fork");
+            stop_workers(ps);
+            exit(1);
+        }
+    }
+
+    int listen_fd = listen_unix(path);
+    if (listen_fd < 0)
+    {
+        stop_workers(ps);
+        exit(1);
+    }
+    for (int c = 0; c < MAX_CLIENTS; c++)
+        clients[c].fd = -1;
+    printf("monte_workerd: %d workers on %s (kernel %s)\n", W, path, kernel_name(kernel_resolve(KERNEL_AUTO)));
+    fflush(stdout);
+
+    // One ppoll loop: new connections, requests, finished jobs. Signals are
+    // only let in while it waits.
+    sigset_t block, orig;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigprocmask(SIG_BLOCK, &block, &orig);
+    while (!terminate)
+    {
+        struct pollfd fds[2 + MAX_CLIENTS];
+        int who[2 + MAX_CLIENTS];
+        int n = 0;
+        fds[n].fd = listen_fd;
+        fds[n++].events = POLLIN;
+        fds[n].fd = done_fd;
+        fds[n++].events = POLLIN;
+        for (int c = 0; c < MAX_CLIENTS; c++)
+        {
+            if (clients[c].fd < 0)
+                continue;
+            who[n] = c;
+            fds[n].fd = clients[c].fd;
+            fds[n++].events = clients[c].eof ? 0 : POLLIN; // POLLHUP still reports a full close
+        }
+        if (ppoll(fds, n, NULL, &orig) < 0)
+            continue; // EINTR: terminate is checked above
+
+        if (fds[1].revents & POLLIN)
+            collect_done(ps, done_fd);
+        for (int k = 2; k < n; k++)
+        {
+            if (clients[who[k]].fd < 0)
+                continue; // Dropped while answering a finished job
+            if (fds[k].revents & (POLLHUP | POLLERR))
+                drop_client(ps, who[k]); // Gone for good, not just done sending
+            else if (fds[k].revents & POLLIN)
+                read_client(ps, who[k]);
+        }
+        if (fds[0].revents & POLLIN)
+            accept_client(listen_fd);
+        admit_pending(ps);
+    }
+
+    printf("monte_workerd: shutting down\n");
+    stop_workers(ps);
+    close(listen_fd);
+    unlink(path);
+    for (int c = 0; c < MAX_CLIENTS; c++)
+    {
+        if (clients[c].fd >= 0)
+            close(clients[c].fd);
+    }
+    munmap(ps, pool_size());
+    return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ *  loadgen.c - load generator for the server3 echo service
+ *
+ *  Opens CONNS connections to the server, waits until all of them are
+ *  up, then keeps every one busy for SECONDS: it sends SIZE lowercase
+ *  bytes, waits for all of them to come back uppercased, and sends
+ *  again. Reports round trips per second and their latency.
+ *
+ *  Build and run it with:
+ *
+ *     $ gcc -O2 -pthread loadgen.c -o loadgen
+ *     $ ./loadgen [-c conns] [-s size] [-d seconds] [-t threads] [-p port] [server]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define SAMPLES (1 << 20)	/* latencies kept per thread */
+
+struct lconn {
+	int fd;
+	int up;			/* connected */
+	size_t sent, got;	/* of the round trip in flight */
+	long long t0;
+};
+
+struct worker {
+	pthread_t thread;
+	int nconns;
+	struct lconn *conns;
+	long long connected, failed, trips, bad;
+	double *lat;		/* microseconds, a sample of the round trips */
+	long nlat;
+	unsigned int seed;
+};
+
+static struct sockaddr_in server_address;
+static size_t size = 64;
+static double seconds = 5;
+static char *msg;
+static pthread_barrier_t all_up;
+static long long start_ns, stop_ns;	/* of the timed part */
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of a sorted sample */
+static double percentile(const double *sorted, long n, double p)
+{
+	long rank = (long) (p * n + 0.999999);
+
+	if (rank < 1)
+		rank = 1;
+	if (rank > n)
+		rank = n;
+	return sorted[rank - 1];
+}
+
+static void watch(int epfd, struct lconn *c, unsigned int events)
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.ptr = c;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void drop(int epfd, struct lconn *c, long long *count)
+{
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	c->fd = -1;
+	(*count)++;
+}
+
+/* Send what is left of the round trip in flight */
+static int push(struct lconn *c)
+{
+	while (c->sent < size) {
+		ssize_t n = send(c->fd, msg + c->sent, size - c->sent, MSG_NOSIGNAL);
+		if (n < 0)
+			return errno == EAGAIN ? 0 : -1;
+		c->sent += n;
+	}
+	return 0;
+}
+
+static void start_trip(int epfd, struct lconn *c)
+{
+	c->sent = c->got = 0;
+	c->t0 = now_ns();
+	if (push(c) == 0)
+		watch(epfd, c, c->sent < size ? EPOLLIN | EPOLLOUT : EPOLLIN);
+}
+
+static void *run(void *arg)
+{
+	struct worker *w = arg;
+	struct epoll_event ev[256];
+	char buf[64 * 1024];
+	int epfd = epoll_create1(0), i, n, pending = w->nconns;
+	long long give_up = now_ns() + 10000000000LL;
+
+	/* Open every connection */
+	for (i = 0; i < w->nconns; i++) {
+		struct lconn *c = &w->conns[i];
+		struct epoll_event e;
+		int one = 1;
+
+		c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (connect(c->fd, (struct sockaddr *) &server_address,
+		    sizeof(server_address)) < 0 && errno != EINPROGRESS) {
+			close(c->fd);
+			c->fd = -1;
+			w->failed++;
+			pending--;
+			continue;
+		}
+		e.events = EPOLLOUT;
+		e.data.ptr = c;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &e);
+	}
+	while (pending > 0 && now_ns() < give_up) {
+		n = epoll_wait(epfd, ev, 256, 100);
+		for (i = 0; i < n; i++) {
+			struct lconn *c = ev[i].data.ptr;
+			int err = 0;
+			socklen_t len = sizeof(err);
+
+			if (c->up || c->fd < 0)
+				continue;
+			getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+			pending--;
+			if (err != 0) {
+				drop(epfd, c, &w->failed);
+				continue;
+			}
+			c->up = 1;
+			w->connected++;
+			watch(epfd, c, 0);
+		}
+	}
+	w->failed += pending;
+
+	/* Keep them busy; the clock starts once every thread is ready */
+	if (pthread_barrier_wait(&all_up) == PTHREAD_BARRIER_SERIAL_THREAD) {
+		start_ns = now_ns();
+		stop_ns = start_ns + (long long) (seconds * 1e9);
+	}
+	pthread_barrier_wait(&all_up);
+	for (i = 0; i < w->nconns; i++)
+		if (w->conns[i].up && w->conns[i].fd >= 0)
+			start_trip(epfd, &w->conns[i]);
+	while (now_ns() < stop_ns) {
+		n = epoll_wait(epfd, ev, 256, 100);
+		for (i = 0; i < n; i++) {
+			struct lconn *c = ev[i].data.ptr;
+			ssize_t got;
+
+			if (c->fd < 0)
+				continue;
+			if ((ev[i].events & EPOLLOUT) && push(c) < 0) {
+				drop(epfd, c, &w->failed);
+				continue;
+			}
+			if (!(ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+				if (c->sent == size)
+					watch(epfd, c, EPOLLIN);
+				continue;
+			}
+			while ((got = read(c->fd, buf, sizeof(buf))) > 0) {
+				/* The echo of msg, uppercased */
+				size_t k;
+				for (k = 0; k < (size_t) got; k++)
+					if (buf[k] != msg[(c->got + k) % size] - 'a' + 'A')
+						break;
+				if (k < (size_t) got || c->got + got > c->sent)
+					break;
+				c->got += got;
+			}
+			if (got > 0) {
+				w->bad++;
+				drop(epfd, c, &w->failed);
+				continue;
+			}
+			if (got == 0 || errno != EAGAIN) {
+				drop(epfd, c, &w->failed);
+				continue;
+			}
+			if (c->got == size) {
+				long long t1 = now_ns();
+				double us = (t1 - c->t0) / 1000.0;
+				if (w->nlat < SAMPLES)
+					w->lat[w->nlat++] = us;
+				else if (rand_r(&w->seed) % w->trips < SAMPLES)
+					w->lat[rand_r(&w->seed) % SAMPLES] = us;
+				w->trips++;
+				if (t1 < stop_ns)
+					start_trip(epfd, c);
+			} else if (c->sent < size && push(c) < 0) {
+				drop(epfd, c, &w->failed);
+			}
+		}
+	}
+	for (i = 0; i < w->nconns; i++)
+		if (w->conns[i].fd >= 0)
+			close(w->conns[i].fd);
+	close(epfd);
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct hostent *host;
+	struct worker *w;
+	struct rlimit rl;
+	int conns = 1000, threads = 1, port = 6996, opt, i;
+	long long connected = 0, failed = 0, trips = 0, bad = 0;
+	long nlat = 0;
+	double *lat, sum = 0;
+
+	while ((opt = getopt(argc, argv, "c:s:d:t:p:")) != -1) {
+		switch (opt) {
+		case 'c':
+			conns = atoi(optarg);
+			break;
+		case 's':
+			size = atol(optarg);
+			break;
+		case 'd':
+			seconds = atof(optarg);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c conns] [-s size] [-d seconds] "
+			    "[-t threads] [-p port] [server]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (conns < 1 || threads < 1 || threads > conns || size < 1 || seconds <= 0) {
+		fprintf(stderr, "%s: need 1 <= threads <= conns, size >= 1, seconds > 0\n", argv[0]);
+		exit(1);
+	}
+	host = gethostbyname(optind < argc ? argv[optind] : "localhost");
+	if (host == (struct hostent *) NULL) {
+		perror("gethostbyname ");
+		exit(2);
+	}
+	memset(&server_address, 0, sizeof(server_address));
+	server_address.sin_family = AF_INET;
+	memcpy(&server_address.sin_addr, host->h_addr, host->h_length);
+	server_address.sin_port = htons(port);
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	msg = malloc(size);
+	for (i = 0; i < (int) size; i++)
+		msg[i] = 'a' + i % 26;
+
+	w = calloc(threads, sizeof(*w));
+	pthread_barrier_init(&all_up, NULL, threads);
+	for (i = 0; i < threads; i++) {
+		w[i].nconns = conns / threads + (i < conns % threads);
+		w[i].conns = calloc(w[i].nconns, sizeof(struct lconn));
+		w[i].lat = malloc(SAMPLES * sizeof(double));
+		w[i].seed = i + 1;
+		pthread_create(&w[i].thread, NULL, run, &w[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		connected += w[i].connected;
+		failed += w[i].failed;
+		trips += w[i].trips;
+		bad += w[i].bad;
+		nlat += w[i].nlat;
+	}
+
+	lat = malloc((nlat > 0 ? nlat : 1) * sizeof(double));
+	for (nlat = 0, i = 0; i < threads; i++) {
+		memcpy(lat + nlat, w[i].lat, w[i].nlat * sizeof(double));
+		nlat += w[i].nlat;
+	}
+	for (i = 0; i < nlat; i++)
+		sum += lat[i];
+	qsort(lat, nlat, sizeof(double), cmp_double);
+	printf("%lld of %d connections up, %lld failed, %lld bad echoes\n",
+	    connected, conns, failed, bad);
+	printf("%lld round trips of %zu bytes in %.1f s: %.0f/s\n",
+	    trips, size, seconds, trips / seconds);
+	if (nlat > 0)
+		printf("latency us: mean %.1f  p50 %.1f  p99 %.1f  max %.1f\n",
+		    sum / nlat, percentile(lat, nlat, 0.50),
+		    percentile(lat, nlat, 0.99), lat[nlat - 1]);
+	exit(bad > 0 || connected == 0);
+}
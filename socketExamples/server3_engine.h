@@ -0,0 +1,393 @@
+/*
+ *  server3_engine.h - event-driven TCP server core used by server3.c
+ *
+ *  One event loop per thread, each with a listening socket of its own on
+ *  the same port (SO_REUSEPORT): the kernel spreads new connections over
+ *  the loops, and a connection stays on the loop that accepted it, so the
+ *  loops share no locks. Sockets are non-blocking. Output a peer cannot
+ *  take yet is kept per connection and sent on EPOLLOUT; a connection
+ *  with too much output pending is not read until it drains.
+ *
+ *  A handler gets each chunk read from a connection and answers with
+ *  conn_send(); conn_close() ends the connection once its output is sent.
+ *  engine_run() serves until SIGINT or SIGTERM.
+ *
+ *  The loops can run on io_uring instead of epoll (server3_uring.h); the
+ *  handler sees no difference. Each loop counts the system calls it makes.
+ */
+
+#ifndef SERVER3_ENGINE_H
+#define SERVER3_ENGINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define ENGINE_MAX_LOOPS 256
+#define ENGINE_EVENTS 256		/* events taken per epoll_wait() */
+#define ENGINE_BUF (64 * 1024)		/* one read */
+#define ENGINE_OUT_MAX (1024 * 1024)	/* pending output that pauses reading */
+
+struct conn;
+struct uring;
+
+struct handler {
+	void (*on_open)(struct conn *c);	/* may be NULL */
+	void (*on_data)(struct conn *c, char *buf, size_t len);
+	void (*on_close)(struct conn *c);	/* may be NULL */
+};
+
+struct engine_loop {
+	int id;
+	int epfd, lfd;
+	int spare;			/* held open to shed a connection at EMFILE */
+	pthread_t thread;
+	struct engine *eng;
+	struct uring *ring;		/* NULL on epoll */
+	char buf[ENGINE_BUF];
+	unsigned long accepted, open, peak;
+	unsigned long long bytes_in, bytes_out, reads, syscalls;
+};
+
+struct engine {
+	int port, nloops, backlog;
+	int uring;			/* use io_uring if the kernel has it */
+	const struct handler *h;
+	int stopfd;			/* eventfd, readable once the loops should stop */
+	struct engine_loop *loops;
+};
+
+struct conn {
+	int fd;
+	struct engine_loop *loop;
+	char *out;			/* output not sent yet: out[off..len) */
+	size_t off, len, cap;
+	unsigned int events;		/* what epoll watches now */
+	int closing;			/* close once out is sent */
+	int dead;			/* the socket failed: free it */
+	void *data;			/* the handler's */
+
+	/* io_uring only */
+	char *wire;			/* being sent: wire[wire_off..+wire_len) */
+	size_t wire_off, wire_len, wire_cap;
+	struct conn *next_dirty;
+	int dirty, sending, recv_armed, cancelling, shut;
+	unsigned int inflight;		/* requests the ring still owes an answer */
+};
+
+/* Tags for the epoll entries that are not connections */
+static char engine_listen_tag, engine_stop_tag;
+
+#include "server3_uring.h"
+
+/* Append len bytes to c's output */
+static void conn_queue(struct conn *c, const char *buf, size_t len)
+{
+	if (c->len + len > c->cap) {
+		memmove(c->out, c->out + c->off, c->len - c->off);
+		c->len -= c->off;
+		c->off = 0;
+		if (c->len + len > c->cap) {
+			c->cap = (c->len + len) * 2;
+			c->out = realloc(c->out, c->cap);
+		}
+	}
+	memcpy(c->out + c->len, buf, len);
+	c->len += len;
+}
+
+/* Queue len bytes for c. On epoll, what the socket takes is sent right
+ * away; on io_uring it goes with the loop's next submission. */
+static void conn_send(struct conn *c, const char *buf, size_t len)
+{
+	if (c->dead || c->closing)
+		return;
+	if (c->loop->ring != NULL) {
+		conn_queue(c, buf, len);
+		uring_dirty(c);
+		return;
+	}
+	if (c->off == c->len) {
+		ssize_t n = send(c->fd, buf, len, MSG_NOSIGNAL);
+		c->loop->syscalls++;
+		if (n < 0 && errno != EAGAIN && errno != EINTR) {
+			c->dead = 1;
+			return;
+		}
+		if (n > 0) {
+			c->loop->bytes_out += n;
+			buf += n;
+			len -= n;
+		}
+		c->off = c->len = 0;
+	}
+	if (len > 0)
+		conn_queue(c, buf, len);
+}
+
+/* Stop reading c and close it once its output has gone */
+static void conn_close(struct conn *c)
+{
+	c->closing = 1;
+}
+
+static void conn_free(struct conn *c)
+{
+	struct engine_loop *l = c->loop;
+	if (l->eng->h->on_close)
+		l->eng->h->on_close(c);
+	close(c->fd);		/* also takes it out of the epoll set */
+	l->syscalls++;
+	free(c->out);
+	free(c);
+	l->open--;
+}
+
+/* After c was read or written: free it, or watch what it now needs */
+static void conn_settle(struct conn *c)
+{
+	size_t pending = c->len - c->off;
+	unsigned int want = 0;
+	if (c->dead || (c->closing && pending == 0)) {
+		conn_free(c);
+		return;
+	}
+	if (!c->closing && pending < ENGINE_OUT_MAX)
+		want |= EPOLLIN;
+	if (pending > 0)
+		want |= EPOLLOUT;
+	if (want != c->events) {
+		struct epoll_event ev;
+		ev.events = want;
+		ev.data.ptr = c;
+		epoll_ctl(c->loop->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+		c->loop->syscalls++;
+		c->events = want;
+	}
+}
+
+static void conn_flush(struct conn *c)
+{
+	while (c->off < c->len) {
+		ssize_t n = send(c->fd, c->out + c->off, c->len - c->off, MSG_NOSIGNAL);
+		c->loop->syscalls++;
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			if (errno != EAGAIN)
+				c->dead = 1;
+			break;
+		}
+		c->off += n;
+		c->loop->bytes_out += n;
+	}
+}
+
+static void conn_read(struct conn *c)
+{
+	struct engine_loop *l = c->loop;
+	ssize_t n = read(c->fd, l->buf, sizeof(l->buf));
+	l->syscalls++;
+	if (n > 0) {
+		l->bytes_in += n;
+		l->reads++;
+		l->eng->h->on_data(c, l->buf, n);
+	} else if (n == 0) {
+		conn_close(c);	/* the peer is done sending, not reading */
+	} else if (errno != EAGAIN && errno != EINTR) {
+		c->dead = 1;
+	}
+}
+
+static void engine_accept(struct engine_loop *l)
+{
+	int k;
+	/* A bounded batch, so one loop's connections are not starved */
+	for (k = 0; k < 64; k++) {
+		int fd = accept4(l->lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		l->syscalls++;
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if ((errno == EMFILE || errno == ENFILE) && l->spare >= 0) {
+				/* Out of fds: take the connection off the queue
+				 * and drop it, or epoll reports it forever */
+				close(l->spare);
+				fd = accept(l->lfd, NULL, NULL);
+				if (fd >= 0)
+					close(fd);
+				l->spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+				l->syscalls += 4;
+			}
+			return;
+		}
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		l->syscalls += 2;	/* with the epoll_ctl() */
+
+		struct conn *c = calloc(1, sizeof(*c));
+		struct epoll_event ev;
+		c->fd = fd;
+		c->loop = l;
+		c->events = EPOLLIN;
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			close(fd);
+			free(c);
+			continue;
+		}
+		l->accepted++;
+		if (++l->open > l->peak)
+			l->peak = l->open;
+		if (l->eng->h->on_open) {
+			l->eng->h->on_open(c);
+			conn_settle(c);
+		}
+	}
+}
+
+static void *engine_loop_run(void *arg)
+{
+	struct engine_loop *l = arg;
+	struct epoll_event ev[ENGINE_EVENTS];
+	for (;;) {
+		int n = epoll_wait(l->epfd, ev, ENGINE_EVENTS, -1), i;
+		l->syscalls++;
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			perror("epoll_wait");
+			return NULL;
+		}
+		for (i = 0; i < n; i++) {
+			void *p = ev[i].data.ptr;
+			struct conn *c = p;
+			if (p == &engine_stop_tag)
+				return NULL;
+			if (p == &engine_listen_tag) {
+				engine_accept(l);
+				continue;
+			}
+			if (ev[i].events & EPOLLOUT)
+				conn_flush(c);
+			if (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				conn_read(c);
+			conn_settle(c);
+		}
+	}
+}
+
+/* A listening socket of our own on the shared port */
+static int engine_listen(int port, int backlog)
+{
+	struct sockaddr_in addr;
+	int fd, one = 1;
+	if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+		perror("generate error");
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+		perror("SO_REUSEPORT");
+		close(fd);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("bind error");
+		close(fd);
+		return -1;
+	}
+	if (listen(fd, backlog) < 0) {
+		perror("listen error");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Set up the loops and serve until SIGINT or SIGTERM. Asked for io_uring
+ * on a kernel without what it needs, falls back to epoll. Returns -1 if
+ * the port cannot be set up. */
+static int engine_run(struct engine *e)
+{
+	struct rlimit rl;
+	sigset_t stop;
+	int i, sig;
+
+	/* Thousands of connections need thousands of fds */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if (e->nloops < 1)
+		e->nloops = 1;
+	if (e->nloops > ENGINE_MAX_LOOPS)
+		e->nloops = ENGINE_MAX_LOOPS;
+
+	/* Only this thread takes the stop signals; the loops inherit the mask */
+	sigemptyset(&stop);
+	sigaddset(&stop, SIGINT);
+	sigaddset(&stop, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (e->uring && !uring_probe()) {
+		fprintf(stderr, "io_uring unavailable (%s), using epoll\n", strerror(errno));
+		e->uring = 0;
+	}
+
+	e->stopfd = eventfd(0, EFD_CLOEXEC);
+	e->loops = calloc(e->nloops, sizeof(struct engine_loop));
+	for (i = 0; i < e->nloops; i++) {
+		struct engine_loop *l = &e->loops[i];
+		struct epoll_event ev;
+		l->id = i;
+		l->eng = e;
+		l->spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+		if ((l->lfd = engine_listen(e->port, e->backlog)) < 0)
+			return -1;
+		if (e->uring)
+			continue;
+		l->epfd = epoll_create1(EPOLL_CLOEXEC);
+		ev.events = EPOLLIN;
+		ev.data.ptr = &engine_listen_tag;
+		epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->lfd, &ev);
+		ev.data.ptr = &engine_stop_tag;
+		epoll_ctl(l->epfd, EPOLL_CTL_ADD, e->stopfd, &ev);
+	}
+	for (i = 0; i < e->nloops; i++)
+		pthread_create(&e->loops[i].thread, NULL,
+		    e->uring ? uring_loop_run : engine_loop_run, &e->loops[i]);
+
+	sigwait(&stop, &sig);
+	eventfd_write(e->stopfd, 1);	/* never read, so every loop sees it */
+	for (i = 0; i < e->nloops; i++) {
+		struct engine_loop *l = &e->loops[i];
+		pthread_join(l->thread, NULL);
+		printf("loop %d (%s): %lu accepted, %lu open at most, %llu bytes in, %llu out, "
+		       "%llu reads, %llu syscalls (%.3f per read)\n",
+		       i, e->uring ? "io_uring" : "epoll", l->accepted, l->peak,
+		       l->bytes_in, l->bytes_out, l->reads, l->syscalls,
+		       l->reads ? (double) l->syscalls / l->reads : 0.0);
+	}
+	return 0;
+}
+
+#endif
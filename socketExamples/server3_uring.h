@@ -0,0 +1,484 @@
+/*
+ *  server3_uring.h - io_uring backend of server3_engine.h, included by it
+ *
+ *  Each loop owns a ring. One multishot accept takes every connection;
+ *  each connection has one multishot recv that picks its buffers from a
+ *  ring of provided buffers, and a buffer goes back as soon as the
+ *  handler has seen it. Output is queued as in the epoll backend, then
+ *  sent from a second buffer so the handler can queue more while the
+ *  send is in flight; the last send of a closing connection is linked
+ *  to its close. Sockets can stay blocking: the ring polls them itself.
+ *  One io_uring_enter() both submits a batch and waits for the next, so
+ *  a busy loop makes almost no other system calls.
+ *
+ *  Raw system calls, no liburing. Multishot recv needs Linux 6.0;
+ *  uring_probe() says whether this kernel will do.
+ */
+
+#ifndef SERVER3_URING_H
+#define SERVER3_URING_H
+
+#include <stdint.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 4096	/* submission queue; completions get twice that */
+#define URING_BUFS 4096		/* provided buffers per loop, a power of two */
+#define URING_BUF_SIZE 4096
+#define URING_BGID 0
+
+/* What a completion is for, in the low bits of user_data under the
+ * connection pointer */
+enum { OP_ACCEPT, OP_STOP, OP_RECV, OP_SEND, OP_CLOSE, OP_CANCEL };
+#define OP_MASK 7ULL
+
+struct uring {
+	int fd;
+	unsigned int *sq_head, *sq_tail, *sq_mask, sq_entries;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	unsigned int tail;		/* SQEs filled so far */
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *rings;
+	size_t rings_size;
+	struct io_uring_buf_ring *br;
+	char *bufs;
+	unsigned short br_tail;
+	struct conn *dirty;		/* to settle before the next submit */
+};
+
+static int uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned int submit, unsigned int wait, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned int op, void *arg, unsigned int n)
+{
+	return syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+/* Give buffer bid back to the kernel */
+static void uring_give_buf(struct uring *u, unsigned int bid)
+{
+	struct io_uring_buf *b = &u->br->bufs[u->br_tail & (URING_BUFS - 1)];
+
+	b->addr = (uintptr_t) (u->bufs + (size_t) bid * URING_BUF_SIZE);
+	b->len = URING_BUF_SIZE;
+	b->bid = bid;
+	__atomic_store_n(&u->br->tail, ++u->br_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_exit(struct uring *u)
+{
+	close(u->fd);		/* also drops the buffer ring registration */
+	munmap(u->sqes, u->sq_entries * sizeof(struct io_uring_sqe));
+	munmap(u->rings, u->rings_size);
+	free(u->br);
+	free(u->bufs);
+}
+
+/* Set up a ring and its provided buffers. Returns -1 with errno set if
+ * the kernel cannot. The thread that calls this must be the only one to
+ * submit to the ring. */
+static int uring_init(struct uring *u)
+{
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	size_t sq_size, cq_size;
+	char *sq, *cq;
+	unsigned int i;
+	int err;
+
+	memset(u, 0, sizeof(*u));
+	memset(&p, 0, sizeof(p));
+	/* Completions are only reaped by the loop, when it waits */
+	p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	if ((u->fd = uring_setup(URING_ENTRIES, &p)) < 0 && errno == EINVAL) {
+		memset(&p, 0, sizeof(p));
+		u->fd = uring_setup(URING_ENTRIES, &p);
+	}
+	if (u->fd < 0)
+		return -1;
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		close(u->fd);
+		errno = ENOSYS;
+		return -1;
+	}
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	u->rings_size = sq_size > cq_size ? sq_size : cq_size;
+	u->rings = mmap(NULL, u->rings_size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	u->sq_entries = p.sq_entries;
+	u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+	    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->rings == MAP_FAILED || u->sqes == MAP_FAILED) {
+		err = errno;
+		close(u->fd);
+		errno = err;
+		return -1;
+	}
+	sq = cq = u->rings;
+	u->sq_head = (unsigned int *) (sq + p.sq_off.head);
+	u->sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+	u->sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+	u->cq_head = (unsigned int *) (cq + p.cq_off.head);
+	u->cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+	u->cq_mask = (unsigned int *) (cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+	for (i = 0; i < p.sq_entries; i++)
+		((unsigned int *) (sq + p.sq_off.array))[i] = i;
+	u->tail = *u->sq_tail;
+
+	/* The provided buffers, all handed over at once */
+	if (posix_memalign((void **) &u->br, 4096, URING_BUFS * sizeof(struct io_uring_buf)) != 0 ||
+	    (u->bufs = malloc((size_t) URING_BUFS * URING_BUF_SIZE)) == NULL) {
+		uring_exit(u);
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(u->br, 0, URING_BUFS * sizeof(struct io_uring_buf));
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t) u->br;
+	reg.ring_entries = URING_BUFS;
+	reg.bgid = URING_BGID;
+	if (uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		err = errno;
+		uring_exit(u);
+		errno = err;
+		return -1;
+	}
+	for (i = 0; i < URING_BUFS; i++)
+		uring_give_buf(u, i);
+	return 0;
+}
+
+/* Whether this kernel has what the backend needs: a ring, provided
+ * buffer rings (5.19) and multishot recv (6.0, like IORING_OP_SEND_ZC,
+ * which the probe can see). */
+static int uring_probe(void)
+{
+	struct uring u;
+	struct io_uring_probe *probe;
+	size_t size = sizeof(*probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+	int ok;
+
+	if (uring_init(&u) < 0)
+		return 0;
+	probe = calloc(1, size);
+	ok = uring_register(u.fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0 &&
+	    probe->last_op >= IORING_OP_SEND_ZC &&
+	    (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	uring_exit(&u);
+	if (!ok)
+		errno = ENOSYS;
+	return ok;
+}
+
+/* Submit what is queued; with wait, also wait for a completion */
+static void uring_submit(struct engine_loop *l, int wait)
+{
+	struct uring *u = l->ring;
+	unsigned int n;
+
+	__atomic_store_n(u->sq_tail, u->tail, __ATOMIC_RELEASE);
+	n = u->tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+	if (n == 0 && !wait)
+		return;
+	l->syscalls++;
+	if (uring_enter(u->fd, n, wait, wait ? IORING_ENTER_GETEVENTS : 0) < 0 &&
+	    errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+		perror("io_uring_enter");
+		exit(2);
+	}
+}
+
+/* Make room for n more SQEs in this submission */
+static void uring_reserve(struct engine_loop *l, unsigned int n)
+{
+	struct uring *u = l->ring;
+
+	if (u->sq_entries - (u->tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE)) < n)
+		uring_submit(l, 0);
+}
+
+static struct io_uring_sqe *uring_sqe(struct engine_loop *l, void *p, int op)
+{
+	struct uring *u = l->ring;
+	struct io_uring_sqe *sqe;
+
+	uring_reserve(l, 1);
+	sqe = &u->sqes[u->tail++ & *u->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = (uintptr_t) p | op;
+	return sqe;
+}
+
+static void uring_dirty(struct conn *c)
+{
+	struct uring *u = c->loop->ring;
+
+	if (!c->dirty) {
+		c->dirty = 1;
+		c->next_dirty = u->dirty;
+		u->dirty = c;
+	}
+}
+
+static void uring_accept(struct engine_loop *l)
+{
+	struct io_uring_sqe *sqe = uring_sqe(l, NULL, OP_ACCEPT);
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = l->lfd;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+}
+
+static void uring_open(struct engine_loop *l, int fd)
+{
+	struct conn *c = calloc(1, sizeof(*c));
+	int one = 1;
+
+	l->syscalls++;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	c->fd = fd;
+	c->loop = l;
+	l->accepted++;
+	if (++l->open > l->peak)
+		l->peak = l->open;
+	if (l->eng->h->on_open)
+		l->eng->h->on_open(c);
+	uring_dirty(c);
+}
+
+static void uring_free(struct conn *c)
+{
+	struct engine_loop *l = c->loop;
+
+	if (l->eng->h->on_close)
+		l->eng->h->on_close(c);
+	free(c->out);
+	free(c->wire);
+	free(c);
+	l->open--;
+}
+
+/* Send out[off..len) from the wire buffer; out starts over empty */
+static void uring_send(struct engine_loop *l, struct conn *c, int link)
+{
+	struct io_uring_sqe *sqe = uring_sqe(l, c, OP_SEND);
+	char *buf = c->wire;
+	size_t cap = c->wire_cap;
+
+	c->wire = c->out;
+	c->wire_cap = c->cap;
+	c->wire_off = c->off;
+	c->wire_len = c->len - c->off;
+	c->out = buf;
+	c->cap = cap;
+	c->off = c->len = 0;
+	c->sending = 1;
+	c->inflight++;
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = c->fd;
+	sqe->addr = (uintptr_t) (c->wire + c->wire_off);
+	sqe->len = c->wire_len;
+	/* All of it or fail, so a linked close never follows a short send */
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+	if (link)
+		sqe->flags = IOSQE_IO_LINK;
+}
+
+/* Bring c's requests in line with its state, or free it once its fd is
+ * closed and nothing is in flight */
+static void uring_settle(struct engine_loop *l, struct conn *c)
+{
+	size_t pending = c->len - c->off;
+	struct io_uring_sqe *sqe;
+	int ending = c->dead || c->closing;
+
+	if (c->shut) {
+		if (c->inflight == 0)
+			uring_free(c);
+		return;
+	}
+	if (ending || pending >= ENGINE_OUT_MAX) {
+		/* Stop reading, for good or until the output drains */
+		if (c->recv_armed && !c->cancelling) {
+			sqe = uring_sqe(l, c, OP_CANCEL);
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = (uintptr_t) c | OP_RECV;
+			c->cancelling = 1;
+			c->inflight++;
+		}
+	} else if (!c->recv_armed) {
+		sqe = uring_sqe(l, c, OP_RECV);
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = c->fd;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BGID;
+		c->recv_armed = 1;
+		c->inflight++;
+	}
+
+	if (c->sending)
+		return;
+	if (pending > 0 && !c->dead) {
+		if (c->closing)
+			uring_reserve(l, 2);	/* a link must not span submissions */
+		uring_send(l, c, c->closing);
+	}
+	else if (!ending)
+		return;
+	if (ending) {
+		sqe = uring_sqe(l, c, OP_CLOSE);
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = c->fd;
+		c->shut = 1;
+		c->inflight++;
+	}
+}
+
+static void uring_recv_done(struct engine_loop *l, struct conn *c, struct io_uring_cqe *cqe)
+{
+	struct uring *u = l->ring;
+	int res = cqe->res;
+
+	if (!(cqe->flags & IORING_CQE_F_MORE)) {
+		c->recv_armed = c->cancelling = 0;
+		c->inflight--;
+	}
+	if (res > 0) {
+		unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		l->bytes_in += res;
+		l->reads++;
+		if (!c->dead && !c->closing)
+			l->eng->h->on_data(c, u->bufs + (size_t) bid * URING_BUF_SIZE, res);
+		uring_give_buf(u, bid);
+	} else if (res == 0) {
+		c->closing = 1;	/* EOF: the linked send+close flushes first */
+	} else if (res != -ENOBUFS && res != -ECANCELED) {
+		c->dead = 1;
+	}
+}
+
+static void uring_send_done(struct engine_loop *l, struct conn *c, int res)
+{
+	c->sending = 0;
+	c->inflight--;
+	if (res < 0) {
+		c->dead = 1;
+		return;
+	}
+	l->bytes_out += res;
+	if ((size_t) res < c->wire_len) {
+		/* Short: what is left goes out before what was queued since */
+		size_t rest = c->wire_len - res, queued = c->len - c->off;
+		if (rest + queued > c->cap) {
+			c->cap = (rest + queued) * 2;
+			c->out = realloc(c->out, c->cap);
+		}
+		memmove(c->out + rest, c->out + c->off, queued);
+		memcpy(c->out, c->wire + c->wire_off + res, rest);
+		c->off = 0;
+		c->len = rest + queued;
+	}
+}
+
+/* Handle one completion. Returns 1 when the loop should stop. */
+static int uring_complete(struct engine_loop *l, struct io_uring_cqe *cqe)
+{
+	struct conn *c = (struct conn *) (uintptr_t) (cqe->user_data & ~OP_MASK);
+
+	switch (cqe->user_data & OP_MASK) {
+	case OP_STOP:
+		return 1;
+	case OP_ACCEPT:
+		if (cqe->res >= 0) {
+			uring_open(l, cqe->res);
+		} else if ((cqe->res == -EMFILE || cqe->res == -ENFILE) && l->spare >= 0) {
+			/* Shed one connection, as engine_accept() does */
+			int fd;
+			close(l->spare);
+			if ((fd = accept(l->lfd, NULL, NULL)) >= 0)
+				close(fd);
+			l->spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+			l->syscalls += 4;
+		}
+		if (!(cqe->flags & IORING_CQE_F_MORE))
+			uring_accept(l);
+		return 0;
+	case OP_RECV:
+		uring_recv_done(l, c, cqe);
+		break;
+	case OP_SEND:
+		uring_send_done(l, c, cqe->res);
+		break;
+	case OP_CLOSE:
+		/* Cancelled with a failed send it was linked to */
+		if (cqe->res == -ECANCELED) {
+			close(c->fd);
+			l->syscalls++;
+		}
+		c->inflight--;
+		break;
+	case OP_CANCEL:
+		c->inflight--;
+		break;
+	}
+	uring_dirty(c);
+	return 0;
+}
+
+static void *uring_loop_run(void *arg)
+{
+	struct engine_loop *l = arg;
+	struct io_uring_sqe *sqe;
+	struct uring u;
+
+	/* Set up here: the ring belongs to the thread that submits */
+	if (uring_init(&u) < 0) {
+		perror("io_uring");
+		exit(2);
+	}
+	l->ring = &u;
+	uring_accept(l);
+	sqe = uring_sqe(l, NULL, OP_STOP);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = l->eng->stopfd;
+	sqe->poll32_events = POLLIN;
+
+	for (;;) {
+		unsigned int head, tail;
+
+		while (u.dirty != NULL) {
+			struct conn *c = u.dirty;
+			u.dirty = c->next_dirty;
+			c->dirty = 0;
+			uring_settle(l, c);
+		}
+		uring_submit(l, 1);
+		head = *u.cq_head;
+		tail = __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			if (uring_complete(l, &u.cqes[head & *u.cq_mask])) {
+				uring_exit(&u);
+				return NULL;
+			}
+		}
+		__atomic_store_n(u.cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+#endif